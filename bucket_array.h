@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// The size of a huge page on x86-64 and AArch64 (with 4 KiB base pages)
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+// Number of /proc/self/pagemap entries read at once when destroying a BucketArray
+#define PAGEMAP_BATCH 4096
+
+/**
+ * The kind of pages backing a BucketArray.
+ * Huge pages cover a large table with far fewer TLB entries than 4 KiB pages,
+ * which saves a page walk on most random bucket accesses.
+ */
+enum class HugePages {
+    None,        // Base pages
+    Transparent, // 2 MiB-aligned memory the kernel backs with transparent huge pages if it can (madvise(MADV_HUGEPAGE))
+    Explicit     // Reserved huge pages from hugetlbfs (MAP_HUGETLB), Transparent if none are available
+};
+
+/**
+ * Whether T's all-zero bit pattern is a valid, default-constructed object.
+ * That's assumed unless T declares `static constexpr bool zeroInitialized = false`.
+ */
+template <typename T>
+constexpr bool zeroInitialized() {
+    if constexpr(requires { T::zeroInitialized; })
+        return T::zeroInitialized;
+    else
+        return true;
+}
+
+/**
+ * A fixed-size array of buckets in anonymous memory mapped with mmap(),
+ * i.e. in zero pages which the kernel only backs with memory once they are
+ * written to. The elements are not constructed if T's all-zero bit pattern
+ * is a valid object (e.g. an empty HashTable bucket, see zeroInitialized()).
+ * So allocating even a huge array takes constant time and buckets which are
+ * never used cost no memory. The elements are destroyed along with the array,
+ * except for those which are still all zero and don't own anything.
+ */
+template <typename T>
+class BucketArray {
+    public:
+        BucketArray() = default;
+
+        /**
+         * Maps `n` zeroed elements.
+         * If huge pages are requested but unavailable, the array falls back to
+         * transparent huge pages and then to base pages, see pages().
+         *
+         * @param n the number of elements
+         * @param pages the kind of pages the elements should be stored in
+         * @throws std::bad_alloc if the memory can't be mapped
+         */
+        explicit BucketArray(size_t n, HugePages pages = HugePages::None) : _size(n) {
+            if(n == 0)
+                return;
+            _bytes = n * sizeof(T);
+            void* ptr = MAP_FAILED;
+            if(pages != HugePages::None)
+                ptr = mapHuge(pages);
+            if(ptr == MAP_FAILED) {
+                // Only memory which is written to is backed, so don't reserve all of it
+                ptr = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+                _pages = HugePages::None;
+            }
+            if(ptr == MAP_FAILED)
+                throw std::bad_alloc{};
+            _data = std::launder(static_cast<T*>(ptr));
+            if constexpr(!zeroInitialized<T>())
+                std::uninitialized_default_construct_n(_data, _size);
+        }
+
+        BucketArray(BucketArray&& other) noexcept
+                : _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)),
+                  _bytes(std::exchange(other._bytes, 0)), _pages(std::exchange(other._pages, HugePages::None)) { }
+
+        BucketArray& operator=(BucketArray&& other) noexcept {
+            BucketArray old{std::move(*this)};
+            _data = std::exchange(other._data, nullptr);
+            _size = std::exchange(other._size, 0);
+            _bytes = std::exchange(other._bytes, 0);
+            _pages = std::exchange(other._pages, HugePages::None);
+            return *this;
+        }
+
+        ~BucketArray() {
+            if(_data) {
+                destroy();
+                munmap(_data, _bytes);
+            }
+        }
+
+        // Like std::unique_ptr<T[]>, constness isn't passed on to the elements
+        T& operator[](size_t i) const {
+            return _data[i];
+        }
+
+        T* get() const {
+            return _data;
+        }
+
+        size_t size() const {
+            return _size;
+        }
+
+        /**
+         * Returns the kind of pages the array was actually mapped with.
+         * Transparent huge pages are only a hint, the kernel may still back
+         * (parts of) the array with base pages.
+         *
+         * @returns the HugePages the array got
+         */
+        HugePages pages() const {
+            return _pages;
+        }
+
+    private:
+        // Maps the array in huge pages and rounds _bytes up to whole ones,
+        // returns MAP_FAILED if neither kind is available
+        void* mapHuge(HugePages pages) {
+#if defined(__linux__)
+            size_t bytes = (_bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+            if(pages == HugePages::Explicit) {
+                // Fails unless enough pages are reserved in /proc/sys/vm/nr_hugepages.
+                // MAP_NORESERVE would defer that to a SIGBUS on the first write
+                void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if(ptr != MAP_FAILED) {
+                    _bytes = bytes;
+                    _pages = HugePages::Explicit;
+                    return ptr;
+                }
+            }
+
+            // Over-allocate by a huge page to align the array to one, then
+            // unmap the unaligned head and the tail
+            void* ptr = mmap(nullptr, bytes + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if(ptr == MAP_FAILED)
+                return MAP_FAILED;
+            auto* begin = static_cast<char*>(ptr);
+            auto* aligned = reinterpret_cast<char*>(
+                    (reinterpret_cast<uintptr_t>(begin) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+            if(aligned != begin)
+                munmap(begin, static_cast<size_t>(aligned - begin));
+            munmap(aligned + bytes, static_cast<size_t>(begin + HUGE_PAGE_SIZE - aligned));
+            _bytes = bytes;
+            // Without THP support (e.g. "never" in /sys/kernel/mm/transparent_hugepage/enabled)
+            // the aligned memory is used with base pages
+            _pages = madvise(aligned, bytes, MADV_HUGEPAGE) == 0 ? HugePages::Transparent : HugePages::None;
+            return aligned;
+#else
+            (void) pages;
+            return MAP_FAILED;
+#endif
+        }
+
+        /**
+         * Destroys the elements which aren't all zero. Pages which were never
+         * written to are skipped if /proc/self/pagemap tells which ones those
+         * are, since reading them would map all of the zero pages again.
+         * Whether a page is resident (mincore()) doesn't tell: swapped out
+         * pages hold live elements, too.
+         */
+        void destroy() {
+            if constexpr(!zeroInitialized<T>()) {
+                std::destroy_n(_data, _size);
+                return;
+            }
+            const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            const size_t pages = (_bytes + pageSize - 1) / pageSize;
+            const size_t firstPage = reinterpret_cast<uintptr_t>(_data) / pageSize;
+            int pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+            std::vector<uint64_t> entries(std::min<size_t>(pages, PAGEMAP_BATCH));
+            // The first element which hasn't been visited yet
+            size_t next = 0;
+            for(size_t page = 0; page < pages; page += entries.size()) {
+                size_t count = std::min(entries.size(), pages - page);
+                size_t bytes = count * sizeof(uint64_t);
+                bool known = pagemap != -1 && pread(pagemap, entries.data(), bytes,
+                        static_cast<off_t>((firstPage + page) * sizeof(uint64_t))) == static_cast<ssize_t>(bytes);
+                for(size_t p = page; p < page + count; ++p) {
+                    // Bit 63 is set if the page is present, bit 62 if it is swapped out
+                    if(known && (entries[p - page] >> 62) == 0)
+                        continue;
+                    size_t first = std::max(next, p * pageSize / sizeof(T));
+                    size_t last = std::min(_size, ((p + 1) * pageSize + sizeof(T) - 1) / sizeof(T));
+                    for(size_t i = first; i < last; ++i) {
+                        if(!isZero(_data[i]))
+                            std::destroy_at(_data + i);
+                    }
+                    next = std::max(next, last);
+                }
+            }
+            if(pagemap != -1)
+                close(pagemap);
+        }
+
+        // Whether all bytes of `elem` are zero, i.e. it's in the state it was mapped in
+        static bool isZero(const T& elem) {
+            auto* bytes = reinterpret_cast<const unsigned char*>(&elem);
+            return std::all_of(bytes, bytes + sizeof(T), [](unsigned char b) { return b == 0; });
+        }
+
+        T* _data{nullptr};
+        size_t _size{0};
+        // The size of the mapping, a multiple of HUGE_PAGE_SIZE with huge pages
+        size_t _bytes{0};
+        HugePages _pages{HugePages::None};
+};
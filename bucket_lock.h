@@ -0,0 +1,260 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Number of stripes which bucket locks are assigned to by their address
+#define LOCK_STRIPES 256
+// Number of times a blocked thread checks the lock again before it sleeps
+#define LOCK_SPIN_LIMIT 128
+// Number of contended acquisitions after which a stripe chooses its mode again
+#define LOCK_SAMPLE_WINDOW 256
+// Contended reads per contended write from which a stripe favors readers
+#define LOCK_READ_BIAS 8
+
+/**
+ * Tells the CPU that the calling thread spins on a lock.
+ */
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * How the bucket locks of a stripe behave under contention.
+ */
+enum class LockMode : uint8_t {
+    Spin,         // Spin for a while, then sleep. Waiting writers keep new readers out.
+    ReaderBiased, // Like Spin, but readers pass waiting writers
+    Fair          // Sleep right away, waiting writers keep new readers out
+};
+
+/**
+ * The modes of all lock stripes and what they observed, see BucketLock::stats().
+ */
+struct LockStats {
+    size_t spin{0};           // Stripes in LockMode::Spin
+    size_t readerBiased{0};   // Stripes in LockMode::ReaderBiased
+    size_t fair{0};           // Stripes in LockMode::Fair
+    uint64_t contendedReads{0};
+    uint64_t contendedWrites{0};
+    uint64_t parkedWrites{0}; // Contended writes which had to sleep
+};
+
+/**
+ * A reader/writer lock for a single HashTable bucket, usable with
+ * std::unique_lock and std::shared_lock like std::shared_mutex.
+ * It takes 4 bytes instead of 56 and all of them are zero while it is
+ * unlocked, so buckets in fresh zero pages need no initialization (see
+ * BucketArray). Blocked threads sleep in std::atomic::wait(), i.e. on a futex
+ * on Linux.
+ *
+ * Uncontended acquisitions are a single compare-and-swap. Contended ones are
+ * sampled per stripe, a group of locks chosen by address, which then picks a
+ * LockMode: read-dominated stripes let readers pass waiting writers, stripes
+ * whose writers mostly end up sleeping anyway stop spinning and queue up in
+ * the futex, and all others spin before they sleep. The stripes are shared by
+ * all locks of the process.
+ */
+class BucketLock {
+    public:
+        constexpr BucketLock() = default;
+        BucketLock(const BucketLock&) = delete;
+        BucketLock& operator=(const BucketLock&) = delete;
+
+        void lock() {
+            uint32_t state = 0;
+            if(!_state.compare_exchange_strong(state, WRITER, std::memory_order_acquire, std::memory_order_relaxed))
+                lockContended();
+        }
+
+        bool try_lock() {
+            uint32_t state = _state.load(std::memory_order_relaxed);
+            return (state & ~WAITING) == 0
+                && _state.compare_exchange_strong(state, WRITER, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        void unlock() {
+            _state.store(0, std::memory_order_release);
+            _state.notify_all();
+        }
+
+        void lock_shared() {
+            uint32_t state = _state.load(std::memory_order_relaxed);
+            if((state & (WRITER | WAITING))
+                    || !_state.compare_exchange_strong(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                lockSharedContended();
+        }
+
+        bool try_lock_shared() {
+            uint32_t state = _state.load(std::memory_order_relaxed);
+            while(!(state & (WRITER | WAITING))) {
+                if(_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                    return true;
+            }
+            return false;
+        }
+
+        void unlock_shared() {
+            // Only a waiting writer waits for the last reader
+            if(_state.fetch_sub(1, std::memory_order_release) - 1 == WAITING)
+                _state.notify_all();
+        }
+
+        /**
+         * Returns the current mode of the lock's stripe.
+         *
+         * @returns the LockMode
+         */
+        LockMode mode() const {
+            return stripe().mode.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Chooses the mode of a stripe from the contended acquisitions it sampled.
+         *
+         * @param reads the contended reads
+         * @param writes the contended writes
+         * @param parkedWrites the contended writes which had to sleep
+         * @returns the new LockMode
+         */
+        static LockMode classify(uint64_t reads, uint64_t writes, uint64_t parkedWrites) {
+            // Spinning doesn't pay off if writers mostly sleep nonetheless
+            if(writes > 0 && parkedWrites * 2 >= writes)
+                return LockMode::Fair;
+            if(reads >= LOCK_READ_BIAS * writes)
+                return LockMode::ReaderBiased;
+            return LockMode::Spin;
+        }
+
+        /**
+         * Returns how many stripes are in which mode and the contended
+         * acquisitions of all bucket locks so far.
+         *
+         * @returns the LockStats
+         */
+        static LockStats stats() {
+            LockStats stats{};
+            for(auto& stripe : _stripes) {
+                switch(stripe.mode.load(std::memory_order_relaxed)) {
+                    case LockMode::Spin:         ++stats.spin; break;
+                    case LockMode::ReaderBiased: ++stats.readerBiased; break;
+                    case LockMode::Fair:         ++stats.fair; break;
+                }
+                stats.contendedReads += stripe.totalReads.load(std::memory_order_relaxed);
+                stats.contendedWrites += stripe.totalWrites.load(std::memory_order_relaxed);
+                stats.parkedWrites += stripe.totalParked.load(std::memory_order_relaxed);
+            }
+            return stats;
+        }
+
+    private:
+        static constexpr uint32_t WRITER  = 1u << 31;
+        static constexpr uint32_t WAITING = 1u << 30;
+
+        struct alignas(64) Stripe {
+            std::atomic<LockMode> mode{LockMode::Spin};
+            // The current sample
+            std::atomic<uint32_t> events{0};
+            std::atomic<uint32_t> reads{0};
+            std::atomic<uint32_t> writes{0};
+            std::atomic<uint32_t> parked{0};
+            // Since the start of the process, for stats()
+            std::atomic<uint64_t> totalReads{0};
+            std::atomic<uint64_t> totalWrites{0};
+            std::atomic<uint64_t> totalParked{0};
+        };
+
+        static std::array<Stripe, LOCK_STRIPES> _stripes;
+
+        Stripe& stripe() const {
+            // Fibonacci hashing of the address, neighbouring buckets end up in different stripes
+            auto address = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(this));
+            return _stripes[(address * 0x9e3779b97f4a7c15ULL) >> 56];
+        }
+
+        void lockContended() {
+            Stripe& s = stripe();
+            const bool spin = s.mode.load(std::memory_order_relaxed) != LockMode::Fair;
+            bool parked = false;
+            size_t spins = 0;
+            uint32_t state = _state.load(std::memory_order_relaxed);
+            while(true) {
+                if((state & ~WAITING) == 0) {
+                    // Clears WAITING, other waiting writers set it again
+                    if(_state.compare_exchange_weak(state, WRITER, std::memory_order_acquire, std::memory_order_relaxed))
+                        break;
+                    continue;
+                }
+                if(spin && spins < LOCK_SPIN_LIMIT) {
+                    ++spins;
+                    cpu_relax();
+                    state = _state.load(std::memory_order_relaxed);
+                    continue;
+                }
+                if(!(state & WAITING)
+                        && !_state.compare_exchange_weak(state, state | WAITING, std::memory_order_relaxed))
+                    continue;
+                parked = true;
+                _state.wait(state | WAITING, std::memory_order_relaxed);
+                state = _state.load(std::memory_order_relaxed);
+            }
+            sample(s, true, parked);
+        }
+
+        void lockSharedContended() {
+            Stripe& s = stripe();
+            const LockMode mode = s.mode.load(std::memory_order_relaxed);
+            // Biased readers only wait for a writer which holds the lock
+            const uint32_t blocking = mode == LockMode::ReaderBiased ? WRITER : WRITER | WAITING;
+            size_t spins = 0;
+            uint32_t state = _state.load(std::memory_order_relaxed);
+            while(true) {
+                if(!(state & blocking)) {
+                    if(_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                        break;
+                    continue;
+                }
+                if(mode != LockMode::Fair && spins < LOCK_SPIN_LIMIT) {
+                    ++spins;
+                    cpu_relax();
+                } else {
+                    _state.wait(state, std::memory_order_relaxed);
+                }
+                state = _state.load(std::memory_order_relaxed);
+            }
+            sample(s, false, false);
+        }
+
+        // Records a contended acquisition and chooses the stripe's mode again
+        // once the sample is complete
+        static void sample(Stripe& s, bool write, bool parked) {
+            if(write) {
+                s.writes.fetch_add(1, std::memory_order_relaxed);
+                s.totalWrites.fetch_add(1, std::memory_order_relaxed);
+                if(parked) {
+                    s.parked.fetch_add(1, std::memory_order_relaxed);
+                    s.totalParked.fetch_add(1, std::memory_order_relaxed);
+                }
+            } else {
+                s.reads.fetch_add(1, std::memory_order_relaxed);
+                s.totalReads.fetch_add(1, std::memory_order_relaxed);
+            }
+            if(s.events.fetch_add(1, std::memory_order_relaxed) + 1 == LOCK_SAMPLE_WINDOW) {
+                s.mode.store(classify(s.reads.exchange(0, std::memory_order_relaxed),
+                                      s.writes.exchange(0, std::memory_order_relaxed),
+                                      s.parked.exchange(0, std::memory_order_relaxed)),
+                             std::memory_order_relaxed);
+                s.events.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        // WRITER if a writer holds the lock, otherwise the number of readers,
+        // plus WAITING if a writer waits for it
+        std::atomic<uint32_t> _state{0};
+};
+
+inline std::array<BucketLock::Stripe, LOCK_STRIPES> BucketLock::_stripes{};
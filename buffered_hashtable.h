@@ -0,0 +1,352 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "hashtable.h"
+
+// Number of delta stripes, every key always goes to the same one
+#define WRITE_BUFFER_STRIPES 16
+// Number of deltas per chunk
+#define WRITE_BUFFER_CHUNK 4096
+// Number of 64-bit words in the filter of a chunk
+#define WRITE_BUFFER_FILTER_WORDS 1024
+// Maximum time between two merges of full chunks into the table
+#define WRITE_BUFFER_INTERVAL_MS 5
+
+/**
+ * A write-optimized front end for a HashTable, for bursts of writes.
+ * Writes don't touch the table: they are appended to a delta buffer as
+ * blind writes, i.e. without checking the current value, and return right
+ * away. A background thread merges the deltas into the table in batches with
+ * HashTable::apply(), which takes every bucket lock once per batch. So the
+ * throughput of writers doesn't depend on the latency of the bucket locks or
+ * on resizes, and only the merger competes with readers for the buckets.
+ *
+ * The buffer is split into stripes by key hash. Each stripe is a list of
+ * chunks of WRITE_BUFFER_CHUNK deltas, of which writers fill the newest one
+ * without locking: they claim a slot with an atomic increment and mark it as
+ * ready once it is written. get() first looks for the newest delta of the key
+ * in its stripe, where a filter per chunk skips most chunks, and only then in
+ * the table. Since all deltas of a key go through the same stripe in order,
+ * they are merged in the order they were written.
+ *
+ * Until they are merged, buffered writes are not part of table(), size() or
+ * any other view of the table. flush() merges them right away.
+ */
+template <typename K, typename V> requires Hashable<K> && std::equality_comparable<K> && std::copy_constructible<V>
+class BufferedHashTable {
+    public:
+        /**
+         * Constructor.
+         * Starts the merger thread.
+         *
+         * @param cap number of elements the underlying HashTable should have space for after initialization
+         * @param resizable decides whether the underlying HashTable should dynamically resize itself
+         */
+        explicit BufferedHashTable(size_t cap = 4, bool resizable = true) : _table(cap, resizable) {
+            for(auto& stripe : _stripes) {
+                stripe.chunks.push_back(std::make_unique<Chunk>());
+                stripe.active.store(stripe.chunks.back().get(), std::memory_order_release);
+            }
+            _merger = std::thread([this]() { mergeLoop(); });
+        }
+
+        BufferedHashTable(const BufferedHashTable&) = delete;
+        BufferedHashTable& operator=(const BufferedHashTable&) = delete;
+
+        /**
+         * Destructor.
+         * Stops the merger thread and merges all remaining deltas.
+         */
+        ~BufferedHashTable() {
+            {
+                std::scoped_lock lock(_mergerMutex);
+                _stop = true;
+            }
+            _mergerCv.notify_one();
+            _merger.join();
+        }
+
+        /**
+         * Buffers an insertion of `value` or an overwrite of the existing value.
+         *
+         * @param key the entry's key
+         * @param value the new value
+         */
+        void insert_or_assign(K key, V value) {
+            append(std::move(key), std::move(value));
+        }
+
+        /**
+         * Buffers the removal of `key`'s entry, if there is one.
+         *
+         * @param key the entry's key
+         */
+        void remove(K key) {
+            append(std::move(key), std::nullopt);
+        }
+
+        /**
+         * Tries to fetch the value associated with the given `key`, taking
+         * writes into account which are not merged yet.
+         *
+         * @param key the key of the entry which should be retrieved
+         * @return An optional which contains a value if the key existed.
+         */
+        std::optional<V> get(const K& key) const {
+            size_t h = std::hash<K>{}(key);
+            auto& stripe = stripeOf(h);
+            {
+                // Chunks are only recycled with the lock held in write mode
+                std::shared_lock lock(stripe.mutex);
+                for(auto chunk = stripe.chunks.rbegin(); chunk != stripe.chunks.rend(); ++chunk) {
+                    if(auto delta = (*chunk)->find(key, h))
+                        return delta->second;
+                }
+            }
+            return _table.get(key);
+        }
+
+        /**
+         * Merges all writes which returned before flush() was called into the table.
+         */
+        void flush() {
+            for(auto& stripe : _stripes) {
+                Chunk* chunk = stripe.active.load(std::memory_order_acquire);
+                if(chunk->used() > 0)
+                    seal(stripe, chunk);
+            }
+            merge();
+        }
+
+        /**
+         * Returns the underlying HashTable, which contains all merged writes.
+         *
+         * @returns the HashTable
+         */
+        HashTable<K, V>& table() {
+            return _table;
+        }
+
+        /**
+         * Returns the amount of entries in the table, without buffered writes.
+         *
+         * @returns the amount of merged key/value pairs as size_t
+         */
+        size_t size() const {
+            return _table.size();
+        }
+
+    private:
+        // A buffered write, a removal if `second` is empty
+        using Delta = std::pair<K, std::optional<V>>;
+
+        struct Slot {
+            std::atomic<bool> ready{false};
+            size_t hash{0};
+            std::optional<Delta> delta;
+        };
+
+        struct Chunk {
+            std::unique_ptr<Slot[]> slots = std::make_unique<Slot[]>(WRITE_BUFFER_CHUNK);
+            // The number of claimed slots, may exceed WRITE_BUFFER_CHUNK once it is full
+            std::atomic<size_t> tail{0};
+            // The number of writers which may still claim or write a slot
+            std::atomic<size_t> writers{0};
+            // Two bits per key hash, a missing bit rules the key out
+            std::array<std::atomic<uint64_t>, WRITE_BUFFER_FILTER_WORDS> filter{};
+
+            static std::pair<size_t, size_t> bits(size_t h) {
+                constexpr size_t bits = WRITE_BUFFER_FILTER_WORDS * 64;
+                return {(h >> 8) % bits, (h >> 32) % bits};
+            }
+
+            size_t used() const {
+                return std::min<size_t>(tail.load(std::memory_order_acquire), WRITE_BUFFER_CHUNK);
+            }
+
+            void mark(size_t h) {
+                for(size_t bit : {bits(h).first, bits(h).second}) {
+                    filter[bit / 64].fetch_or(uint64_t{1} << (bit % 64), std::memory_order_relaxed);
+                }
+            }
+
+            bool mayContain(size_t h) const {
+                for(size_t bit : {bits(h).first, bits(h).second}) {
+                    if(!(filter[bit / 64].load(std::memory_order_relaxed) & (uint64_t{1} << (bit % 64))))
+                        return false;
+                }
+                return true;
+            }
+
+            // Returns the newest ready delta of `key`, if any
+            const Delta* find(const K& key, size_t h) const {
+                if(!mayContain(h))
+                    return nullptr;
+                for(size_t i = used(); i-- > 0;) {
+                    auto& slot = slots[i];
+                    if(slot.ready.load(std::memory_order_acquire) && slot.hash == h && slot.delta->first == key)
+                        return &*slot.delta;
+                }
+                return nullptr;
+            }
+
+            // Prepares a merged chunk for reuse, must not be reachable by writers
+            void reset() {
+                for(size_t i = 0; i < used(); ++i) {
+                    slots[i].ready.store(false, std::memory_order_relaxed);
+                    slots[i].delta.reset();
+                }
+                for(auto& word : filter) {
+                    word.store(0, std::memory_order_relaxed);
+                }
+                tail.store(0, std::memory_order_relaxed);
+            }
+        };
+
+        struct Stripe {
+            // The chunk writers append to, always the last one of `chunks`
+            std::atomic<Chunk*> active{nullptr};
+            // Guards `chunks` and `spare`
+            mutable std::shared_mutex mutex;
+            // The chunks which were not merged yet, oldest first
+            std::deque<std::unique_ptr<Chunk>> chunks;
+            // Merged chunks for reuse
+            std::vector<std::unique_ptr<Chunk>> spare;
+        };
+
+        Stripe& stripeOf(size_t h) const {
+            return _stripes[h % WRITE_BUFFER_STRIPES];
+        }
+
+        void append(K key, std::optional<V> value) {
+            size_t h = std::hash<K>{}(key);
+            auto& stripe = stripeOf(h);
+            while(true) {
+                Chunk* chunk = stripe.active.load(std::memory_order_seq_cst);
+                // Chunks are recycled rather than freed, so even an outdated one
+                // can be registered with. It is only written to if it is (again)
+                // the active chunk afterwards, which the merger then waits for.
+                chunk->writers.fetch_add(1, std::memory_order_seq_cst);
+                if(stripe.active.load(std::memory_order_seq_cst) != chunk) {
+                    chunk->writers.fetch_sub(1, std::memory_order_release);
+                    continue;
+                }
+
+                size_t i = chunk->tail.fetch_add(1, std::memory_order_relaxed);
+                if(i < WRITE_BUFFER_CHUNK) {
+                    auto& slot = chunk->slots[i];
+                    slot.hash = h;
+                    slot.delta.emplace(std::move(key), std::move(value));
+                    chunk->mark(h);
+                    slot.ready.store(true, std::memory_order_release);
+                    chunk->writers.fetch_sub(1, std::memory_order_release);
+                    if(i == WRITE_BUFFER_CHUNK - 1)
+                        seal(stripe, chunk);
+                    return;
+                }
+                // Full, the writer of the last slot seals it
+                chunk->writers.fetch_sub(1, std::memory_order_release);
+                std::this_thread::yield();
+            }
+        }
+
+        // Replaces `chunk` by a new active chunk unless that happened already
+        // and wakes up the merger
+        void seal(Stripe& stripe, Chunk* chunk) {
+            {
+                std::unique_lock lock(stripe.mutex);
+                if(stripe.active.load(std::memory_order_relaxed) != chunk)
+                    return;
+                if(!stripe.spare.empty()) {
+                    stripe.chunks.push_back(std::move(stripe.spare.back()));
+                    stripe.spare.pop_back();
+                } else {
+                    stripe.chunks.push_back(std::make_unique<Chunk>());
+                }
+                stripe.active.store(stripe.chunks.back().get(), std::memory_order_seq_cst);
+            }
+            _mergerCv.notify_one();
+        }
+
+        // Merges all sealed chunks into the table and recycles them
+        void merge() {
+            std::scoped_lock lock(_mergeMutex);
+            std::vector<Delta> deltas{};
+            std::array<size_t, WRITE_BUFFER_STRIPES> merged{};
+            for(size_t s = 0; s < WRITE_BUFFER_STRIPES; ++s) {
+                auto& stripe = _stripes[s];
+                std::vector<Chunk*> sealed{};
+                {
+                    std::shared_lock slock(stripe.mutex);
+                    for(auto& chunk : stripe.chunks) {
+                        if(chunk.get() != stripe.active.load(std::memory_order_relaxed))
+                            sealed.push_back(chunk.get());
+                    }
+                }
+                // Sealed chunks stay in place until they are merged, and only
+                // this thread removes them
+                for(Chunk* chunk : sealed) {
+                    while(chunk->writers.load(std::memory_order_seq_cst) != 0) {
+                        std::this_thread::yield();
+                    }
+                    // Readers may still read the deltas, so they are copied
+                    for(size_t i = 0; i < chunk->used(); ++i) {
+                        deltas.push_back(*chunk->slots[i].delta);
+                    }
+                }
+                merged[s] = sealed.size();
+            }
+            if(deltas.empty())
+                return;
+
+            _table.apply(std::move(deltas));
+
+            for(size_t s = 0; s < WRITE_BUFFER_STRIPES; ++s) {
+                auto& stripe = _stripes[s];
+                std::unique_lock slock(stripe.mutex);
+                for(size_t i = 0; i < merged[s]; ++i) {
+                    stripe.chunks.front()->reset();
+                    stripe.spare.push_back(std::move(stripe.chunks.front()));
+                    stripe.chunks.pop_front();
+                }
+            }
+        }
+
+        void mergeLoop() {
+            std::unique_lock lock(_mergerMutex);
+            while(!_stop) {
+                _mergerCv.wait_for(lock, std::chrono::milliseconds(WRITE_BUFFER_INTERVAL_MS));
+                lock.unlock();
+                merge();
+                lock.lock();
+            }
+            lock.unlock();
+            flush();
+        }
+
+        HashTable<K, V> _table;
+        mutable std::array<Stripe, WRITE_BUFFER_STRIPES> _stripes{};
+
+        // Serializes merges of the merger thread and flush()
+        std::mutex _mergeMutex;
+
+        std::thread _merger;
+        std::mutex _mergerMutex;
+        std::condition_variable _mergerCv;
+        bool _stop{false};
+};
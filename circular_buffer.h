@@ -1,14 +1,14 @@
 #pragma once
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
 
 #include <cstdlib>
 
 #include <optional>
-#include <semaphore>
-#include <shared_mutex>
 #include <iostream> // Debugging
 #include <stdexcept>
 
@@ -23,153 +23,137 @@ class timeout_exception : public std::exception {
         }
 };
 
+static_assert(std::atomic<size_t>::is_always_lock_free, "atomic<size_t> is not always lock free and can't be used in shared memory");
+
 /**
  * A simple circular buffer / fixed size queue
  * The number of available slots is defined by the template parameter N.
  *
- * TODO: Timeouts so that locked threads can return if a client dies?
+ * It is a lock-free bounded queue for several producers and consumers
+ * (after Dmitry Vyukov's), so it works between processes if it is placed
+ * in shared memory. Every slot carries a sequence number which tells whether
+ * it is free for the producer of a given position or filled for its consumer,
+ * so pushing or popping an element takes a single compare-and-swap on the
+ * tail or head. Threads only sleep on a futex word if the buffer is full or
+ * empty, and only the timed push_back() and pop() block at all.
  */
 
 template <typename T, size_t N = 10>
 class CircularBuffer {
-    public: 
-        CircularBuffer() : _buffer(std::array<T, N> {}), _capacity(N), _pmutex(), _openSlots(N), _fullSlots(0) {
-
+    public:
+        CircularBuffer() : _buffer(), _capacity(N) {
+            for(size_t i = 0; i < N; ++i) {
+                _buffer[i].seq.store(i, std::memory_order_relaxed);
+            }
         }
 
         /**
          * Returns a reference to the slot at the provided index.
-         * //Reading and writing via the subscript operator is not threadsafe per se.
+         * Reading and writing via the subscript operator is not threadsafe per se.
          */
         T& operator[](const size_t idx) {
-            _pmutex.lock();
-            T& ret = _buffer[idx];
-            _pmutex.unlock();
-            return ret;
+            return _buffer[idx].elem;
         }
 
         /**
-         * Updates the given slot by overwriting it with the provided element.
+         * Returns and pops the element at the current head as well as its index.
+         * Does not block, see pop(timeout) for that.
+         *
+         * @returns the element at the current head as well as its index, std::nullopt if the buffer is empty
          */
-        void update(size_t idx, T elem) {
-            if(idx >= _capacity)
-                throw std::out_of_range("Update failed");
-            _pmutex.lock();
-            _buffer[idx] = elem;
-            _pmutex.unlock();
+        std::optional<std::pair<T, size_t>> pop() {
+            return try_pop();
         }
 
         /**
-         * @returns an std::optional possibly containing an std::pair<T, size_t> consisting of the content of the current slot at _headIdx as well as the _headIdx itself
+         * Like pop(), but waits for up to `timeout` if the buffer is empty.
+         *
+         * @param timeout the maximum time to block
+         * @returns the element at the current head as well as its index, std::nullopt if the buffer stayed empty
          */
-        std::optional<std::pair<T, size_t>> peek() {
-            if(isEmpty())
-                return std::nullopt;
-
-            //_fullSlots.acquire();
-            T elem;
-            size_t idx;
-            {
-                //std::lock_guard<std::mutex> lock(_mutex);
-                _pmutex.lock();
-                elem = _buffer[_headIdx];
-                idx  = _headIdx;
-                //_mutex.unlock();
-                _pmutex.unlock();
-            }
-            //_openSlots.release();
-
-            return std::make_optional(std::pair<T, size_t>{elem, idx});
+        std::optional<std::pair<T, size_t>> pop(std::chrono::milliseconds timeout) {
+            return waitFor(_pushes, _popWaiters, timeout, [this]() { return try_pop(); });
         }
 
         /**
-         * Returns and pops the element at the current head as well as its index.
+         * Returns and pops the element at the current head as well as its
+         * index if there is one, e.g. to drain a batch of elements.
          *
-         * @returns the element at the current head without modifying it as well as its index.
+         * @returns the element at the current head as well as its index if there was one
          */
-        std::optional<std::pair<T, size_t>> pop() {
-            if(isEmpty())
-                return std::nullopt;
-
-            //_fullSlots.acquire();
-            //_nWait_full++;
-            _fullSlots.wait();
-            //if(!_fullSlots.try_acquire_for(2s))
-            //    throw timeout_exception();
-
-            T elem;
-            size_t idx;
-            {
-                //std::lock_guard<std::mutex> lock(_mutex);
-                _pmutex.lock();
-                //_buffer[_headIdx] = T(); // overwrite slot, not actually needed, remove for better performance
-                elem = _buffer[_headIdx];
-                idx  = _headIdx;
-                --_size;
-                if((long long)_size < 0) {
-                    std::cout << "pop(): _size < 0: " << _size << std::endl;
-                    std::cout << "elem = " << elem << std::endl;
-                    std::cout << "idx = " << idx << std::endl;
-                    std::exit(-1);
+        std::optional<std::pair<T, size_t>> try_pop() {
+            size_t pos = _head.load(std::memory_order_relaxed);
+            while(true) {
+                Slot& slot = _buffer[pos % N];
+                size_t seq = slot.seq.load(std::memory_order_acquire);
+                if(seq == pos + 1) {
+                    // The slot is filled, claim it
+                    if(_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                } else if(seq < pos + 1) {
+                    // The producer of this position hasn't filled it yet
+                    return std::nullopt;
+                } else {
+                    // Another consumer took it already
+                    pos = _head.load(std::memory_order_relaxed);
                 }
-
-                _headIdx = (_headIdx + 1) % _capacity;
-                //_mutex.unlock();
-                //unsigned int fullVal = _fullSlots.current_value();
-                //unsigned int openVal = _openSlots.current_value();
-                //std::cout << "fullVal: " << fullVal << "; openVal: " << openVal << std::endl;
-
-                _pmutex.unlock();
             }
-            //_openSlots.release();
-            //_nPost_open++;
-            _openSlots.post();
 
-            return std::make_optional<std::pair<T, size_t>>(std::make_pair(elem, idx));
+            Slot& slot = _buffer[pos % N];
+            std::optional<std::pair<T, size_t>> ret = std::make_optional<std::pair<T, size_t>>(std::make_pair(slot.elem, pos % N));
+            // Hand the slot to the producer one lap ahead
+            slot.seq.store(pos + N, std::memory_order_release);
+            notify(_pops, _pushWaiters);
+
+            return ret;
         }
 
         /**
          * Enqueues a new element.
          *
          * @param elem the new element
-         * @returns a positive integer (the now filled slot's index) on success, -1 on failure
+         * @returns a positive integer (the now filled slot's index) on success, -1 if the buffer is full
          */
-        int push_back(T elem) {
-            if(isFull())
-                return -1;
-
-            //_openSlots.acquire();
-            //_nWait_open++;
-            _openSlots.wait();
-            //_openSlots.try_acquire_for(2s);
-            //if(!_fullSlots.try_acquire_for(2s))
-            //    throw timeout_exception();
-
-            int ret; //= static_cast<int>(_tailIdx);
-            {
-                //std::lock_guard<std::mutex> lock(_mutex);
-                _pmutex.lock();
-                ret = static_cast<int>(_tailIdx);
-                _buffer[_tailIdx] = elem;
-                ++_size;
-                if((long long)_size < 0) {
-                    std::cout << "push(): _size < 0!" << std::endl;
-                    std::exit(-1);
+        int push_back(const T& elem) {
+            size_t pos = _tail.load(std::memory_order_relaxed);
+            while(true) {
+                Slot& slot = _buffer[pos % N];
+                size_t seq = slot.seq.load(std::memory_order_acquire);
+                if(seq == pos) {
+                    // The slot is free, claim it
+                    if(_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                } else if(seq < pos) {
+                    // The consumer of the previous lap hasn't emptied it yet
+                    return -1;
+                } else {
+                    // Another producer took it already
+                    pos = _tail.load(std::memory_order_relaxed);
                 }
-                //++_tailIdx; // TODO avoid modulo etc.
-                //_tailIdx %= _capacity;
-                _tailIdx = (_tailIdx + 1) % _capacity;
-                //_mutex.unlock();
-                //unsigned int fullVal = _fullSlots.current_value();
-                //unsigned int openVal = _openSlots.current_value();
-                //std::cout << "fullVal: " << fullVal << "; openVal: " << openVal << std::endl;
-                _pmutex.unlock();
             }
-            //_fullSlots.release();
-            //_nPost_full++;
-            _fullSlots.post();
 
-            return ret;
+            Slot& slot = _buffer[pos % N];
+            slot.elem = elem;
+            // Hand the slot to its consumer
+            slot.seq.store(pos + 1, std::memory_order_release);
+            notify(_pushes, _popWaiters);
+
+            return static_cast<int>(pos % N);
+        }
+
+        /**
+         * Like push_back(), but waits for up to `timeout` if the buffer is full.
+         *
+         * @param elem the new element
+         * @param timeout the maximum time to block
+         * @returns a positive integer (the now filled slot's index) on success, -1 if the buffer stayed full
+         */
+        int push_back(const T& elem, std::chrono::milliseconds timeout) {
+            auto idx = waitFor(_pops, _pushWaiters, timeout, [&]() -> std::optional<int> {
+                int ret = push_back(elem);
+                return ret == -1 ? std::nullopt : std::make_optional(ret);
+            });
+            return idx.value_or(-1);
         }
 
         /**
@@ -178,95 +162,103 @@ class CircularBuffer {
          * the CircularBuffer.
          */
         T& at(const size_t idx) {
-            //std::lock_guard<std::mutex> lock(_mutex);
-            _pmutex.lock();
-            //std::unique_lock lock(_rwlock);
-            auto& ret = _buffer.at(idx);
-            //_mutex.unlock();
-            _pmutex.unlock();
-
-            return ret;
-            //return _buffer.at(idx);
+            return _buffer.at(idx).elem;
         }
 
         inline bool isEmpty() const {
-            //std::lock_guard<std::mutex> lock(_mutex);
-            _pmutex.lock();
-            bool ret = _size == 0;
-            //std::shared_lock lock(_rwlock);
-            //return _size == 0;
-            //_mutex.unlock();
-            _pmutex.unlock();
-
-            return ret;
+            return size() == 0;
         }
 
         inline bool isFull() const {
-            //std::lock_guard<std::mutex> lock(_mutex);
-            _pmutex.lock();
-            bool ret = _size == _capacity;
-            //std::shared_lock lock(_rwlock);
-            //_mutex.unlock();
-            _pmutex.unlock();
-
-            return ret;
-            //return _size == _capacity;
+            return size() == _capacity;
         }
 
         size_t capacity() const {
-            _pmutex.lock();
-            size_t ret = _capacity;
-            _pmutex.unlock();
-            return ret;
-            //return _capacity;
+            return _capacity;
         }
 
+        /**
+         * Returns the number of elements in the buffer. While other threads
+         * push or pop, it's only a snapshot, including elements which are
+         * still being written or read.
+         */
         size_t size() const {
-            //std::lock_guard<std::mutex> lock(_mutex);
-            _pmutex.lock();
-            //std::shared_lock lock(_rwlock);
-            size_t ret = _size;
-            //_mutex.unlock();
-            _pmutex.unlock();
-
-            return ret;
-            //return _size;
-        }
-
-        void lock() const {
-            _pmutex.lock();
-        }
-        void unlock() const {
-            _pmutex.unlock();
+            // Read the head first, so the tail can't be behind it
+            size_t head = _head.load(std::memory_order_acquire);
+            size_t tail = _tail.load(std::memory_order_acquire);
+            return std::min(tail - head, _capacity);
         }
 
-        // Debugging
+        // Debugging, the slots are read without synchronization
         void printBuffer() const {
             std::cout << "Buffer capacity: " << capacity() << " (" << size() << " used)" \
-                << "; Head: " << _headIdx << ", Tail: " << _tailIdx << std::endl;
+                << "; Head: " << _head.load() % N << ", Tail: " << _tail.load() % N << std::endl;
             for(size_t i = 0; i < _capacity; ++i) {
-                std::cout << _buffer[i] << " ";
+                std::cout << _buffer[i].elem << " ";
             }
             std::cout << std::endl;
         }
 
     private:
-        //std::atomic<size_t> _nWait_open{0};
-        //std::atomic<size_t> _nPost_open{0};
-        //std::atomic<size_t> _nWait_full{0};
-        //std::atomic<size_t> _nPost_full{0};
-        std::array<T, N> _buffer;
+        struct Slot {
+            // pos if the slot is free for the producer of position pos,
+            // pos + 1 once it's filled for the consumer of position pos
+            std::atomic<size_t> seq{0};
+            T elem{};
+        };
 
-        size_t _headIdx{0};
-        size_t _tailIdx{0};
+        /**
+         * Calls `attempt` until it returns a value, sleeping on `word` while
+         * it doesn't, for up to `timeout` in total. `waiters` counts the
+         * sleepers, so that the other side only calls futexWake() if needed.
+         */
+        template <typename F>
+        static auto waitFor(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiters, std::chrono::milliseconds timeout, F&& attempt) {
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            while(true) {
+                if(auto ret = attempt())
+                    return ret;
+                uint32_t seen = word.load(std::memory_order_acquire);
+                waiters.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                // Check again after registering, a notify() in between might
+                // not have seen us
+                auto ret = attempt();
+                auto now = std::chrono::steady_clock::now();
+                if(!ret && now < deadline)
+                    futexWait(&word, seen, std::chrono::ceil<std::chrono::milliseconds>(deadline - now));
+                waiters.fetch_sub(1, std::memory_order_relaxed);
+                if(ret || std::chrono::steady_clock::now() >= deadline)
+                    return ret;
+            }
+        }
 
-        size_t _capacity;
-        size_t _size{0};
+        /**
+         * Wakes the threads sleeping on `word`, if there are any.
+         * Has to be called after publishing a slot.
+         */
+        static void notify(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiters) {
+            // Orders the slot's sequence number before reading `waiters`,
+            // pairs with the fence after registering in waitFor()
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(waiters.load(std::memory_order_relaxed) == 0)
+                return;
+            word.fetch_add(1, std::memory_order_release);
+            futexWake(&word);
+        }
+
+        std::array<Slot, N> _buffer;
 
-        //mutable std::mutex _mutex;
-        mutable PMutex _pmutex;
-        //std::counting_semaphore<N> _openSlots;
-        //std::counting_semaphore<N> _fullSlots;
-        CountingSemaphore _openSlots;
-        CountingSemaphore _fullSlots;
+        // The next positions to pop and to push, on their own cache lines
+        // since consumers and producers update them independently
+        alignas(64) std::atomic<size_t> _head{0};
+        alignas(64) std::atomic<size_t> _tail{0};
+
+        // Futex words bumped after a push / pop if someone is waiting for it
+        alignas(64) std::atomic<uint32_t> _pushes{0};
+        std::atomic<uint32_t> _popWaiters{0};
+        std::atomic<uint32_t> _pops{0};
+        std::atomic<uint32_t> _pushWaiters{0};
+
+        size_t _capacity;
 };
@@ -50,6 +50,33 @@ std::string uint8_to_string(const uint8_t* v, const size_t len) {
     return ss.str();
 }
 
+/**
+ * Maps the server's watch table, see WATCH.
+ *
+ * @param name the name of its shared memory object
+ * @returns a pointer to the WatchTable, nullptr on failure
+ */
+WatchTable* mapWatchTable(const std::string& name) {
+    // The table is mapped writable since futexes can't wait on read-only pages
+    int watch_fd = shm_open(name.c_str(), O_RDWR, 0666);
+    if(watch_fd == -1) {
+        perror("client.cpp: watch(): shm_open() failed");
+        return nullptr;
+    }
+    void* watch_ptr = mmap(NULL,
+                           sizeof(WatchTable),
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED,
+                           watch_fd,
+                           0);
+    close(watch_fd);
+    if(watch_ptr == MAP_FAILED) {
+        perror("client.cpp: watch(): mmap() failed");
+        return nullptr;
+    }
+    return reinterpret_cast<WatchTable*>(watch_ptr);
+}
+
 Message sendMsg(Mailbox<slots>* mailbox, const enum Message::mode_t mode, const char* key, const char* value) {
     Message msg{};
     msg.client_id.store(client_id);
@@ -78,22 +105,40 @@ Message sendMsg(Mailbox<slots>* mailbox, const enum Message::mode_t mode, const
             msg.mode = mode;
             memcpy(msg.key.data(), key, strlen(key) + 1);
             break;
+        case Message::WATCH:
+            msg.mode = mode;
+            memcpy(msg.key.data(), key, strlen(key) + 1);
+            break;
+        case Message::ERASE_IF:
+            msg.mode = mode;
+            // Key is interpreted as a glob pattern in this case
+            memcpy(msg.key.data(), key, strlen(key) + 1);
+            break;
+        case Message::MULTI:
+            msg.mode = mode;
+            // The operations are already encoded in value, see encodeMulti()
+            memcpy(msg.data.data(), value, MAX_LENGTH_VAL);
+            break;
+        case Message::SUBSCRIBE:
+            msg.mode = mode;
+            break;
+        case Message::GET_KEYS_BY_VALUE:
+            msg.mode = mode;
+            memcpy(msg.data.data(), value, strlen(value) + 1);
+            break;
         case Message::EXIT:
             running = false;
             break;
         default:
-            throw std::invalid_argument("mode must be either GET, INSERT, READ_BUCKET or DELETE");            
+            throw std::invalid_argument("mode must be either GET, INSERT, READ_BUCKET, DELETE, MULTI, SUBSCRIBE, GET_KEYS_BY_VALUE, WATCH or ERASE_IF");
             break;
     }
     // Send the message
     size_t idx = static_cast<size_t>(-1);
-    idx = static_cast<size_t>(mailbox->msgs.push_back(msg));
+    idx = static_cast<size_t>(mailbox->msgs.push_back(msg, 100ms));
     while(idx == static_cast<size_t>(-1)) {
-        // push_back failed due to the Message buffer being full, wait and try again
-        //std::cout << "push_back() failed: Message buffer full" << std::endl;
-        
-        std::this_thread::sleep_for(15ms);
-        idx = static_cast<size_t>(mailbox->msgs.push_back(msg));
+        // The Message buffer stayed full, wait again
+        idx = static_cast<size_t>(mailbox->msgs.push_back(msg, 100ms));
     }
 
     Message ret{};
@@ -168,6 +213,14 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
     std::signal(SIGINT, signal_handler);
 
     Message response;
+    // The operations of the last MULTI request
+    std::vector<MultiOp> multi_ops{};
+    // The server's change feed and our position in it, see SUBSCRIBE
+    const ChangeFeed* feed = nullptr;
+    LogCursor cursor{};
+    // The server's watch table, see WATCH
+    WatchTable* watches = nullptr;
+    bool watched = false;
     // Main loop
     do {
         response = Message();
@@ -217,8 +270,68 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
                 }
                 response = sendMsg(mailbox_ptr, Message::DELETE, input[1].c_str());
 
+            } else if(input[0] == "multi") {
+                // e.g. MULTI DELETE a INSERT b 1 GET c
+                std::vector<MultiOp> ops{};
+                for(size_t i = 1; i < input.size(); ++i) {
+                    std::string op = input[i];
+                    std::transform(op.begin(), op.end(), op.begin(),
+                            [](char c){ return std::tolower(c); });
+                    if(op == "insert" && i + 2 < input.size()) {
+                        ops.push_back(MultiOp{Message::INSERT, input[i + 1], input[i + 2]});
+                        i += 2;
+                    } else if((op == "get" || op == "delete") && i + 1 < input.size()) {
+                        ops.push_back(MultiOp{op == "get" ? Message::GET : Message::DELETE, input[i + 1], ""});
+                        i += 1;
+                    } else {
+                        throw std::invalid_argument("MULTI expects a list of operations, e.g. MULTI DELETE a INSERT b 1 GET c");
+                    }
+                }
+                std::array<uint8_t, MAX_LENGTH_VAL> data{};
+                if(ops.empty() || !encodeMulti(ops, data)) {
+                    throw std::invalid_argument("MULTI expects between 1 and 255 operations which fit into "
+                            + std::to_string(MAX_LENGTH_VAL) + " bytes");
+                }
+                multi_ops = ops;
+                response = sendMsg(mailbox_ptr, Message::MULTI, "", reinterpret_cast<const char*>(data.data()));
+
+            } else if(input[0] == "subscribe") {
+                // Once subscribed, SUBSCRIBE prints the changes since the last call
+                if(!feed)
+                    response = sendMsg(mailbox_ptr, Message::SUBSCRIBE, "");
+            } else if(input[0] == "get_keys_by_value") {
+                if(input.size() < 2 || input[1].length() > MAX_LENGTH_VAL) {
+                    throw std::invalid_argument("GET_KEYS_BY_VALUE expects 1 argument (the value) with a maximum length of "
+                            + std::to_string(MAX_LENGTH_VAL));
+                }
+                response = sendMsg(mailbox_ptr, Message::GET_KEYS_BY_VALUE, "", input[1].c_str());
+            } else if(input[0] == "watch") {
+                if(input.size() < 2 || input[1].length() > MAX_LENGTH_KEY) {
+                    throw std::invalid_argument("WATCH expects 1 argument (the key) with a maximum length of "
+                            + std::to_string(MAX_LENGTH_KEY));
+                }
+                // Blocks until the key changes, then fetches its new value with a GET
+                response = sendMsg(mailbox_ptr, Message::WATCH, input[1].c_str());
+                watched = response.success;
+                if(watched && !watches)
+                    watches = mapWatchTable(uint8_to_string(response.key.data(), response.key.size()));
+                if(watched && watches) {
+                    size_t slot = 0;
+                    uint32_t seen = 0;
+                    std::istringstream{uint8_to_string(response.data.data(), response.data.size())} >> slot >> seen;
+                    // Wakes up regularly to notice a SIGINT
+                    while(running && slot < WATCH_SLOTS && !futexWait(&watches->versions[slot], seen, 100ms)) { }
+                    response = sendMsg(mailbox_ptr, Message::GET, input[1].c_str());
+                }
+                watched = watched && watches;
+            } else if(input[0] == "erase_if") {
+                if(input.size() < 2 || input[1].length() >= MAX_LENGTH_KEY) {
+                    throw std::invalid_argument("ERASE_IF expects 1 argument (a glob pattern such as tenant42:*) with a maximum length of "
+                            + std::to_string(MAX_LENGTH_KEY - 1));
+                }
+                response = sendMsg(mailbox_ptr, Message::ERASE_IF, input[1].c_str());
             } else {
-                throw std::invalid_argument("the first argument must be either GET, INSERT, READ_BUCKET or DELETE");            
+                throw std::invalid_argument("the first argument must be either GET, INSERT, READ_BUCKET, DELETE, MULTI, SUBSCRIBE, GET_KEYS_BY_VALUE, WATCH or ERASE_IF");
             }
         } catch(std::invalid_argument& e) {
             std::cerr << e.what() << std::endl;
@@ -251,6 +364,106 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
                     std::cout << " failed";
                 }
                 std::cout << std::endl;
+        } else if(input[0] == "multi") {
+                std::cout << "MULTI";
+                if(response.success) {
+                    std::cout << " succeeded" << std::endl;
+                    auto results = decodeMultiResults(response.data);
+                    for(size_t i = 0; i < multi_ops.size() && i < results.size(); ++i) {
+                        auto& op = multi_ops[i];
+                        switch(op.mode) {
+                            case Message::GET:
+                                std::cout << "  GET " << op.key << " -> " << (results[i] ? *results[i] : "(none)") << std::endl;
+                                break;
+                            case Message::INSERT:
+                                std::cout << "  INSERT " << op.key << " -> " << op.value << std::endl;
+                                break;
+                            default:
+                                std::cout << "  DELETE " << op.key << " -> " << (results[i] ? *results[i] : "(none)") << std::endl;
+                                break;
+                        }
+                    }
+                } else {
+                    std::cout << " failed" << std::endl;
+                }
+        } else if(input[0] == "subscribe") {
+            if(!feed) {
+                if(!response.success) {
+                    std::cout << "SUBSCRIBE failed" << std::endl;
+                    continue;
+                }
+                std::string feed_name = uint8_to_string(response.key.data(), response.key.size());
+                try {
+                    cursor.next = std::stoull(uint8_to_string(response.data.data(), response.data.size()));
+                } catch(std::exception const& e) {
+                    std::cerr << "client.cpp: subscribe(): " << e.what() << std::endl;
+                    continue;
+                }
+                // Reading the feed only loads from it, so it's mapped read-only
+                int feed_fd = shm_open(feed_name.c_str(), O_RDONLY, 0666);
+                if(feed_fd == -1) {
+                    perror("client.cpp: subscribe(): shm_open() failed");
+                    continue;
+                }
+                void* feed_ptr = mmap(NULL,
+                                      sizeof(ChangeFeed),
+                                      PROT_READ,
+                                      MAP_SHARED,
+                                      feed_fd,
+                                      0);
+                close(feed_fd);
+                if(feed_ptr == MAP_FAILED) {
+                    perror("client.cpp: subscribe(): mmap() failed");
+                    continue;
+                }
+                feed = reinterpret_cast<const ChangeFeed*>(feed_ptr);
+                std::cout << "SUBSCRIBE " << feed_name << " at change " << cursor.next << " succeeded" << std::endl;
+            } else {
+                uint64_t dropped = cursor.dropped;
+                feed->read(cursor, [](const ChangeRecord& record) {
+                    std::cout << (record.mode == Message::DELETE ? "  DELETE " : "  INSERT ")
+                              << uint8_to_string(record.key.data(), record.key.size());
+                    if(record.mode != Message::DELETE)
+                        std::cout << " -> " << uint8_to_string(record.value.data(), record.value.size());
+                    std::cout << std::endl;
+                });
+                if(cursor.dropped != dropped)
+                    std::cout << "  (" << cursor.dropped - dropped << " changes were missed)" << std::endl;
+            }
+        } else if(input[0] == "get_keys_by_value") {
+                std::cout << "GET_KEYS_BY_VALUE " << input[1];
+                if(response.success) {
+                    auto keys = decodeKeys(response.data);
+                    std::cout << " ->";
+                    for(auto& key : keys) {
+                        std::cout << " " << key;
+                    }
+                    std::string total = uint8_to_string(response.key.data(), response.key.size());
+                    if(total != std::to_string(keys.size()))
+                        std::cout << " (" << total << " keys in total)";
+                    std::cout << " succeeded";
+                } else {
+                    std::cout << " failed";
+                }
+                std::cout << std::endl;
+        } else if(input[0] == "erase_if") {
+                std::cout << "ERASE_IF " << input[1];
+                if(response.success) {
+                    std::cout << " -> " << uint8_to_string(response.data.data(), response.data.size()) << " removed";
+                } else {
+                    std::cout << " failed";
+                }
+                std::cout << std::endl;
+        } else if(input[0] == "watch") {
+                std::cout << "WATCH " << input[1];
+                if(!watched) {
+                    std::cout << " failed";
+                } else if(response.success) {
+                    std::cout << " -> " << uint8_to_string(response.data.data(), response.data.size()) << " succeeded";
+                } else {
+                    std::cout << " -> (deleted) succeeded";
+                }
+                std::cout << std::endl;
         } else if(input[0] == "read_bucket") {
             if(response.success) {
                 // 1. Establish a new shared memory segment, given the name
@@ -326,6 +539,10 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
     } while(running);
 
     // Tidy up
+    if(feed)
+        munmap(const_cast<ChangeFeed*>(feed), sizeof(ChangeFeed));
+    if(watches)
+        munmap(watches, sizeof(WatchTable));
     //shm_unlink(name);
     //munmap(shared_mem_ptr, sizeof(MMap) + sizeof(Message) * slots);
     close(shm_fd);
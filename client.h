@@ -9,9 +9,11 @@
  * The client has to wait for a response inside sendMsg().
  *
  * @param mailbox a pointer to the shared mailbox
- * @param msg the request's type (either GET, INSERT, READ_BUCKET or DELETE)
+ * @param msg the request's type (either GET, INSERT, READ_BUCKET, DELETE, MULTI, SUBSCRIBE, GET_KEYS_BY_VALUE or WATCH)
  * @param key the key for getting a value from the HashTable or writing to the HashTable
  * @param value the C-style string which should be written to the HashTable. May be NULL or ignored when getting a value.
+ *              For MULTI, the MAX_LENGTH_VAL bytes of operations encoded by encodeMulti().
+ *              For GET_KEYS_BY_VALUE, the value to look up.
  * @returns a new Message containing the server's response
  */
 Message sendMsg(Mailbox<slots>* mailbox, const enum Message::mode_t mode, const char* key, const char* value = NULL);
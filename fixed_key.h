@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <string_view>
+#include <type_traits>
+
+#include "simd.h"
+
+/**
+ * A string of at most N bytes which is stored inline, i.e. without a heap
+ * allocation, mirroring the fixed-size key and data fields of a Message.
+ * The bytes behind the string are zero up to the next multiple of HASH_STRIPE,
+ * so comparisons and hashing work on whole SIMD registers (see simd_equal()
+ * and hash_bytes()) instead of single bytes. Copies only touch these bytes
+ * as well, not all N of them.
+ */
+template <size_t N>
+class FixedBytes {
+    public:
+        static_assert(N > 0 && N <= UINT16_MAX, "FixedBytes supports 1 to 65535 bytes");
+
+        // A single length byte for keys, two bytes for longer values
+        using length_type = std::conditional_t<N <= UINT8_MAX, uint8_t, uint16_t>;
+
+        FixedBytes() = default;
+
+        FixedBytes(const FixedBytes& other) : _length(other._length) {
+            std::memcpy(_bytes.data(), other._bytes.data(), padded(_length));
+        }
+
+        FixedBytes& operator=(const FixedBytes& other) {
+            _length = other._length;
+            std::memmove(_bytes.data(), other._bytes.data(), padded(_length));
+            return *this;
+        }
+
+        /**
+         * Copies up to N bytes.
+         *
+         * @param bytes the string's bytes
+         * @param length the string's length, longer strings are truncated
+         */
+        FixedBytes(const uint8_t* bytes, size_t length) : _length(static_cast<length_type>(std::min(length, N))) {
+            std::memcpy(_bytes.data(), bytes, _length);
+            std::memset(_bytes.data() + _length, 0, padded(_length) - _length);
+        }
+
+        /**
+         * Copies a zero-terminated (or completely filled) field of a Message.
+         *
+         * @param bytes the field
+         */
+        explicit FixedBytes(const std::array<uint8_t, N>& bytes)
+                : FixedBytes(bytes.data(), simd_find<uint8_t>(bytes.data(), N, 0)) { }
+
+        explicit FixedBytes(std::string_view str) : FixedBytes(reinterpret_cast<const uint8_t*>(str.data()), str.size()) { }
+
+        const uint8_t* data() const {
+            return _bytes.data();
+        }
+
+        size_t size() const {
+            return _length;
+        }
+
+        bool empty() const {
+            return _length == 0;
+        }
+
+        static constexpr size_t max_size() {
+            return N;
+        }
+
+        explicit operator std::string_view() const {
+            return std::string_view{reinterpret_cast<const char*>(_bytes.data()), _length};
+        }
+
+        /**
+         * Copies the string into a Message field of the same size, which is
+         * zero-terminated unless the string fills it completely.
+         *
+         * @param bytes the field
+         */
+        void copy_to(std::array<uint8_t, N>& bytes) const {
+            std::memcpy(bytes.data(), _bytes.data(), _length);
+            std::memset(bytes.data() + _length, 0, N - _length);
+        }
+
+        bool operator==(const FixedBytes& other) const {
+            return _length == other._length && simd_equal(_bytes.data(), other._bytes.data(), padded(_length));
+        }
+
+        size_t hash() const {
+            return static_cast<size_t>(hash_bytes(_bytes.data(), padded(_length), _length));
+        }
+
+        /**
+         * Hashes `count` strings at once (see hash_bytes_batch()), with the
+         * same results as hash(). Without AVX2 they are simply hashed one by one.
+         *
+         * @param strs the strings
+         * @param count the amount of strings
+         * @param hashes receives the hashes
+         */
+        static void hash_batch(const FixedBytes* const* strs, size_t count, size_t* hashes) {
+            if(hash_batch_width() == 1) {
+                for(size_t i = 0; i < count; ++i) {
+                    hashes[i] = strs[i]->hash();
+                }
+                return;
+            }
+            // Gathered 64 strings at a time
+            constexpr size_t chunk = 64;
+            const uint8_t* bytes[chunk];
+            size_t n[chunk];
+            uint64_t lengths[chunk];
+            uint64_t out[chunk];
+            for(size_t i = 0; i < count; i += chunk) {
+                size_t batch = std::min(chunk, count - i);
+                for(size_t b = 0; b < batch; ++b) {
+                    bytes[b] = strs[i + b]->_bytes.data();
+                    n[b] = padded(strs[i + b]->_length);
+                    lengths[b] = strs[i + b]->_length;
+                    // The strings of the next chunk are loaded while this one is hashed
+                    if(i + chunk + b < count) {
+                        auto* next = reinterpret_cast<const char*>(strs[i + chunk + b]);
+                        for(size_t line = 0; line < sizeof(FixedBytes); line += 64) {
+                            __builtin_prefetch(next + line);
+                        }
+                    }
+                }
+                hash_bytes_batch(bytes, n, lengths, batch, out);
+                for(size_t b = 0; b < batch; ++b) {
+                    hashes[i + b] = static_cast<size_t>(out[b]);
+                }
+            }
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const FixedBytes& str) {
+            return os << static_cast<std::string_view>(str);
+        }
+
+    private:
+        // Rounds up to whole stripes of hash_bytes(), which are whole SIMD registers as well
+        static constexpr size_t padded(size_t length) {
+            return (length + HASH_STRIPE - 1) / HASH_STRIPE * HASH_STRIPE;
+        }
+
+        length_type _length{0};
+        // Only the first padded(_length) bytes are initialized
+        std::array<uint8_t, padded(N)> _bytes;
+};
+
+// A key as sent in a Message, up to MAX_LENGTH_KEY bytes
+template <size_t N>
+using FixedKey = FixedBytes<N>;
+
+// A value as sent in a Message, up to MAX_LENGTH_VAL bytes
+template <size_t N>
+using FixedValue = FixedBytes<N>;
+
+template <size_t N>
+struct std::hash<FixedBytes<N>> {
+    size_t operator()(const FixedBytes<N>& str) const noexcept {
+        return str.hash();
+    }
+
+    // See BatchHashable
+    static void hash_batch(const FixedBytes<N>* const* strs, size_t count, size_t* hashes) {
+        FixedBytes<N>::hash_batch(strs, count, hashes);
+    }
+};
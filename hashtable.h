@@ -2,24 +2,66 @@
 
 #include <iostream>
 
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
 #include <concepts>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
-#include <list>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <ranges>
 #include <shared_mutex>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <unordered_map> // For hashes
+#include <utility>
 #include <vector>
+#include <unistd.h>
+
+#include "bucket_array.h"
+#include "bucket_lock.h"
+#include "heap.h"
+#include "lock_policy.h"
+#include "lookup_task.h"
+#include "mutation_log.h"
+#include "reverse_index.h"
+#include "slot_blocks.h"
 
 // Maximum load factor
 #define ALPHA_MAX 0.75
 #define ALPHA_MIN 0.10
 #define GROWTH_FACTOR 2
 #define SHRINK_FACTOR 2
+// Load factor at which mutators resize the HashTable themselves
+// even though a maintenance thread is running
+#define ALPHA_HARD_MAX 2.0
+// Minimum time between two resizes done by the maintenance thread
+#define MAINTENANCE_INTERVAL_MS 10
+// Number of records kept by the mutation log, see enableMutationLog()
+#define MUTATION_LOG_SIZE 4096
+// Number of lookups interleaved by get_batch()
+#define BATCH_WIDTH 8
+// Number of buckets compacted at once, see compact()
+#define COMPACTION_BATCH 1024
+// Number of keys bulk_load() hashes at once if its Hash is a BatchHasher
+#define BULK_HASH_BATCH 64
+// Minimum number of deltas apply() sorts into buckets at once
+#define APPLY_MIN_WINDOW 64
+// Minimum number of buckets each thread of an export scans, see Snapshot::getEntries()
+#define EXPORT_MIN_BUCKETS 65536
+// Number of bytes each thread of Snapshot::write() collects before writing them out
+#define EXPORT_BUFFER_BYTES (1 << 20)
+// Minimum number of buckets each thread of erase_if() sweeps
+#define SWEEP_MIN_BUCKETS 65536
 
 /**
  * Hashable concept as found at https://en.cppreference.com/w/cpp/language/constraints
@@ -29,36 +71,71 @@ concept Hashable = requires(T a) {
     { std::hash<T>{}(a) } -> std::convertible_to<std::size_t>;
 };
 
+/**
+ * A function object H which hashes keys of type T, like std::hash<T>.
+ */
+template<typename H, typename T>
+concept Hasher = std::default_initializable<H> && requires(const H& h, const T& a) {
+    { h(a) } -> std::convertible_to<std::size_t>;
+};
+
+/**
+ * A Hasher which can also hash several keys at once with the same results,
+ * e.g. std::hash<FixedBytes> with AVX2. get_batch() and bulk_load() use it.
+ */
+template<typename H, typename T>
+concept BatchHasher = Hasher<H, T> && requires(const T* const* keys, size_t count, size_t* hashes) {
+    H::hash_batch(keys, count, hashes);
+};
+
+/**
+ * A Hasher of integer keys whose hashes leave the high bits, which the tags of
+ * the SlotBlocks are taken from, mostly empty, e.g. IntegerHash. Tables using
+ * it compare the keys themselves with SIMD instead of the tags.
+ */
+template<typename H, typename T>
+concept SimdKeysHasher = Hasher<H, T> && std::integral<T> && requires {
+    requires H::simd_keys;
+};
+
+/**
+ * A key type whose std::hash is a BatchHasher.
+ */
+template<typename T>
+concept BatchHashable = Hashable<T> && BatchHasher<std::hash<T>, T>;
+
 
 /**
  * A hashtable storing key-value pairs supporting concurrent operations.
  * Hash collisions are resolved by chaining via linked lists for each bucket in the table.
- * Synchronization of concurrent operations is done via reader/writer locks, i.e. std::shared_mutex.
+ * Synchronization of concurrent operations is done via reader/writer locks, one for the whole
+ * table and one per bucket, which the LockPolicy chooses. By default, that's std::shared_mutex
+ * for the whole table and a BucketLock per bucket (AdaptiveLocks), NullLocks disables locking
+ * for tables which only one thread uses.
+ * Keys are hashed with `Hash`, std::hash<K> by default (see IntegerHash for integer keys).
+ * If `Capacity` is not 0, the HashTable has exactly that many buckets, stored inline
+ * instead of in a BucketArray. Then it never resizes, bucket indices are computed
+ * modulo a constant and there is no global lock (see StaticHashTable).
  */ 
-template <typename K, typename V> requires Hashable<K> && std::equality_comparable<K> && std::copy_constructible<V>
+template <typename K, typename V, typename Locks = AdaptiveLocks, typename Hash = std::hash<K>, size_t Capacity = 0>
+    requires Hasher<Hash, K> && std::equality_comparable<K> && std::copy_constructible<V> && LockPolicy<Locks>
 class HashTable {
     /**
      * Proxy class to enable correct assignments via the subscript operator
      */
     struct Proxy {
         private:
-            HashTable<K, V>& table;
+            HashTable& table;
             const K key;
             const V element;
 
         public:
             // Constructor
-            Proxy(HashTable<K, V>& table, const K key, const V element) : table(table), key(key), element(element) { }
+            Proxy(HashTable& table, const K key, const V element) : table(table), key(key), element(element) { }
 
             // Assignment via subscript in class HashTable
             void operator=(V rhs) {
-                auto entry = table.get(key);
-                if(entry) {
-                    table.remove(key);
-                    table.insert(key, rhs);
-                } else {
-                    table.insert(key, rhs);
-                }
+                table.insert_or_assign(key, rhs);
             }
 
             friend std::ostream& operator<<(std::ostream& os, const Proxy& prox) {
@@ -70,6 +147,9 @@ class HashTable {
             operator V() const { return element; };
             operator V() { return element; };
         };
+
+    // See snapshot()
+    struct SnapshotState;
    
     public:
         /**
@@ -77,11 +157,20 @@ class HashTable {
          * Initializes a HashTable with default space for 4 elements
          * which is also resizable.
          */
-        HashTable() : _size(0),
-                      _capacity(4),
-                      _resizable(true),
-                      _storage(std::make_unique<Node[]>(4)),
-                      _mutex() { }
+        HashTable() requires (Capacity == 0) : _size(0),
+                                               _capacity(4),
+                                               _resizable(true),
+                                               _storage(4),
+                                               _mutex() { }
+
+        /**
+         * The constructor of a HashTable with a fixed Capacity, which is never resizable.
+         */
+        HashTable() requires (Capacity > 0) : _size(0),
+                                              _capacity(Capacity),
+                                              _resizable(false),
+                                              _storage(),
+                                              _mutex() { }
 
         /**
          * Constructor.
@@ -89,18 +178,30 @@ class HashTable {
          *
          * @param cap number of elements the HashTable should have space for after initialization
          * @param resizable decides whether the HashTable should dynamically resize itself or keep a static amount of buckets
+         * @param pages the kind of pages the bucket array is stored in, also after resizing (see HugePages)
          */
-        HashTable(size_t cap, bool resizable = false) : _size(0),
-                                                        _capacity(cap),
-                                                        _resizable(resizable),
-                                                        _mutex() {
+        HashTable(size_t cap, bool resizable = false, HugePages pages = HugePages::None) requires (Capacity == 0) : _size(0),
+                                                                                          _capacity(cap),
+                                                                                          _resizable(resizable),
+                                                                                          _pages(pages),
+                                                                                          _mutex() {
             if(cap < 4) {
-                _storage = std::make_unique<Node[]>(4);
+                _storage = Buckets(4, pages);
             } else {
-                _storage = std::make_unique<Node[]>(cap);
+                _storage = Buckets(cap, pages);
             }
         }
 
+        /**
+         * Destructor.
+         * Stops the maintenance thread if one is running and copies the
+         * remaining entries into all outstanding snapshots.
+         */
+        ~HashTable() {
+            stopMaintenance();
+            completeSnapshots();
+        }
+
         /**
          * Inserts `value` into the HashTable given the `key`.
          * If the entry exists already, insert() returns false and does
@@ -121,29 +222,53 @@ class HashTable {
             // reached
             //if(_size == _capacity)
             //    return false;
-            if(get(key))
-                return false;
-            
+
             // Get the table's global lock in read mode
             std::shared_lock glock(_mutex);
 
-            if(_resizable) {
-                while(needsResize(1)) {
-                    glock.unlock();
-                    resize(1);
-                    glock.lock();
-                }
-            }
+            ensureCapacity(glock, 1);
 
+            size_t h = hashOf(key);
+            auto& bucket = _storage[index(h)];
+            // Get this bucket's lock
+            std::unique_lock lock(bucket._lock);
 
-            size_t hash_val = hash(key);
-            auto& bucket = _storage[hash_val];
+            // The key is looked up under the bucket's lock so that concurrent
+            // insertions of the same key can't both succeed
+            if(find(bucket, key, h) != bucket.slots.end())
+                return false;
+
+            emplaceEntry(bucket, h, std::move(key), std::move(value));
+
+            return true;
+        }
+
+        /**
+         * Inserts `value` into the HashTable given the `key` or overwrites
+         * the existing entry's value.
+         *
+         * @param key the entry's key
+         * @param value the value which is to be inserted into the HashTable
+         * @return True if a new entry was inserted, false if an existing one was overwritten
+         */
+        bool insert_or_assign(K key, V value) {
+            // Get the table's global lock in read mode
+            std::shared_lock glock(_mutex);
+
+            ensureCapacity(glock, 1);
+
+            size_t h = hashOf(key);
+            auto& bucket = _storage[index(h)];
             // Get this bucket's lock
             std::unique_lock lock(bucket._lock);
 
-            bucket.l.push_back(std::make_pair(key, value));
+            auto result = find(bucket, key, h);
+            if(result != bucket.slots.end()) {
+                assignEntry(bucket, result, std::move(value));
+                return false;
+            }
 
-            ++_size; 
+            emplaceEntry(bucket, h, std::move(key), std::move(value));
 
             return true;
         }
@@ -158,24 +283,103 @@ class HashTable {
             // Get the table's global lock in read mode
             std::shared_lock glock(_mutex);
 
-            size_t hash_val = hash(key);
-            auto& bucket = _storage[hash_val];
+            size_t h = hashOf(key);
+            auto& bucket = _storage[index(h)];
             // Get this bucket's lock
             std::shared_lock lock(bucket._lock);
 
-            if(bucket.l.size() == 0)
+            if(bucket.slots.empty())
                 return std::nullopt;
 
-            auto result = std::find_if(bucket.l.begin(), bucket.l.end(),
-                    [&key](const std::pair<K, V>& elem) { return elem.first == key; } );
+            auto result = find(bucket, key, h);
 
-            if(result != bucket.l.end()) {
+            if(result != bucket.slots.end()) {
                 return std::make_optional((*result).second);
             } else {
                 return std::nullopt;
             }
         }
 
+        /**
+         * Looks up all `keys` at once and returns their values in the same order.
+         * Each lookup is a coroutine which prefetches the bucket, every slot block
+         * and every key's heap buffer and suspends before dereferencing them,
+         * while up to `width` lookups are interleaved. This way the cache misses
+         * of several chain walks overlap instead of being waited for one by one,
+         * which pays off for tables much larger than the CPU's caches.
+         * Keys of the same bucket share a lookup, which holds the bucket's lock
+         * in read mode while suspended, so no bucket is locked twice at a time.
+         *
+         * @param keys the keys of the entries which should be retrieved
+         * @param width the amount of lookups in flight at a time
+         * @return one optional per key which contains a value if the key existed
+         */
+        std::vector<std::optional<V>> get_batch(const std::vector<K>& keys, size_t width = BATCH_WIDTH) const {
+            std::vector<std::optional<V>> results(keys.size());
+            width = std::max(width, static_cast<size_t>(1));
+
+            std::vector<const K*> ptrs(keys.size());
+            for(size_t i = 0; i < keys.size(); ++i) {
+                ptrs[i] = &keys[i];
+            }
+            std::vector<size_t> hashes(keys.size());
+            hashKeys(ptrs.data(), keys.size(), hashes.data());
+
+            // Get the table's global lock in read mode once for all lookups
+            std::shared_lock glock(_mutex);
+
+            // Keys of the same bucket are looked up by the same task one after
+            // another, as a thread must not hold a bucket's lock in read mode
+            // twice: same[i] is the next key in the bucket of key i or SIZE_MAX
+            std::vector<size_t> heads{};
+            heads.reserve(keys.size());
+            std::vector<size_t> same(keys.size(), SIZE_MAX);
+            std::vector<size_t> buckets(keys.size());
+            {
+                // The last key seen of each bucket, by open addressing on the bucket index
+                std::vector<size_t> last(2 * std::bit_ceil(keys.size()), SIZE_MAX);
+                size_t mask = last.size() - 1;
+                for(size_t i = 0; i < keys.size(); ++i) {
+                    buckets[i] = index(hashes[i]);
+                    size_t pos = buckets[i] & mask;
+                    while(last[pos] != SIZE_MAX && buckets[last[pos]] != buckets[i]) {
+                        pos = (pos + 1) & mask;
+                    }
+                    if(last[pos] == SIZE_MAX)
+                        heads.push_back(i);
+                    else
+                        same[last[pos]] = i;
+                    last[pos] = i;
+                }
+            }
+
+            size_t next = 0;
+            std::vector<LookupTask> tasks{};
+            tasks.reserve(std::min(width, heads.size()));
+            for(; next < heads.size() && tasks.size() < width; ++next) {
+                tasks.push_back(lookup(buckets[heads[next]], keys, hashes.data(), heads[next], same.data(), results.data()));
+            }
+
+            // Resume the lookups round robin, replacing finished ones by new ones
+            while(!tasks.empty()) {
+                for(size_t i = 0; i < tasks.size();) {
+                    tasks[i].resume();
+                    if(!tasks[i].done()) {
+                        ++i;
+                    } else if(next < heads.size()) {
+                        tasks[i] = lookup(buckets[heads[next]], keys, hashes.data(), heads[next], same.data(), results.data());
+                        ++next;
+                        ++i;
+                    } else {
+                        tasks[i] = std::move(tasks.back());
+                        tasks.pop_back();
+                    }
+                }
+            }
+
+            return results;
+        }
+
         /**
          * Tries to remove and return the value associated with the given `key`.
          *
@@ -186,32 +390,484 @@ class HashTable {
             // Get the table's global lock in read mode
             std::shared_lock glock(_mutex);
 
-            if(_resizable) {
-                while(needsResize(-1)) {
-                    glock.unlock();
-                    resize(-1);
-                    glock.lock();
+            ensureCapacity(glock, -1);
+
+            size_t h = hashOf(key);
+            auto& bucket = _storage[index(h)];
+            // Get this bucket's lock
+            std::unique_lock lock(bucket._lock);
+
+            auto const result = find(bucket, key, h);
+
+            if(result != bucket.slots.end()) {
+                return std::make_optional(eraseEntry(bucket, result));
+            } else {
+                return std::nullopt;
+            }
+        }
+
+        /**
+         * Removes all entries for which pred(key, value) returns true in a single
+         * sweep over the buckets, each of which is swept in place with its lock
+         * held in write mode. Unlike a remove() per entry, the load factor is
+         * only checked once all buckets are done, so the HashTable shrinks at
+         * most once. With several threads, every thread sweeps its own range of
+         * buckets, so `pred` has to be safe to call concurrently.
+         *
+         * @param pred a callable taking a const K& and a const V&
+         * @param threads the amount of threads to use, 0 chooses std::thread::hardware_concurrency()
+         * @returns the amount of removed entries
+         */
+        template <typename P> requires std::is_invocable_r_v<bool, P, const K&, const V&>
+        size_t erase_if(P pred, size_t threads = 1) {
+            // Get the table's global lock in read mode, which keeps the buckets
+            // from being resized during the sweep
+            std::shared_lock glock(_mutex);
+
+            const size_t cap = _capacity;
+            if(threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            // Spawning threads does not pay off for small tables
+            threads = std::min(threads, cap / SWEEP_MIN_BUCKETS + 1);
+
+            std::atomic<size_t> removed{0};
+            auto sweep = [&](size_t first, size_t last) {
+                size_t count = 0;
+                for(size_t i = first; i < last; ++i) {
+                    auto& bucket = _storage[i];
+                    std::unique_lock lock(bucket._lock);
+                    // Back to front, so erasing only moves entries which are kept
+                    // into the hole
+                    for(size_t pos = bucket.slots.size(); pos-- > 0;) {
+                        auto it = bucket.slots.at(pos);
+                        if(pred(std::as_const(it->first), std::as_const(it->second))) {
+                            eraseEntry(bucket, it);
+                            ++count;
+                        }
+                    }
                 }
+                removed += count;
+            };
+            std::vector<std::thread> workers{};
+            for(size_t t = 1; t < threads; ++t) {
+                workers.emplace_back(sweep, t * cap / threads, (t + 1) * cap / threads);
+            }
+            sweep(0, cap / threads);
+            for(auto& w : workers) {
+                w.join();
             }
 
-            size_t hash_val = hash(key);
-            auto& bucket = _storage[hash_val];
+            ensureCapacity(glock, 0);
+            return removed;
+        }
+
+        /**
+         * Keeps only the entries for which pred(key, value) returns true,
+         * see erase_if().
+         *
+         * @param pred a callable taking a const K& and a const V&
+         * @param threads the amount of threads to use, 0 chooses std::thread::hardware_concurrency()
+         * @returns the amount of removed entries
+         */
+        template <typename P> requires std::is_invocable_r_v<bool, P, const K&, const V&>
+        size_t retain(P pred, size_t threads = 1) {
+            return erase_if([&pred](const K& key, const V& value) { return !pred(key, value); }, threads);
+        }
+
+        /**
+         * Atomically computes a new value for `key` from its current one.
+         * `f` is called with the current value (or std::nullopt if the key is
+         * missing) while the key's bucket is locked. If it returns a value,
+         * the entry is inserted or overwritten, otherwise it is removed.
+         *
+         * @param key the entry's key
+         * @param f a callable taking an std::optional<V> and returning an std::optional<V>
+         * @return the new value associated with `key`, if any
+         */
+        template <typename F> requires std::is_invocable_r_v<std::optional<V>, F, std::optional<V>>
+        std::optional<V> compute(const K& key, F&& f) {
+            // Get the table's global lock in read mode
+            std::shared_lock glock(_mutex);
+
+            ensureCapacity(glock, 1);
+
+            size_t h = hashOf(key);
+            auto& bucket = _storage[index(h)];
             // Get this bucket's lock
             std::unique_lock lock(bucket._lock);
 
-            auto const result = std::find_if(bucket.l.begin(), bucket.l.end(),
-                    [&key](const std::pair<K, V>& elem) { return elem.first == key; } );
+            auto result = find(bucket, key, h);
+            bool present = result != bucket.slots.end();
+            std::optional<V> value = std::invoke(std::forward<F>(f),
+                    present ? std::make_optional(result->second) : std::nullopt);
+
+            if(value) {
+                if(present)
+                    assignEntry(bucket, result, *value);
+                else
+                    emplaceEntry(bucket, h, key, *value);
+            } else if(present) {
+                eraseEntry(bucket, result);
+            }
 
-            if(result != bucket.l.end()) {
-                --_size;
-                auto ret = std::make_optional((*result).second);
-                bucket.l.erase(result);
+            return value;
+        }
 
-                return ret;
-            } else {
+        /**
+         * Returns the value associated with `key`. If the key is missing,
+         * `factory` is called while the key's bucket is locked and its result
+         * is inserted, so it is called at most once per missing key.
+         *
+         * @param key the entry's key
+         * @param factory a callable returning a V
+         * @return the existing or newly inserted value
+         */
+        template <typename F> requires std::is_invocable_r_v<V, F>
+        V compute_if_absent(const K& key, F&& factory) {
+            // Get the table's global lock in read mode
+            std::shared_lock glock(_mutex);
+
+            ensureCapacity(glock, 1);
+
+            size_t h = hashOf(key);
+            auto& bucket = _storage[index(h)];
+            // Get this bucket's lock
+            std::unique_lock lock(bucket._lock);
+
+            auto result = find(bucket, key, h);
+            if(result != bucket.slots.end())
+                return result->second;
+
+            V value = std::invoke(std::forward<F>(factory));
+            emplaceEntry(bucket, h, key, value);
+
+            return value;
+        }
+
+        /**
+         * Atomically computes a new value for an existing `key`.
+         * `f` is called with the current value while the key's bucket is locked.
+         * If it returns a value, the entry is overwritten, otherwise it is removed.
+         * Nothing happens if the key is missing.
+         *
+         * @param key the entry's key
+         * @param f a callable taking a const V& and returning an std::optional<V>
+         * @return the new value associated with `key`, if any
+         */
+        template <typename F> requires std::is_invocable_r_v<std::optional<V>, F, const V&>
+        std::optional<V> compute_if_present(const K& key, F&& f) {
+            // Get the table's global lock in read mode
+            std::shared_lock glock(_mutex);
+
+            size_t h = hashOf(key);
+            auto& bucket = _storage[index(h)];
+            // Get this bucket's lock
+            std::unique_lock lock(bucket._lock);
+
+            auto result = find(bucket, key, h);
+            if(result == bucket.slots.end())
                 return std::nullopt;
+
+            std::optional<V> value = std::invoke(std::forward<F>(f), std::as_const(result->second));
+            if(value)
+                assignEntry(bucket, result, *value);
+            else
+                eraseEntry(bucket, result);
+
+            return value;
+        }
+
+        /**
+         * Inserts `value` if `key` is missing. Otherwise `combiner` is called
+         * with the current value and `value` while the key's bucket is locked.
+         * If it returns a value, the entry is overwritten, otherwise it is removed.
+         *
+         * @param key the entry's key
+         * @param value the value which is inserted or combined with the current one
+         * @param combiner a callable taking two const V& and returning an std::optional<V>
+         * @return the new value associated with `key`, if any
+         */
+        template <typename F> requires std::is_invocable_r_v<std::optional<V>, F, const V&, const V&>
+        std::optional<V> merge(const K& key, V value, F&& combiner) {
+            // Get the table's global lock in read mode
+            std::shared_lock glock(_mutex);
+
+            ensureCapacity(glock, 1);
+
+            size_t h = hashOf(key);
+            auto& bucket = _storage[index(h)];
+            // Get this bucket's lock
+            std::unique_lock lock(bucket._lock);
+
+            auto result = find(bucket, key, h);
+            if(result == bucket.slots.end()) {
+                emplaceEntry(bucket, h, key, value);
+                return std::make_optional(std::move(value));
+            }
+
+            std::optional<V> merged = std::invoke(std::forward<F>(combiner), std::as_const(result->second), std::as_const(value));
+            if(merged)
+                assignEntry(bucket, result, *merged);
+            else
+                eraseEntry(bucket, result);
+
+            return merged;
+        }
+
+        /**
+         * Adds `delta` to the value associated with `key` in place, inserting
+         * `delta` if the key is missing. Only one lock acquisition is needed,
+         * which makes it the fast path for counters.
+         * If V is an integer or floating point type which std::atomic_ref
+         * supports without a lock, existing values are incremented with an
+         * atomic fetch_add while holding the bucket's lock in read mode only,
+         * so increments of one bucket don't wait for each other. Concurrent
+         * readers of the same entry may then see the old or the new value.
+         * This isn't possible while a MutationLog, change hook, reverse index
+         * or snapshot has to observe the change, nor for missing keys, which
+         * take the bucket's lock in write mode like insert_or_assign().
+         *
+         * @param key the entry's key
+         * @param delta the amount which is added
+         * @return the new value associated with `key`
+         */
+        V increment(const K& key, V delta = V{1}) requires std::is_arithmetic_v<V> {
+            // Get the table's global lock in read mode
+            std::shared_lock glock(_mutex);
+
+            size_t h = hashOf(key);
+            if constexpr(atomicIncrement) {
+                auto& bucket = _storage[index(h)];
+                // Get this bucket's lock in read mode, the global lock keeps logs,
+                // hooks, reverse indexes and snapshots from being added meanwhile
+                std::shared_lock lock(bucket._lock);
+                if(!observed(bucket)) {
+                    auto result = find(bucket, key, h);
+                    if(result != bucket.slots.end())
+                        return static_cast<V>(std::atomic_ref<V>(result->second).fetch_add(delta, std::memory_order_relaxed) + delta);
+                }
+            }
+
+            ensureCapacity(glock, 1);
+
+            auto& bucket = _storage[index(h)];
+            // Get this bucket's lock
+            std::unique_lock lock(bucket._lock);
+
+            auto result = find(bucket, key, h);
+            if(result == bucket.slots.end()) {
+                emplaceEntry(bucket, h, key, delta);
+                return delta;
+            }
+
+            assignEntry(bucket, result, static_cast<V>(result->second + delta));
+            return result->second;
+        }
+
+        /**
+         * Inserts all key/value pairs of `pairs` at once, e.g. to warm up the HashTable.
+         * The bucket array is resized up front (if the HashTable is resizable),
+         * then the pairs are partitioned by bucket and each partition is written
+         * by its own thread without taking any bucket locks.
+         * Like insert(), existing entries are not overwritten and for duplicate keys
+         * in `pairs` the first pair wins.
+         * All other operations are blocked until bulk_load() returns.
+         * The pairs are copied into the HashTable, or moved if `pairs` yields
+         * rvalues or is an rvalue container, e.g. bulk_load(std::move(vec)).
+         *
+         * @param pairs a random access range of std::pair<K, V>
+         * @param unique whether `pairs` can be trusted to contain no keys which are
+         *               duplicates or already present, which skips the duplicate check
+         * @param threads the amount of threads to use, 0 chooses std::thread::hardware_concurrency()
+         * @returns the amount of inserted pairs
+         */
+        template <std::ranges::random_access_range R>
+            requires std::ranges::sized_range<R> && std::convertible_to<std::ranges::range_reference_t<R>, std::pair<K, V>>
+        size_t bulk_load(R&& pairs, bool unique = false, size_t threads = 0) {
+            const size_t n = std::ranges::size(pairs);
+            if(n == 0)
+                return 0;
+
+            if(threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            // Spawning threads does not pay off for small inputs
+            threads = std::min(threads, n / 10000 + 1);
+
+            std::scoped_lock rlock(_resizeMutex);
+            // Acquire the HashTable's global lock in write mode
+            auto glock = lockExclusive();
+
+            if constexpr(Capacity == 0) {
+                if(_resizable) {
+                    size_t newCapacity = _capacity;
+                    while(static_cast<double>(_size + n) / static_cast<double>(newCapacity) >= ALPHA_MAX) {
+                        newCapacity *= GROWTH_FACTOR;
+                    }
+                    if(newCapacity != _capacity)
+                        rehash(Buckets(newCapacity, _pages), newCapacity);
+                }
+            }
+
+            auto first = std::ranges::begin(pairs);
+            using Ref = std::ranges::range_reference_t<R>;
+            // The i-th pair, by reference unless the range yields prvalues
+            auto at = [&first](size_t i) -> Ref {
+                return first[static_cast<std::ranges::range_difference_t<R>>(i)];
+            };
+            // Whether the pairs' keys can be hashed and looked up without converting them
+            constexpr bool exact = std::same_as<std::remove_cvref_t<Ref>, std::pair<K, V>>;
+            // Whether the pairs may be moved from: rvalues or the elements of an
+            // rvalue container, which aren't used by anyone else afterwards
+            constexpr bool movable = !std::is_const_v<std::remove_reference_t<Ref>>
+                    && (!std::is_lvalue_reference_v<Ref>
+                        || (!std::is_lvalue_reference_v<R> && !std::ranges::view<std::remove_cvref_t<R>>));
+            // Runs f(0) to f(threads - 1) in parallel
+            auto parallel = [threads](auto&& f) {
+                std::vector<std::thread> workers{};
+                for(size_t t = 1; t < threads; ++t) {
+                    workers.emplace_back(f, t);
+                }
+                f(0);
+                for(auto& w : workers) {
+                    w.join();
+                }
+            };
+
+            // 1. Every thread hashes a contiguous chunk of the input and sorts the
+            //    indices of its pairs into one partition per thread by bucket
+            //    parts[t][p] holds (index in pairs, hash) for chunk t and partition p
+            std::vector<std::vector<std::vector<std::pair<size_t, size_t>>>> parts(threads,
+                    std::vector<std::vector<std::pair<size_t, size_t>>>(threads));
+            parallel([&](size_t t) {
+                const size_t begin = t * n / threads;
+                const size_t end = (t + 1) * n / threads;
+                if constexpr(BatchHasher<Hash, K> && std::is_reference_v<Ref> && exact) {
+                    // Hash the keys in place, BULK_HASH_BATCH at a time
+                    const K* keys[BULK_HASH_BATCH];
+                    size_t hashes[BULK_HASH_BATCH];
+                    for(size_t i = begin; i < end; i += BULK_HASH_BATCH) {
+                        size_t count = std::min<size_t>(BULK_HASH_BATCH, end - i);
+                        for(size_t b = 0; b < count; ++b) {
+                            auto&& elem = at(i + b);
+                            keys[b] = &elem.first;
+                        }
+                        hashKeys(keys, count, hashes);
+                        for(size_t b = 0; b < count; ++b) {
+                            parts[t][index(hashes[b]) % threads].emplace_back(i + b, hashes[b]);
+                        }
+                    }
+                } else if constexpr(exact) {
+                    // Hash the keys in place, without copying the pairs
+                    for(size_t i = begin; i < end; ++i) {
+                        size_t h = hashOf(at(i).first);
+                        parts[t][index(h) % threads].emplace_back(i, h);
+                    }
+                } else {
+                    for(size_t i = begin; i < end; ++i) {
+                        std::pair<K, V> elem = at(i);
+                        size_t h = hashOf(elem.first);
+                        parts[t][index(h) % threads].emplace_back(i, h);
+                    }
+                }
+            });
+
+            // 2. Every thread writes one partition, i.e. its own set of buckets,
+            //    going through the chunks in order so that the first duplicate wins
+            std::atomic<size_t> inserted{0};
+            parallel([&](size_t p) {
+                size_t count = 0;
+                for(size_t t = 0; t < threads; ++t) {
+                    for(auto [i, h] : parts[t][p]) {
+                        auto& bucket = _storage[index(h)];
+                        if constexpr(exact) {
+                            auto&& elem = at(i);
+                            if(!unique && find(bucket, elem.first, h) != bucket.slots.end())
+                                continue;
+                            if constexpr(movable)
+                                appendEntry(bucket, h, std::move(elem.first), std::move(elem.second));
+                            else
+                                appendEntry(bucket, h, elem.first, elem.second);
+                        } else {
+                            std::pair<K, V> elem = at(i);
+                            if(!unique && find(bucket, elem.first, h) != bucket.slots.end())
+                                continue;
+                            appendEntry(bucket, h, std::move(elem.first), std::move(elem.second));
+                        }
+                        ++count;
+                    }
+                }
+                inserted += count;
+            });
+
+            _size += inserted;
+            return inserted;
+        }
+
+        /**
+         * Applies a batch of writes at once, e.g. those collected by a
+         * BufferedHashTable. A delta with a value inserts or overwrites its key,
+         * one without a value removes it. The deltas are grouped by bucket, so
+         * every bucket's lock is taken once per batch instead of once per delta.
+         * A batch holds at most as many deltas as the table has room for below
+         * ALPHA_MAX, the load factor is checked after each one. Of several
+         * deltas for the same key, the last one wins.
+         *
+         * @param deltas the keys and their new values, std::nullopt for removals
+         */
+        void apply(std::vector<std::pair<K, std::optional<V>>> deltas) {
+            const size_t n = deltas.size();
+            if(n == 0)
+                return;
+
+            std::vector<const K*> keys(n);
+            for(size_t i = 0; i < n; ++i) {
+                keys[i] = &deltas[i].first;
+            }
+            std::vector<size_t> hashes(n);
+            hashKeys(keys.data(), n, hashes.data());
+
+            // Get the table's global lock in read mode
+            std::shared_lock glock(_mutex);
+
+            std::vector<std::pair<size_t, size_t>> order{};
+            for(size_t begin = 0; begin < n;) {
+                // Apply at most as many deltas at once as entries fit in until
+                // the load factor reaches ALPHA_MAX, and resize in between
+                size_t room = static_cast<size_t>(ALPHA_MAX * static_cast<double>(_capacity));
+                room = room > _size ? room - _size : 0;
+                const size_t end = begin + std::min(n - begin, std::max<size_t>(room, APPLY_MIN_WINDOW));
+
+                // (bucket, position in deltas), so that deltas for the same key stay in order
+                order.clear();
+                for(size_t i = begin; i < end; ++i) {
+                    order.emplace_back(index(hashes[i]), i);
+                }
+                std::sort(order.begin(), order.end());
+
+                for(size_t first = 0; first < order.size();) {
+                    auto& bucket = _storage[order[first].first];
+                    // Get this bucket's lock once for all of its deltas
+                    std::unique_lock lock(bucket._lock);
+                    size_t last = first;
+                    for(; last < order.size() && order[last].first == order[first].first; ++last) {
+                        size_t i = order[last].second;
+                        auto& [key, value] = deltas[i];
+                        auto result = find(bucket, key, hashes[i]);
+                        if(value) {
+                            if(result != bucket.slots.end())
+                                assignEntry(bucket, result, std::move(*value));
+                            else
+                                emplaceEntry(bucket, hashes[i], std::move(key), std::move(*value));
+                        } else if(result != bucket.slots.end()) {
+                            eraseEntry(bucket, result);
+                        }
+                    }
+                    first = last;
+                }
+
+                ensureCapacity(glock, 0);
+                begin = end;
             }
-            return std::make_optional((*result).second);
         }
 
         /**
@@ -230,7 +886,7 @@ class HashTable {
             // Get the bucket's lock
             std::shared_lock lock(bucket._lock);
 
-            for(auto& elem : bucket.l) {
+            for(auto& elem : bucket.slots) {
                 vec.push_back(elem);
             } 
 
@@ -239,50 +895,62 @@ class HashTable {
 
         /**
          * Returns a vector containing all keys present in the HashTable.
+         * The keys are taken from a snapshot by several threads, see Snapshot::getKeys().
          *
+         * @param threads the amount of threads to use, 0 chooses std::thread::hardware_concurrency()
          * @returns an std::vector<K> containing the keys in all buckets
          */
-        std::vector<K> getKeys() const {
-            // Get the table's global lock in read mode
-            std::shared_lock glock(_mutex);
-
-            std::vector<K> vec = std::vector<K>();
-
-            // Get the global lock
-            std::shared_lock lock(_mutex);
-
-            for(size_t i = 0; i < _capacity; ++i) {
-                //std::cout << "Bucket " << i << " size: " << _storage[i].l.size() << std::endl;
-                std::shared_lock llock(_storage[i]._lock);
-                if(!_storage[i].l.empty()) {
-                    for(auto& elem : _storage[i].l) {
-                        vec.push_back(elem.first);
-                    }
-                }
-            }
-            return vec;
+        std::vector<K> getKeys(size_t threads = 0) const {
+            return snapshot().getKeys(threads);
         }
         
         /**
          * Returns a vector containing all values present in the HashTable.
+         * The values are taken from a snapshot by several threads, see Snapshot::getValues().
          *
+         * @param threads the amount of threads to use, 0 chooses std::thread::hardware_concurrency()
          * @returns an std::vector<V> containing the values in all buckets
          */
-        std::vector<V> getValues() const {
-            // Get the table's global lock in read mode
-            std::shared_lock glock(_mutex);
+        std::vector<V> getValues(size_t threads = 0) const {
+            return snapshot().getValues(threads);
+        }
 
-            std::vector<V> vec = std::vector<V>();
+        /**
+         * Returns a vector containing all key/value pairs present in the HashTable.
+         * Unlike separate calls of getKeys() and getValues(), the keys and values
+         * always belong together.
+         * The pairs are taken from a snapshot by several threads, see Snapshot::getEntries().
+         *
+         * @param threads the amount of threads to use, 0 chooses std::thread::hardware_concurrency()
+         * @returns an std::vector<std::pair<K, V>> containing the entries in all buckets
+         */
+        std::vector<std::pair<K, V>> getEntries(size_t threads = 0) const {
+            return snapshot().getEntries(threads);
+        }
+
+        /**
+         * Returns all keys mapped to `value`.
+         * Looks them up in the reverse index if it is enabled (see
+         * enableReverseIndex()), otherwise scans all buckets like getValues().
+         *
+         * @param value the value to look up
+         * @returns an std::vector<K> containing the keys in no particular order
+         */
+        std::vector<K> keysOf(const V& value) const requires std::equality_comparable<V> {
+            if constexpr(ReverseIndexable<V>) {
+                if(auto index = _index.load(std::memory_order_acquire))
+                    return index->keysOf(value);
+            }
 
-            // Get the global lock
-            std::shared_lock lock(_mutex);
+            // Get the table's global lock in read mode
+            std::shared_lock glock(_mutex);
 
+            std::vector<K> vec = std::vector<K>();
             for(size_t i = 0; i < _capacity; ++i) {
                 std::shared_lock llock(_storage[i]._lock);
-                if(!_storage[i].l.empty()) {
-                    for(auto& elem : _storage[i].l) {
-                        vec.push_back(elem.second);
-                    }
+                for(auto& elem : _storage[i].slots) {
+                    if(elem.second == value)
+                        vec.push_back(elem.first);
                 }
             }
             return vec;
@@ -303,11 +971,20 @@ class HashTable {
          *
          * @returns the current amount of buckets in the HashTable as size_t
          */
-        size_t capacity() const {
+        size_t capacity() const requires (Capacity == 0) {
             //std::shared_lock lock(_mutex);
             return _capacity;
         }
 
+        /**
+         * Returns the fixed capacity of the HashTable.
+         *
+         * @returns the amount of buckets in the HashTable as size_t
+         */
+        static constexpr size_t capacity() requires (Capacity > 0) {
+            return Capacity;
+        }
+
         /**
          * Returns whether the HashTable is set to be resizable.
          *
@@ -317,6 +994,32 @@ class HashTable {
             return _resizable;
         }
 
+        /**
+         * Returns the kind of pages the bucket array is currently stored in,
+         * which is less than requested if huge pages were unavailable.
+         *
+         * @returns the HugePages of the current bucket array
+         */
+        HugePages hugePages() const {
+            if constexpr(Capacity > 0) {
+                return HugePages::None;
+            } else {
+                std::shared_lock glock(_mutex);
+                return _storage.pages();
+            }
+        }
+
+        /**
+         * Returns the modes the bucket lock stripes adapted to and the
+         * contended acquisitions so far.
+         * The stripes are shared by all tables of the process, see BucketLock.
+         *
+         * @returns the LockStats
+         */
+        static LockStats lockStats() {
+            return BucketLock::stats();
+        }
+
         /**
          * Checks whether the HashTable needs to be resized.
          *
@@ -357,6 +1060,187 @@ class HashTable {
             return static_cast<double>(_size + static_cast<size_t>(delta)) / static_cast<double>(_capacity);
         }
 
+        /**
+         * Starts a maintenance thread owned by the HashTable which takes care of
+         * growing and shrinking it in the background.
+         * Afterwards, insert() and remove() only signal the maintenance thread
+         * instead of resizing the HashTable themselves unless the load factor
+         * reaches ALPHA_HARD_MAX.
+         * Has no effect if the HashTable is not resizable or the thread is already running.
+         * Not available without locking (see LockPolicy) or with a fixed Capacity.
+         *
+         * @param interval the minimum time between two resizes done by the maintenance thread
+         */
+        void startMaintenance(std::chrono::milliseconds interval = std::chrono::milliseconds(MAINTENANCE_INTERVAL_MS))
+                requires Locks::threadSafe && (Capacity == 0) {
+            std::scoped_lock lock(_maintenanceMutex);
+            if(!_resizable || _maintenance.joinable())
+                return;
+
+            _maintenanceInterval = interval;
+            _maintenanceStop = false;
+            _maintenance = std::thread{&HashTable::maintenanceLoop, this};
+            _maintenanceEnabled = true;
+        }
+
+        /**
+         * Stops the maintenance thread and waits for it to finish.
+         * Afterwards, insert() and remove() resize the HashTable themselves again.
+         */
+        void stopMaintenance() {
+            {
+                std::scoped_lock lock(_maintenanceMutex);
+                if(!_maintenance.joinable())
+                    return;
+                _maintenanceEnabled = false;
+                _maintenanceStop = true;
+            }
+            _maintenanceCv.notify_all();
+            _maintenance.join();
+        }
+
+        /**
+         * Returns whether a maintenance thread is currently running.
+         *
+         * @returns whether a maintenance thread is currently running as bool
+         */
+        bool hasMaintenance() const {
+            return _maintenanceEnabled;
+        }
+
+        /**
+         * The result of a compaction, see compact().
+         */
+        struct CompactionStats {
+            size_t buckets{0};   // Buckets visited
+            size_t entries{0};   // Entries relocated
+            // Decrease of the whole process' resident set size in bytes during
+            // compact(). Best effort: Other threads' allocations count as well,
+            // and it's 0 where the allocator keeps freed pages.
+            size_t rssDelta{0};
+        };
+
+        /**
+         * Relocates all entries into freshly allocated storage and hands the
+         * memory freed this way back to the OS, e.g. after mass removals left
+         * the heap riddled with small holes which keep whole pages resident.
+         * The entries are owned by the global heap, so this is best effort and
+         * relies on glibc: the copies are allocated by a thread of their own,
+         * which gets a fresh arena, and malloc_trim() releases the free pages
+         * (see releaseFreeMemory()). With other allocators, it only relocates.
+         * Buckets are compacted in batches of COMPACTION_BATCH, each bucket
+         * with its lock held in write mode, and the global lock is released
+         * for `pause` between batches, so other operations are only delayed
+         * for single buckets.
+         * If a maintenance thread is running, it compacts the HashTable
+         * in the background after shrinking it.
+         *
+         * @param pause the time to wait between two batches
+         * @returns the number of buckets and entries visited and the change of the process' RSS
+         */
+        CompactionStats compact(std::chrono::microseconds pause = std::chrono::microseconds(0)) {
+            CompactionStats stats{};
+            size_t before = residentBytes();
+            // Threads get an arena of their own from glibc, so the copies are
+            // packed into it instead of into the holes in the caller's arena
+            std::thread worker([&]() {
+                for(size_t first = 0; first < _capacity; first += COMPACTION_BATCH) {
+                    if(first > 0 && pause.count() > 0)
+                        std::this_thread::sleep_for(pause);
+                    auto [buckets, entries] = compactBuckets(first, COMPACTION_BATCH);
+                    stats.buckets += buckets;
+                    stats.entries += entries;
+                }
+            });
+            worker.join();
+            releaseFreeMemory();
+            size_t after = residentBytes();
+            stats.rssDelta = before > after ? before - after : 0;
+            return stats;
+        }
+
+        using Log = MutationLog<Mutation<K, V>, MUTATION_LOG_SIZE>;
+
+        /**
+         * Starts recording every insertion, assignment and removal in a bounded
+         * MutationLog which consumers can tail with their own LogCursor.
+         * Records are appended while the entry's bucket is locked, so the records
+         * of each key are in the order the changes were applied.
+         * Until the log is enabled, writers only check for it, afterwards they
+         * additionally copy the key and value into the log.
+         *
+         * @returns the HashTable's MutationLog
+         */
+        Log& enableMutationLog() {
+            std::call_once(_logOnce, [this]() {
+                _logStorage = std::make_unique<Log>();
+                // Wait for running operations, e.g. in-place increments
+                auto glock = lockExclusive();
+                _log.store(_logStorage.get(), std::memory_order_release);
+            });
+            return *_log.load(std::memory_order_acquire);
+        }
+
+        /**
+         * Returns the HashTable's MutationLog.
+         *
+         * @returns a pointer to the MutationLog, nullptr if it is not enabled
+         */
+        Log* mutationLog() const {
+            return _log.load(std::memory_order_acquire);
+        }
+
+        using ChangeHook = std::function<void(const K&)>;
+
+        /**
+         * Calls `hook` with the key of every insertion, assignment and removal
+         * from now on. Assignments of the value an entry already has are
+         * skipped if V is equality comparable, so the hook reports changes
+         * rather than writes. Unlike records in the MutationLog, which consumers may
+         * read late or miss once the ring overflows, the hook runs in the
+         * writer's thread while the entry's bucket is locked, so it has to be
+         * short. Only the first hook is installed, later calls are ignored.
+         *
+         * @param hook a callable taking the changed key
+         */
+        void enableChangeHook(ChangeHook hook) {
+            std::call_once(_hookOnce, [this, &hook]() {
+                _hookStorage = std::make_unique<ChangeHook>(std::move(hook));
+                // Wait for running operations, e.g. in-place increments
+                auto glock = lockExclusive();
+                _hook.store(_hookStorage.get(), std::memory_order_release);
+            });
+        }
+
+        /**
+         * Starts maintaining a ReverseIndex from values to keys, which turns
+         * keysOf() from a scan of the whole table into a lookup.
+         * Existing entries are indexed with the global lock held in write mode,
+         * afterwards every insertion, assignment and removal updates the index
+         * while the entry's bucket is locked. Calling it again has no effect.
+         */
+        void enableReverseIndex() requires ReverseIndexable<V> {
+            std::call_once(_indexOnce, [this]() {
+                auto glock = lockExclusive();
+                _indexStorage = std::make_unique<Index>();
+                for(size_t i = 0; i < _capacity; ++i) {
+                    for(auto& elem : _storage[i].slots) {
+                        _indexStorage->add(elem.second, elem.first);
+                    }
+                }
+                _index.store(_indexStorage.get(), std::memory_order_release);
+            });
+        }
+
+        /**
+         * Returns whether the reverse index is enabled.
+         *
+         * @returns whether enableReverseIndex() was called as bool
+         */
+        bool hasReverseIndex() const {
+            return _index.load(std::memory_order_acquire) != nullptr;
+        }
+
         /**
          * Returns a reference to the value the provided key is mapped to.
          * If an assignment happens, the assignment is proxied to the assignment operator
@@ -366,61 +1250,499 @@ class HashTable {
             // Get the table's global lock in read mode
             std::shared_lock glock(_mutex);
 
-            size_t hash_val = hash(key);
-            auto& bucket = _storage[hash_val];
+            size_t h = hashOf(key);
+            auto& bucket = _storage[index(h)];
             // Get this bucket's lock
             std::unique_lock lock(bucket._lock);
 
-            auto const result = std::find_if(bucket.l.begin(), bucket.l.end(),
-                    [&key](const std::pair<K, V>& elem) { return elem.first == key; } );
+            auto const result = find(bucket, key, h);
 
-            return Proxy{*this, key, ((*result).second)};
+            return Proxy{*this, key, result != bucket.slots.end() ? (*result).second : V{}};
         }
 
         V& operator[](const K key) const {
             // Get the table's global lock in read mode
             std::shared_lock glock(_mutex);
 
-            size_t hash_val = hash(key);
-            auto& bucket = _storage[hash_val];
+            size_t h = hashOf(key);
+            auto& bucket = _storage[index(h)];
             // Get this bucket's lock
             //std::shared_lock lock(bucket._lock);
             std::unique_lock lock(bucket._lock);
 
-            auto const result = std::find_if(bucket.l.begin(), bucket.l.end(),
-                    [&key](const std::pair<K, V>& elem) { return elem.first == key; } );
+            auto const result = find(bucket, key, h);
 
             return V{Proxy{*this, key, ((*result).second)}};
         }
 
         /**
-         * Prints out the current key/value pairs in all buckets to stdout
+         * A batch of operations which is executed atomically by commit().
          */
+        class Transaction {
+            public:
+                enum op_t {
+                    GET,
+                    INSERT, // Fails the Transaction if the key exists
+                    ASSIGN, // Inserts or overwrites
+                    REMOVE  // Fails the Transaction if the key is missing
+                };
+
+                struct Op {
+                    op_t op;
+                    K key;
+                    std::optional<V> value;
+                };
+
+                Transaction& get(K key) {
+                    _ops.push_back(Op{GET, std::move(key), std::nullopt});
+                    return *this;
+                }
+                Transaction& insert(K key, V value) {
+                    _ops.push_back(Op{INSERT, std::move(key), std::move(value)});
+                    return *this;
+                }
+                Transaction& assign(K key, V value) {
+                    _ops.push_back(Op{ASSIGN, std::move(key), std::move(value)});
+                    return *this;
+                }
+                Transaction& remove(K key) {
+                    _ops.push_back(Op{REMOVE, std::move(key), std::nullopt});
+                    return *this;
+                }
 
-        void print_table() const {
-            // TODO
-            auto keys   = getKeys();
-            auto values = getValues();
+                const std::vector<Op>& ops() const {
+                    return _ops;
+                }
 
-            //for(auto&& [k, v] : zip(keys, values)) {
-            //    std::cout << k << " -> " << v << std::endl;
-            //}
-            auto ki = keys.begin();
-            auto vi = values.begin();
-            for(; ki < keys.end(); ++ki, ++vi) {
-                std::cout << *ki << " -> " << *vi << std::endl;
+            private:
+                std::vector<Op> _ops;
+        };
+
+        /**
+         * Executes all operations of `tx` atomically and in order.
+         * The buckets of all involved keys are locked in ascending order (which
+         * prevents deadlocks between concurrent transactions), then the operations
+         * are checked and either all of them or none are applied.
+         *
+         * @param tx the Transaction which should be committed
+         * @return std::nullopt if the Transaction failed, otherwise one result per operation:
+         *         GET returns the value, ASSIGN and REMOVE the previous value and INSERT std::nullopt
+         */
+        std::optional<std::vector<std::optional<V>>> commit(const Transaction& tx) {
+            auto& ops = tx.ops();
+
+            // Get the table's global lock in read mode
+            std::shared_lock glock(_mutex);
+
+            int inserts = static_cast<int>(std::count_if(ops.begin(), ops.end(),
+                    [](const typename Transaction::Op& op) { return op.op == Transaction::INSERT || op.op == Transaction::ASSIGN; }));
+            ensureCapacity(glock, inserts);
+
+            // Lock all involved buckets in a global order
+            std::vector<size_t> buckets{};
+            for(auto& op : ops) {
+                buckets.push_back(hash(op.key));
+            }
+            std::sort(buckets.begin(), buckets.end());
+            buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+            std::vector<std::unique_lock<BucketMutex>> locks{};
+            for(auto i : buckets) {
+                locks.emplace_back(_storage[i]._lock);
+            }
+
+            // Execute the operations on a staged view of the involved keys first
+            std::vector<std::pair<K, std::optional<V>>> staged{};
+            auto lookup = [this, &staged](const K& key) -> std::optional<V> {
+                auto s = std::find_if(staged.begin(), staged.end(),
+                        [&key](const std::pair<K, std::optional<V>>& elem) { return elem.first == key; });
+                if(s != staged.end())
+                    return s->second;
+
+                size_t h = hashOf(key);
+                auto& bucket = _storage[index(h)];
+                auto result = find(bucket, key, h);
+                return result != bucket.slots.end() ? std::make_optional(result->second) : std::nullopt;
+            };
+            auto stage = [&staged](const K& key, std::optional<V> value) {
+                auto s = std::find_if(staged.begin(), staged.end(),
+                        [&key](const std::pair<K, std::optional<V>>& elem) { return elem.first == key; });
+                if(s != staged.end())
+                    s->second = std::move(value);
+                else
+                    staged.emplace_back(key, std::move(value));
+            };
+
+            std::vector<std::optional<V>> results{};
+            for(auto& op : ops) {
+                auto current = lookup(op.key);
+                switch(op.op) {
+                    case Transaction::GET:
+                        results.push_back(std::move(current));
+                        break;
+                    case Transaction::INSERT:
+                        if(current)
+                            return std::nullopt;
+                        stage(op.key, op.value);
+                        results.push_back(std::nullopt);
+                        break;
+                    case Transaction::ASSIGN:
+                        stage(op.key, op.value);
+                        results.push_back(std::move(current));
+                        break;
+                    case Transaction::REMOVE:
+                        if(!current)
+                            return std::nullopt;
+                        stage(op.key, std::nullopt);
+                        results.push_back(std::move(current));
+                        break;
+                }
+            }
+
+            // All operations succeeded, apply the staged changes
+            for(auto& [key, value] : staged) {
+                size_t h = hashOf(key);
+                auto& bucket = _storage[index(h)];
+                auto result = find(bucket, key, h);
+                if(value) {
+                    if(result != bucket.slots.end())
+                        assignEntry(bucket, result, std::move(*value));
+                    else
+                        emplaceEntry(bucket, h, key, std::move(*value));
+                } else if(result != bucket.slots.end()) {
+                    eraseEntry(bucket, result);
+                }
+            }
+
+            return std::make_optional(std::move(results));
+        }
+
+        /**
+         * An immutable, point-in-time view of a HashTable returned by snapshot().
+         * Buckets which were not modified since the snapshot was taken are read
+         * from the HashTable itself, all others from the copies their writers
+         * made before modifying them.
+         * A Snapshot may be copied, read from several threads at once and outlive
+         * its HashTable, but must not be read while the HashTable is destroyed.
+         */
+        class Snapshot {
+            public:
+                /**
+                 * Returns the amount of entries at the time of the snapshot.
+                 *
+                 * @returns the amount of key/value pairs in the snapshot as size_t
+                 */
+                size_t size() const {
+                    return _state->size;
+                }
+
+                /**
+                 * Returns the amount of buckets at the time of the snapshot.
+                 * Scans can be split among threads by bucket ranges.
+                 *
+                 * @returns the amount of buckets in the snapshot as size_t
+                 */
+                size_t capacity() const {
+                    return _state->preserved.size();
+                }
+
+                /**
+                 * Calls f(key, value) for all entries in the buckets [first, last).
+                 *
+                 * @param f a callable taking a const K& and a const V&
+                 * @param first the index of the first bucket which is visited
+                 * @param last the index after the last bucket which is visited, capped to capacity()
+                 */
+                template <typename F> requires std::is_invocable_v<F, const K&, const V&>
+                void for_each(F&& f, size_t first = 0, size_t last = SIZE_MAX) const {
+                    last = std::min(last, capacity());
+                    for(size_t i = first; i < last; ++i) {
+                        visitBucket(i, f);
+                    }
+                }
+
+                /**
+                 * Returns a vector of key/value pairs containing the content of the specified bucket.
+                 *
+                 * @param i The bucket's index
+                 * @returns A vector of key/value pairs containing the content of the specified bucket
+                 */
+                std::vector<std::pair<K, V>> getBucket(size_t i) const {
+                    std::vector<std::pair<K, V>> vec{};
+                    visitBucket(i, [&vec](const K& key, const V& value) { vec.emplace_back(key, value); });
+                    return vec;
+                }
+
+                /**
+                 * Returns a vector containing all key/value pairs in the snapshot, in
+                 * bucket order. Every thread copies a range of buckets into its own
+                 * buffer, and the buffers are joined in the end.
+                 *
+                 * @param threads the amount of threads to use, 0 chooses std::thread::hardware_concurrency()
+                 * @returns an std::vector<std::pair<K, V>> containing the entries in all buckets
+                 */
+                std::vector<std::pair<K, V>> getEntries(size_t threads = 0) const {
+                    return collect(threads, [](const K& key, const V& value) { return std::pair<K, V>{key, value}; });
+                }
+
+                /**
+                 * Returns a vector containing all keys in the snapshot, in the same
+                 * order as getValues() returns their values.
+                 *
+                 * @param threads the amount of threads to use, 0 chooses std::thread::hardware_concurrency()
+                 * @returns an std::vector<K> containing the keys in all buckets
+                 */
+                std::vector<K> getKeys(size_t threads = 0) const {
+                    return collect(threads, [](const K& key, const V&) { return key; });
+                }
+
+                /**
+                 * Returns a vector containing all values in the snapshot, in the same
+                 * order as getKeys() returns their keys.
+                 *
+                 * @param threads the amount of threads to use, 0 chooses std::thread::hardware_concurrency()
+                 * @returns an std::vector<V> containing the values in all buckets
+                 */
+                std::vector<V> getValues(size_t threads = 0) const {
+                    return collect(threads, [](const K&, const V& value) { return value; });
+                }
+
+                /**
+                 * Writes all entries as "key<separator>value" lines to `fd`.
+                 * Every thread formats a range of buckets into its own buffer and
+                 * writes it out once it holds EXPORT_BUFFER_BYTES, so lines are
+                 * never torn, but the buffers of different threads follow each
+                 * other in no particular order.
+                 *
+                 * @param fd the file descriptor, e.g. of a file, pipe or STDOUT_FILENO
+                 * @param separator the string between each key and its value
+                 * @param threads the amount of threads to use, 0 chooses std::thread::hardware_concurrency()
+                 * @returns false if a write failed (see errno), true otherwise
+                 */
+                bool write(int fd, std::string_view separator = " ", size_t threads = 0) const {
+                    std::mutex fdMutex;
+                    std::atomic<bool> failed{false};
+                    // Writes out a whole buffer, one thread at a time
+                    auto flush = [&](std::ostringstream& buffer) {
+                        auto out = buffer.view();
+                        std::scoped_lock lock(fdMutex);
+                        while(!out.empty() && !failed) {
+                            ssize_t written = ::write(fd, out.data(), out.size());
+                            if(written < 0 && errno != EINTR)
+                                failed = true;
+                            else if(written > 0)
+                                out.remove_prefix(static_cast<size_t>(written));
+                        }
+                        buffer.str({});
+                    };
+
+                    scan(threads, [&](size_t, size_t first, size_t last) {
+                        std::ostringstream buffer{};
+                        for_each([&](const K& key, const V& value) {
+                            buffer << key << separator << value << '\n';
+                            if(static_cast<size_t>(buffer.tellp()) >= EXPORT_BUFFER_BYTES)
+                                flush(buffer);
+                        }, first, last);
+                        flush(buffer);
+                    });
+                    return !failed;
+                }
+
+            private:
+                friend class HashTable;
+
+                std::shared_ptr<const SnapshotState> _state;
+
+                explicit Snapshot(std::shared_ptr<const SnapshotState> state) : _state(std::move(state)) { }
+
+                // The amount of threads a scan with `threads` threads actually uses
+                size_t scanThreads(size_t threads) const {
+                    if(threads == 0)
+                        threads = std::max(1u, std::thread::hardware_concurrency());
+                    // Spawning threads does not pay off for small tables
+                    return std::min(threads, capacity() / EXPORT_MIN_BUCKETS + 1);
+                }
+
+                // Splits the buckets into one contiguous range per thread and
+                // runs f(t, first, last) for each of them in parallel
+                template <typename F>
+                void scan(size_t threads, F&& f) const {
+                    const size_t cap = capacity();
+                    threads = scanThreads(threads);
+                    std::vector<std::thread> workers{};
+                    for(size_t t = 1; t < threads; ++t) {
+                        workers.emplace_back(f, t, t * cap / threads, (t + 1) * cap / threads);
+                    }
+                    f(0, 0, cap / threads);
+                    for(auto& w : workers) {
+                        w.join();
+                    }
+                }
+
+                // Collects proj(key, value) for all entries in bucket order, every
+                // thread into its own buffer sized for its share of the entries
+                template <typename F, typename T = std::invoke_result_t<F, const K&, const V&>>
+                std::vector<T> collect(size_t threads, F proj) const {
+                    threads = scanThreads(threads);
+                    std::vector<std::vector<T>> parts(threads);
+                    scan(threads, [&](size_t t, size_t first, size_t last) {
+                        auto& part = parts[t];
+                        // The share of the entries expected in [first, last), plus some slack
+                        size_t expected = size() * (last - first) / capacity();
+                        part.reserve(expected + expected / 8);
+                        for_each([&](const K& key, const V& value) { part.push_back(proj(key, value)); }, first, last);
+                    });
+
+                    std::vector<T> vec = std::move(parts[0]);
+                    vec.reserve(size());
+                    for(size_t t = 1; t < parts.size(); ++t) {
+                        std::move(parts[t].begin(), parts[t].end(), std::back_inserter(vec));
+                    }
+                    return vec;
+                }
+
+                // Calls f(key, value) for all entries of bucket i
+                template <typename F>
+                void visitBucket(size_t i, F& f) const {
+                    auto& state = *_state;
+                    auto visit = [&f](const auto& entries) {
+                        for(auto& elem : entries) {
+                            f(elem.first, elem.second);
+                        }
+                    };
+
+                    if(state.complete.load(std::memory_order_acquire)) {
+                        visit(*state.preserved[i]);
+                        return;
+                    }
+
+                    // Get the table's global lock in read mode, which keeps the
+                    // snapshot from being completed by a resize meanwhile
+                    std::shared_lock glock(state.table->_mutex);
+                    if(state.complete.load(std::memory_order_relaxed)) {
+                        visit(*state.preserved[i]);
+                        return;
+                    }
+
+                    auto& bucket = state.table->_storage[i];
+                    // Get the bucket's lock
+                    std::shared_lock lock(bucket._lock);
+                    if(state.preserved[i])
+                        visit(*state.preserved[i]);
+                    else
+                        visit(bucket.slots);
+                }
+        };
+
+        /**
+         * Takes a consistent, point-in-time snapshot of the HashTable.
+         * Taking it only blocks other operations for a moment. Afterwards, writers
+         * copy a bucket's entries before they modify it for the first time, and a
+         * resize copies all remaining buckets. While no snapshot is outstanding,
+         * writers don't copy anything.
+         *
+         * @returns a Snapshot of the HashTable's current content
+         */
+        Snapshot snapshot() const {
+            while(true) {
+                // Allocate the snapshot's bucket array before blocking writers
+                size_t cap = _capacity;
+                auto state = std::shared_ptr<SnapshotState>(new SnapshotState(this, cap),
+                        [registry = _snapshots](SnapshotState* state) {
+                            registry->remove(state);
+                            delete state;
+                        });
+
+                // Acquire the HashTable's global lock in write mode so that
+                // no modification is in progress
+                auto glock = lockExclusive();
+                if(cap != _capacity)
+                    continue;
+
+                state->epoch = ++_epoch;
+                state->size = _size;
+                _snapshots->add(state.get());
+
+                return Snapshot{std::move(state)};
             }
         }
 
+        /**
+         * Prints out the current key/value pairs in all buckets to stdout
+         */
+        void print_table() const {
+            // Anything already printed comes first
+            std::cout.flush();
+            snapshot().write(STDOUT_FILENO, " -> ");
+        }
+
     private:
+        using Slots = SlotBlocks<K, V, SimdKeysHasher<Hash, K>>;
+        using iterator = typename Slots::iterator;
+
         /**
-        * The internal list's node/bucket type
+        * The internal bucket type
         */
+        // Without resizing, nothing needs to lock the whole table but
+        // lockExclusive(), which locks all buckets instead
+        using GlobalMutex = std::conditional_t<Capacity == 0, typename Locks::Global, NullLock>;
+        using BucketMutex = typename Locks::Bucket;
+
+        // All-zero bytes are an empty bucket (an unlocked BucketLock, SlotBlocks
+        // without entries or further blocks and epoch 0) unless the LockPolicy
+        // says otherwise, see BucketArray
         struct Node {
+            static constexpr bool zeroInitialized = Locks::zeroInitialized;
+
             // Each bucket manages a RW-lock
-            mutable std::shared_mutex _lock;
+            [[no_unique_address]] mutable BucketMutex _lock;
+
+            Slots slots{};
+
+            // The value of _epoch when the bucket was last copied for snapshots
+            uint64_t epoch{0};
+        };
+
+        // A bucket's entries as copied for snapshots
+        using Entries = std::vector<std::pair<K, V>>;
+
+        /**
+         * The shared state of a Snapshot.
+         * preserved[i] holds bucket i's entries at the time of the snapshot once
+         * a writer copied them, nullptr while bucket i is unmodified.
+         * Once `complete` is set, all buckets are copied and `table` is unused.
+         */
+        struct SnapshotState {
+            const HashTable* table;
+            uint64_t epoch{0};
+            size_t size{0};
+            std::vector<std::shared_ptr<const Entries>> preserved;
+            std::atomic<bool> complete{false};
+
+            SnapshotState(const HashTable* table, size_t cap) : table(table), preserved(cap) { }
+        };
+
+        /**
+         * The snapshots which still read from the HashTable.
+         * It is shared with the snapshots so that they can outlive the HashTable.
+         */
+        struct SnapshotRegistry {
+            std::mutex mutex;
+            std::vector<SnapshotState*> states;
+            // The size of `states`, which writers check without locking `mutex`
+            std::atomic<size_t> active{0};
+
+            void add(SnapshotState* state) {
+                std::scoped_lock lock(mutex);
+                states.push_back(state);
+                active = states.size();
+            }
 
-            std::list<std::pair<K, V>> l = std::list<std::pair<K, V>>();
+            void remove(SnapshotState* state) {
+                std::scoped_lock lock(mutex);
+                std::erase(states, state);
+                active = states.size();
+            }
         };
 
         // _size must be atomic since many threads may write to it
@@ -428,90 +1750,472 @@ class HashTable {
         std::atomic<size_t> _size;
         std::atomic<size_t> _capacity;
         const bool _resizable;
-        std::unique_ptr<Node[]> _storage;
+        // The kind of pages requested for the bucket array
+        const HugePages _pages{HugePages::None};
+        using Buckets = std::conditional_t<Capacity == 0, BucketArray<Node>, std::array<Node, Capacity>>;
+        Buckets _storage;
         // The table's global mutex / RW-lock
-        mutable std::shared_mutex _mutex;
+        mutable GlobalMutex _mutex;
+        // Serializes resizes, see resize()
+        GlobalMutex _resizeMutex;
+
+        // The mutation log, see enableMutationLog()
+        std::once_flag _logOnce;
+        std::unique_ptr<Log> _logStorage;
+        std::atomic<Log*> _log{nullptr};
+
+        // The change hook, see enableChangeHook()
+        std::once_flag _hookOnce;
+        std::unique_ptr<ChangeHook> _hookStorage;
+        std::atomic<ChangeHook*> _hook{nullptr};
+
+        // The reverse index, see enableReverseIndex()
+        using Index = std::conditional_t<ReverseIndexable<V>, ReverseIndex<K, V, Hash>, NoReverseIndex>;
+        std::once_flag _indexOnce;
+        std::unique_ptr<Index> _indexStorage;
+        std::atomic<Index*> _index{nullptr};
+
+        // Snapshots, see snapshot()
+        // _epoch is incremented with the global lock held in write mode
+        mutable uint64_t _epoch{0};
+        std::shared_ptr<SnapshotRegistry> _snapshots = std::make_shared<SnapshotRegistry>();
+
+        // Background maintenance, see startMaintenance()
+        std::thread _maintenance;
+        std::mutex _maintenanceMutex;
+        std::condition_variable _maintenanceCv;
+        std::chrono::milliseconds _maintenanceInterval{MAINTENANCE_INTERVAL_MS};
+        bool _maintenanceStop{false};
+        std::atomic<bool> _maintenanceEnabled{false};
+        std::atomic<bool> _maintenanceRequested{false};
+
+        // Returns the full hash of `key`, which determines both its bucket
+        // (see index()) and its tag within the bucket (see SlotBlocks::tag())
+        size_t hashOf(const K& key) const {
+            Hash hash_fn;
+            return hash_fn(key);
+        }
+
+        // Returns the bucket index of the full hash `h`
+        size_t index(size_t h) const {
+            if constexpr(Capacity > 0)
+                return h % Capacity;
+            else
+                return h % _capacity;
+        }
+
+        // Holds the locks of all buckets in write mode, see lockExclusive()
+        struct AllBuckets {
+            const HashTable& table;
+
+            explicit AllBuckets(const HashTable& table) : table(table) {
+                // In ascending order like commit()
+                for(size_t i = 0; i < Capacity; ++i) {
+                    table._storage[i]._lock.lock();
+                }
+            }
+
+            ~AllBuckets() {
+                for(size_t i = Capacity; i-- > 0;) {
+                    table._storage[i]._lock.unlock();
+                }
+            }
 
-        size_t hash(const K key) const {
-            std::hash<K> hash_fn;
-            size_t hash_val = hash_fn(key) % _capacity;
+            AllBuckets(const AllBuckets&) = delete;
+            AllBuckets& operator=(const AllBuckets&) = delete;
+        };
 
-            return hash_val;
+        // Blocks all other operations until the returned guard is destroyed:
+        // takes the global lock in write mode or, with a fixed Capacity,
+        // every bucket's lock
+        auto lockExclusive() const {
+            if constexpr(Capacity > 0)
+                return AllBuckets{*this};
+            else
+                return std::unique_lock{_mutex};
         }
 
-        // Collects all (key, value) pairs into one list, emptying all buckets
-        std::list<std::pair<K, V>> collectPairs() {
-            std::list<std::pair<K, V>> l = std::list<std::pair<K, V>>();
+        size_t hash(const K& key) const {
+            return index(hashOf(key));
+        }
 
-            for(size_t i = 0; i < _capacity; ++i) {
-                l.splice(l.begin(), _storage[i].l);
+        // Writes the full hashes of `count` keys to `hashes`, several at a time
+        // if Hash is a BatchHasher
+        void hashKeys(const K* const* keys, size_t count, size_t* hashes) const {
+            if constexpr(BatchHasher<Hash, K>) {
+                Hash::hash_batch(keys, count, hashes);
+            } else {
+                for(size_t i = 0; i < count; ++i) {
+                    hashes[i] = hashOf(*keys[i]);
+                }
+            }
+        }
+
+        // The lookups of get_batch() of keys[first], keys[same[first]], ... in the
+        // bucket with index `i`, given their full hashes, which must be called with
+        // the global lock held in read mode. Suspends after each prefetch.
+        LookupTask lookup(size_t i, const std::vector<K>& keys, const size_t* hashes, size_t first, const size_t* same,
+                std::optional<V>* results) const {
+            auto& bucket = _storage[i];
+            // The bucket's lock and the tags of its first block
+            __builtin_prefetch(&bucket);
+            __builtin_prefetch(bucket.slots.head());
+            co_await std::suspend_always{};
+
+            // Don't block the other lookups of this thread while a writer holds the bucket
+            while(!bucket._lock.try_lock_shared()) {
+                co_await std::suspend_always{};
+            }
+            std::shared_lock lock(bucket._lock, std::adopt_lock);
+
+            for(size_t k = first; k != SIZE_MAX; k = same[k]) {
+                const K& key = keys[k];
+                uint8_t tag = Slots::tag(hashes[k]);
+                bool found = false;
+                for(auto* block = bucket.slots.head(); block && !found; block = block->next()) {
+                    // Only slots with a matching tag (or key) are dereferenced
+                    for(uint64_t mask = block->match(key, tag); mask && !found; mask &= mask - 1) {
+                        auto* elem = block->at(Slots::Block::slot(mask));
+                        __builtin_prefetch(elem);
+                        co_await std::suspend_always{};
+
+                        // e.g. std::string: only wait for its buffer if it is stored out of line
+                        if constexpr(requires { elem->first.data(); }) {
+                            auto* data = reinterpret_cast<const char*>(elem->first.data());
+                            if(data < reinterpret_cast<const char*>(elem) || data >= reinterpret_cast<const char*>(elem + 1)) {
+                                __builtin_prefetch(data);
+                                co_await std::suspend_always{};
+                            }
+                        }
+
+                        if(Slots::simdKeys || elem->first == key) {
+                            results[k] = elem->second;
+                            found = true;
+                        }
+                    }
+
+                    if(!found && block->next()) {
+                        __builtin_prefetch(block->next());
+                        co_await std::suspend_always{};
+                    }
+                }
             }
+        }
+
+        // Returns an iterator to the entry with the given key and full hash `h`
+        // in `bucket` or bucket.slots.end()
+        template <typename N>
+        static auto find(N& bucket, const K& key, size_t h) {
+            return bucket.slots.find(key, Slots::tag(h));
+        }
+
+        /*
+         * All modifications of a bucket's entries go through the following
+         * functions which must be called with the bucket's lock held in write mode
+         * and the global lock held in any mode.
+         */
 
-            return l;
+        // Copies `bucket` into all outstanding snapshots which were taken after
+        // its last modification
+        void preserveEntries(Node& bucket) {
+            if(_snapshots->active == 0 || bucket.epoch == _epoch)
+                return;
+
+            size_t i = static_cast<size_t>(&bucket - &_storage[0]);
+            std::shared_ptr<const Entries> entries;
+            std::scoped_lock lock(_snapshots->mutex);
+            for(auto* state : _snapshots->states) {
+                if(state->epoch > bucket.epoch && !state->preserved[i]) {
+                    if(!entries)
+                        entries = std::make_shared<const Entries>(bucket.slots.begin(), bucket.slots.end());
+                    state->preserved[i] = entries;
+                }
+            }
+            bucket.epoch = _epoch;
+        }
+
+        // Whether increment() can add to a value with std::atomic_ref, see there
+        static constexpr bool atomicIncrement = [] {
+            if constexpr((std::integral<V> && !std::same_as<V, bool>) || std::floating_point<V>)
+                return std::atomic_ref<V>::is_always_lock_free && alignof(V) >= std::atomic_ref<V>::required_alignment;
+            else
+                return false;
+        }();
+
+        // Returns whether changes of `bucket`'s entries have to be recorded by
+        // a MutationLog, change hook, reverse index or snapshot, which must be
+        // called with the global lock held and the bucket's lock held in any mode
+        bool observed(const Node& bucket) const {
+            bool indexed = false;
+            if constexpr(ReverseIndexable<V>)
+                indexed = _index.load(std::memory_order_acquire) != nullptr;
+            return indexed || _log.load(std::memory_order_acquire) || _hook.load(std::memory_order_acquire)
+                    || (_snapshots->active != 0 && bucket.epoch != _epoch);
+        }
+
+        // Appends a new entry with the full hash `h` to `bucket`
+        void emplaceEntry(Node& bucket, size_t h, K key, V value) {
+            appendEntry(bucket, h, std::move(key), std::move(value));
+            ++_size;
+        }
+
+        // Like emplaceEntry(), but leaves updating _size to the caller
+        void appendEntry(Node& bucket, size_t h, K key, V value) {
+            preserveEntries(bucket);
+            if(auto log = _log.load(std::memory_order_acquire))
+                log->append(Mutation<K, V>{Mutation<K, V>::INSERT, key, value});
+            if(auto hook = _hook.load(std::memory_order_acquire))
+                (*hook)(key);
+            reindex(key, nullptr, &value);
+            bucket.slots.emplace(Slots::tag(h), std::move(key), std::move(value));
+        }
+
+        // Overwrites the value of the entry at `it`
+        void assignEntry(Node& bucket, iterator it, V value) {
+            preserveEntries(bucket);
+            if(auto log = _log.load(std::memory_order_acquire))
+                log->append(Mutation<K, V>{Mutation<K, V>::ASSIGN, it->first, value});
+            // Hooks aren't told about assignments of the value the entry already has
+            if(auto hook = _hook.load(std::memory_order_acquire); hook && !unchanged(it->second, value))
+                (*hook)(it->first);
+            reindex(it->first, &it->second, &value);
+            it->second = std::move(value);
+        }
+
+        // Returns whether `value` equals `current`, false if V can't be compared
+        static bool unchanged(const V& current, const V& value) {
+            if constexpr(std::equality_comparable<V>)
+                return current == value;
+            else
+                return false;
+        }
+
+        // Removes the entry at `it` from `bucket` and returns its value
+        V eraseEntry(Node& bucket, iterator it) {
+            preserveEntries(bucket);
+            if(auto log = _log.load(std::memory_order_acquire))
+                log->append(Mutation<K, V>{Mutation<K, V>::REMOVE, it->first, std::nullopt});
+            if(auto hook = _hook.load(std::memory_order_acquire))
+                (*hook)(it->first);
+            reindex(it->first, &it->second, nullptr);
+            V value = std::move(it->second);
+            bucket.slots.erase(it);
+            --_size;
+            return value;
+        }
+
+        // Moves `key` from value `from` to value `to` in the reverse index if it
+        // is enabled, nullptr standing for no value
+        void reindex(const K& key, const V* from, const V* to) {
+            if constexpr(ReverseIndexable<V>) {
+                auto index = _index.load(std::memory_order_acquire);
+                if(!index || (from && to && *from == *to))
+                    return;
+                if(from)
+                    index->remove(*from, key);
+                if(to)
+                    index->add(*to, key);
+            }
+        }
+
+        /**
+         * Makes sure the HashTable has room for `delta` more (or less) entries
+         * before a mutation. Must be called with the global lock held in read mode.
+         * If a maintenance thread is running, it is only signaled unless the
+         * load factor reached ALPHA_HARD_MAX.
+         */
+        void ensureCapacity(std::shared_lock<GlobalMutex>& glock, int delta) {
+            // A fixed Capacity never changes
+            if constexpr(Capacity > 0) {
+                (void) glock;
+                (void) delta;
+            } else {
+                if(!_resizable)
+                    return;
+
+                if(_maintenanceEnabled) {
+                    if(needsResize(delta))
+                        signalMaintenance();
+                    if(load_factor(delta) < ALPHA_HARD_MAX)
+                        return;
+                }
+
+                while(needsResize(delta)) {
+                    glock.unlock();
+                    resize(delta);
+                    glock.lock();
+                }
+            }
+        }
+
+        // Wakes up the maintenance thread if it is not already about to resize
+        void signalMaintenance() {
+            if(!_maintenanceRequested.exchange(true)) {
+                std::scoped_lock lock(_maintenanceMutex);
+                _maintenanceCv.notify_one();
+            }
+        }
+
+        // The maintenance thread's main loop.
+        // Checks the load factor whenever it is signaled or the interval elapsed
+        // and does at most one resize per interval. After shrinking, it
+        // compacts one batch of buckets per interval as well.
+        void maintenanceLoop() {
+            auto last = std::chrono::steady_clock::now() - _maintenanceInterval;
+            // The first bucket not compacted yet, SIZE_MAX if there is nothing to compact
+            size_t compacted = SIZE_MAX;
+            std::unique_lock lock(_maintenanceMutex);
+
+            while(!_maintenanceStop) {
+                _maintenanceCv.wait_for(lock, _maintenanceInterval,
+                        [this] { return _maintenanceStop || _maintenanceRequested.load(); });
+                // Rate limit
+                if(_maintenanceCv.wait_until(lock, last + _maintenanceInterval, [this] { return _maintenanceStop; }))
+                    break;
+
+                _maintenanceRequested = false;
+                lock.unlock();
+
+                if(needsResize(0)) {
+                    size_t capacity = _capacity;
+                    resize(0);
+                    last = std::chrono::steady_clock::now();
+                    // Check again after the next interval
+                    if(needsResize(0))
+                        _maintenanceRequested = true;
+                    // Entries were removed in bulk, start over compacting them
+                    if(_capacity < capacity)
+                        compacted = 0;
+                }
+
+                // Compact one batch per interval until all buckets are done
+                if(compacted != SIZE_MAX) {
+                    compacted += compactBuckets(compacted, COMPACTION_BATCH).first;
+                    if(compacted >= _capacity) {
+                        releaseFreeMemory();
+                        compacted = SIZE_MAX;
+                    }
+                }
+
+                lock.lock();
+            }
+        }
+
+        // Relocates the entries of up to `count` buckets starting at `first` and
+        // returns the number of buckets and entries visited, see compact()
+        std::pair<size_t, size_t> compactBuckets(size_t first, size_t count) {
+            // Get the table's global lock in read mode
+            std::shared_lock glock(_mutex);
+
+            size_t last = std::min<size_t>(first + count, _capacity);
+            // The entries' old storage, which is only released after the whole
+            // batch is copied so that the copies can't simply fill its holes
+            std::vector<std::pair<K, V>> old{};
+            for(size_t i = first; i < last; ++i) {
+                auto& bucket = _storage[i];
+                std::unique_lock lock(bucket._lock);
+                // Copies allocate exactly as much as the key and value need
+                bucket.slots.relocate([&old](std::pair<K, V>& entry) {
+                    K key(std::as_const(entry.first));
+                    std::swap(key, entry.first);
+                    V value(std::as_const(entry.second));
+                    std::swap(value, entry.second);
+                    old.emplace_back(std::move(key), std::move(value));
+                });
+            }
+            return {first < last ? last - first : 0, old.size()};
+        }
+
+        // Returns the amount of buckets after growing (1) or shrinking (2), 0 otherwise
+        size_t resizeTarget(int direction) const {
+            switch(direction) {
+                case 1:
+                    return _capacity * GROWTH_FACTOR;
+                case 2:
+                    return (_capacity + (SHRINK_FACTOR - 1)) / SHRINK_FACTOR;
+                default:
+                    return 0;
+            }
         }
 
         /**
          * Resizes the HashTable by growing or shrinking.
+         * The new bucket array is allocated before and the old one released after
+         * holding the global lock, which is only needed while relinking the entries.
          */
         inline void resize(int delta = 0) {
+            // Only one thread at a time prepares a resize
+            std::scoped_lock rlock(_resizeMutex);
+
+            size_t newCapacity = resizeTarget(needsResize(delta));
+            if(newCapacity == 0)
+                return;
+            Buckets newStorage{newCapacity, _pages};
+            Buckets oldStorage{};
+
             // Acquire the HashTable's global lock in write mode
             std::unique_lock glock(_mutex);
 
             // Check whether resizing is still necessary or already happened
-            switch(needsResize(delta)) {
-                case 1: {
-                    // Grow the HashTable
-                    //std::cout << "lf " << load_factor(1) << " >= " << ALPHA_MAX << ", growing..." << std::endl;
-
-                    auto old_elems = collectPairs();
-
-                    // Create new storage, rehash all old entrys
-                    auto oldPtr = _storage.release();
-                    delete[] oldPtr;
-                    _storage = std::make_unique<Node[]>(_capacity.load() * GROWTH_FACTOR);
-                    _capacity = _capacity * GROWTH_FACTOR;
-                    _size = 0;
-
-                    for(auto& elem : old_elems) {
-                        //insert(elem.first, std::move(elem.second)); 
-                        insert_unsafe(elem.first, std::move(elem.second));
-                    }
-                    break;
-                    }
-                case 2: {
-                    // Shrink the HashTable
-                    //std::cout << "lf " << load_factor(-1) << " <= " << /*(ALPHA_MAX/4)*/ 0.10 << ", shrinking..." << std::endl;
-                    
-                    auto old_elems = collectPairs();
-                    // Create new storage, rehash all old entrys
-                    auto oldPtr = _storage.release();
-                    delete[] oldPtr;
-                    _storage = std::make_unique<Node[]>((_capacity.load() + (SHRINK_FACTOR - 1)) / SHRINK_FACTOR);
-                    _capacity = (_capacity + (SHRINK_FACTOR - 1)) / SHRINK_FACTOR;
-                    _size = 0;
-
-                    for(auto& elem : old_elems) {
-                        insert_unsafe(elem.first, std::move(elem.second));
-                    }
-                    break;
-                    }
-                default:
-                    // Resizing isn't necessary anymore
-                    break;
-            }
+            if(resizeTarget(needsResize(delta)) != newCapacity)
+                return;
+
+            oldStorage = rehash(std::move(newStorage), newCapacity);
 
             glock.unlock();
-            return;
         }
 
-        // Used when resizing.
-        // Does not acquire the global lock nor the bucket's lock.
-        void insert_unsafe(K key, V value) {
-            size_t hash_val = hash(key);
-            auto& bucket = _storage[hash_val];
+        /**
+         * Replaces the bucket array by `newStorage` and moves all entries into it.
+         * Must be called with the global lock held in write mode.
+         *
+         * @returns the old bucket array, which only contains empty buckets now
+         */
+        Buckets rehash(Buckets newStorage, size_t newCapacity) {
+            // Outstanding snapshots refer to the old bucket indices
+            completeSnapshots();
+
+            size_t oldCapacity = _capacity;
+            auto oldStorage = std::move(_storage);
+            _storage = std::move(newStorage);
+            _capacity = newCapacity;
+
+            // Rehash all old entries by moving them into the new buckets
+            for(size_t i = 0; i < oldCapacity; ++i) {
+                auto& slots = oldStorage[i].slots;
+                for(auto& elem : slots) {
+                    size_t h = hashOf(elem.first);
+                    _storage[index(h)].slots.emplace(Slots::tag(h), std::move(elem.first), std::move(elem.second));
+                }
+                slots.clear();
+            }
 
-            bucket.l.push_back(std::make_pair(key, value));
+            return oldStorage;
+        }
 
-            ++_size;
+        /**
+         * Copies all unmodified buckets into the outstanding snapshots, which
+         * no longer read from the HashTable afterwards.
+         * Must be called with the global lock held in write mode.
+         */
+        void completeSnapshots() {
+            if(_snapshots->active == 0)
+                return;
+
+            std::scoped_lock lock(_snapshots->mutex);
+            // Snapshots missing the same bucket share its copy
+            std::vector<std::shared_ptr<const Entries>> copies(_capacity);
+            for(auto* state : _snapshots->states) {
+                for(size_t i = 0; i < _capacity; ++i) {
+                    if(state->preserved[i])
+                        continue;
+                    if(!copies[i])
+                        copies[i] = std::make_shared<const Entries>(_storage[i].slots.begin(), _storage[i].slots.end());
+                    state->preserved[i] = copies[i];
+                }
+                state->complete.store(true, std::memory_order_release);
+            }
+            _snapshots->states.clear();
+            _snapshots->active = 0;
         }
 };
@@ -0,0 +1,500 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "buffered_hashtable.h"
+#include "circular_buffer.h"
+#include "fixed_key.h"
+#include "hashtable.h"
+#include "interned.h"
+#include "mvcc_hashtable.h"
+#include "int_hashtable.h"
+
+/**
+ * Micro benchmarks for the HashTable and its specializations.
+ * Usage: ./build/bench [number of entries]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+// Runs `f` once and prints the time it took per operation
+template <typename F>
+void benchmark(const std::string& name, size_t ops, F&& f) {
+    auto start = Clock::now();
+    f();
+    auto end = Clock::now();
+
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    std::cout << std::left << std::setw(72) << name
+              << std::right << std::setw(10) << std::fixed << std::setprecision(1) << ns / static_cast<double>(ops)
+              << " ns/op" << std::endl;
+}
+
+// Inserts all `keys`, looks all of them up and then looks up `misses`
+template <typename Table>
+void benchmarkTable(const std::string& name, Table& table, const std::vector<uint64_t>& keys, const std::vector<uint64_t>& misses) {
+    benchmark(name + ": insert", keys.size(), [&]() {
+        for(auto k : keys) {
+            table.insert(k, k);
+        }
+    });
+    size_t found = 0;
+    benchmark(name + ": get (hit)", keys.size(), [&]() {
+        for(auto k : keys) {
+            found += table.get(k).has_value();
+        }
+    });
+    benchmark(name + ": get (miss)", misses.size(), [&]() {
+        for(auto k : misses) {
+            found += table.get(k).has_value();
+        }
+    });
+    if(found != keys.size()) {
+        std::cerr << name << ": found " << found << " of " << keys.size() << " keys" << std::endl;
+    }
+}
+
+// IntegerHash without its simd_keys, so that tables compare tags
+struct FoldedHash {
+    size_t operator()(uint64_t key) const {
+        return static_cast<size_t>(fold_integer(key));
+    }
+};
+
+// Compares std::hash (the identity), fold_integer() and IntHashTable, which
+// additionally compares the keys with SIMD, on the given key pattern
+void benchmarkIntegerKeys(const std::string& pattern, const std::vector<uint64_t>& keys, const std::vector<uint64_t>& misses) {
+    {
+        HashTable<uint64_t, uint64_t> table{};
+        benchmarkTable("HashTable<uint64_t>, " + pattern, table, keys, misses);
+    }
+    {
+        HashTable<uint64_t, uint64_t, AdaptiveLocks, FoldedHash> table{};
+        benchmarkTable("HashTable<uint64_t, FoldedHash>, " + pattern, table, keys, misses);
+    }
+    {
+        IntHashTable<uint64_t, uint64_t> table{};
+        benchmarkTable("IntHashTable<uint64_t>, " + pattern, table, keys, misses);
+    }
+}
+
+// Compares random lookups in bucket arrays of base pages and of huge pages,
+// run it under `perf stat -e dTLB-loads,dTLB-load-misses` for the TLB misses
+void benchmarkHugePages(const std::vector<uint64_t>& keys, const std::vector<uint64_t>& misses) {
+    const std::pair<HugePages, std::string> kinds[] = {
+        {HugePages::None, "base pages"},
+        {HugePages::Transparent, "transparent huge pages"},
+        {HugePages::Explicit, "hugetlbfs"}
+    };
+    for(auto& [pages, name] : kinds) {
+        HashTable<uint64_t, uint64_t> table{keys.size(), false, pages};
+        if(table.hugePages() != pages) {
+            std::cout << "HashTable<uint64_t>, " << name << ": unavailable" << std::endl;
+            continue;
+        }
+        benchmarkTable("HashTable<uint64_t>, random IDs, " + name, table, keys, misses);
+    }
+}
+
+// Compares the lock policies on a table used by a single thread
+void benchmarkLockPolicies(const std::vector<uint64_t>& keys, const std::vector<uint64_t>& misses) {
+    {
+        HashTable<uint64_t, uint64_t, AdaptiveLocks> table{keys.size(), false};
+        benchmarkTable("HashTable<uint64_t>, random IDs, AdaptiveLocks", table, keys, misses);
+    }
+    {
+        HashTable<uint64_t, uint64_t, SharedMutexLocks> table{keys.size(), false};
+        benchmarkTable("HashTable<uint64_t>, random IDs, SharedMutexLocks", table, keys, misses);
+    }
+    {
+        HashTable<uint64_t, uint64_t, SpinLocks> table{keys.size(), false};
+        benchmarkTable("HashTable<uint64_t>, random IDs, SpinLocks", table, keys, misses);
+    }
+    {
+        HashTable<uint64_t, uint64_t, NullLocks> table{keys.size(), false};
+        benchmarkTable("HashTable<uint64_t>, random IDs, NullLocks", table, keys, misses);
+    }
+}
+
+// Compares loading string pairs one by one via insert() and all at once via bulk_load()
+void benchmarkBulkLoad(size_t n) {
+    std::vector<std::pair<std::string, std::string>> pairs{};
+    for(size_t i = 0; i < n; ++i) {
+        pairs.emplace_back(std::to_string(i), std::to_string(i));
+    }
+    {
+        HashTable<std::string, std::string> table{};
+        benchmark("HashTable<std::string>: insert() one by one", n, [&]() {
+            for(auto& [k, v] : pairs) {
+                table.insert(k, v);
+            }
+        });
+    }
+    {
+        HashTable<std::string, std::string> table{};
+        benchmark("HashTable<std::string>: bulk_load()", n, [&]() {
+            table.bulk_load(pairs);
+        });
+    }
+    {
+        HashTable<std::string, std::string> table{};
+        benchmark("HashTable<std::string>: bulk_load(), unique input", n, [&]() {
+            table.bulk_load(pairs, true);
+        });
+    }
+}
+
+// Compares get() with the interleaved lookups of get_batch() on string keys
+// which are stored out of line, i.e. three dependent cache misses per entry
+void benchmarkBatchLookups(size_t n) {
+    HashTable<std::string, std::string> table{n, false};
+    std::vector<std::string> keys{};
+    std::vector<std::string> misses{};
+    for(size_t i = 0; i < n; ++i) {
+        keys.push_back("a rather long key number " + std::to_string(i));
+        misses.push_back("a rather long missing key " + std::to_string(i));
+        table.insert(keys.back(), std::to_string(i));
+    }
+    std::mt19937_64 rng{42};
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    for(auto* lookups : {&keys, &misses}) {
+        std::string kind = lookups == &keys ? " (hit)" : " (miss)";
+        size_t found = 0;
+        benchmark("HashTable<std::string>: get()" + kind, n, [&]() {
+            for(auto& k : *lookups) {
+                found += table.get(k).has_value();
+            }
+        });
+        std::vector<std::vector<std::string>> batches{};
+        for(size_t i = 0; i < n; i += 64) {
+            batches.emplace_back(lookups->begin() + static_cast<long>(i),
+                    lookups->begin() + static_cast<long>(std::min(n, i + 64)));
+        }
+        for(size_t width : {1, 8, 16}) {
+            benchmark("HashTable<std::string>: get_batch(), width " + std::to_string(width) + kind, n, [&]() {
+                for(auto& batch : batches) {
+                    for(auto& r : table.get_batch(batch, width)) {
+                        found += r.has_value();
+                    }
+                }
+            });
+        }
+    }
+}
+
+// Compares std::string with FixedKey / FixedValue when keys and values arrive
+// as zero-padded Message fields, like in the server
+void benchmarkWireFormat(size_t n) {
+    using KeyField = std::array<uint8_t, 128>;
+    using ValueField = std::array<uint8_t, 1024>;
+    std::vector<std::pair<KeyField, ValueField>> fields(n);
+    for(size_t i = 0; i < n; ++i) {
+        std::string key = "a rather long key number " + std::to_string(i);
+        std::string value = "value " + std::to_string(i);
+        memcpy(fields[i].first.data(), key.data(), key.length());
+        memcpy(fields[i].second.data(), value.data(), value.length());
+    }
+    auto toString = [](const uint8_t* bytes, size_t size) {
+        return std::string(reinterpret_cast<const char*>(bytes), strnlen(reinterpret_cast<const char*>(bytes), size));
+    };
+
+    {
+        HashTable<std::string, std::string> table{n, false};
+        benchmark("HashTable<std::string>: insert from Message fields", n, [&]() {
+            for(auto& [key, value] : fields) {
+                table.insert(toString(key.data(), key.size()), toString(value.data(), value.size()));
+            }
+        });
+        size_t found = 0;
+        benchmark("HashTable<std::string>: get from Message fields", n, [&]() {
+            for(auto& [key, value] : fields) {
+                found += table.get(toString(key.data(), key.size())).has_value();
+            }
+        });
+    }
+    {
+        HashTable<FixedKey<128>, FixedValue<1024>> table{n, false};
+        benchmark("HashTable<FixedKey>: insert from Message fields", n, [&]() {
+            for(auto& [key, value] : fields) {
+                table.insert(FixedKey<128>{key}, FixedValue<1024>{value});
+            }
+        });
+        size_t found = 0;
+        benchmark("HashTable<FixedKey>: get from Message fields", n, [&]() {
+            for(auto& [key, value] : fields) {
+                found += table.get(FixedKey<128>{key}).has_value();
+            }
+        });
+    }
+}
+
+// Compares hashing FixedKeys one by one with hash_batch(), which hashes
+// hash_batch_width() keys side by side (4 if the CPU supports AVX2)
+void benchmarkBatchHashing(size_t n) {
+    std::vector<FixedKey<128>> keys{};
+    std::vector<const FixedKey<128>*> ptrs{};
+    for(size_t i = 0; i < n; ++i) {
+        keys.emplace_back(std::string(32 + i % 96, static_cast<char>('a' + i % 26)) + std::to_string(i));
+    }
+    for(auto& key : keys) {
+        ptrs.push_back(&key);
+    }
+    std::vector<size_t> hashes(n);
+    benchmark("FixedKey<128>: hash() one by one", n, [&]() {
+        for(size_t i = 0; i < n; ++i) {
+            hashes[i] = keys[i].hash();
+        }
+    });
+    size_t sum = std::accumulate(hashes.begin(), hashes.end(), size_t{0});
+    benchmark("FixedKey<128>: hash_batch(), " + std::to_string(hash_batch_width()) + " at a time", n, [&]() {
+        std::hash<FixedKey<128>>::hash_batch(ptrs.data(), n, hashes.data());
+    });
+    if(std::accumulate(hashes.begin(), hashes.end(), size_t{0}) != sum)
+        std::cerr << "FixedKey<128>: hash_batch() differs from hash()" << std::endl;
+}
+
+// Compares storing repetitive values as std::string and as Interned<std::string>
+void benchmarkInternedValues(size_t n) {
+    std::vector<std::string> values{};
+    for(size_t i = 0; i < 16; ++i) {
+        values.push_back("{\"status\": \"" + std::to_string(i) + "\", \"details\": \"" + std::string(64, 'x') + "\"}");
+    }
+    {
+        HashTable<uint64_t, std::string> table{n, false};
+        benchmark("HashTable<uint64_t, std::string>: insert, 16 distinct values", n, [&]() {
+            for(size_t i = 0; i < n; ++i) {
+                table.insert(i, values[i % values.size()]);
+            }
+        });
+    }
+    {
+        HashTable<uint64_t, Interned<std::string>> table{n, false};
+        benchmark("HashTable<uint64_t, Interned<std::string>>: insert, 16 distinct values", n, [&]() {
+            for(size_t i = 0; i < n; ++i) {
+                table.insert(i, values[i % values.size()]);
+            }
+        });
+    }
+}
+
+// Compares exporting a table on one thread and on all of them
+void benchmarkExport(size_t n) {
+    HashTable<std::string, std::string> table{};
+    for(size_t i = 0; i < n; ++i) {
+        table.insert("user:" + std::to_string(i), std::string(32, static_cast<char>('a' + i % 26)));
+    }
+    auto snapshot = table.snapshot();
+    const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    for(size_t t : {size_t{1}, threads}) {
+        std::string suffix = ", " + std::to_string(t) + (t == 1 ? " thread" : " threads");
+        size_t exported = 0;
+        benchmark("HashTable<std::string>: Snapshot::getEntries()" + suffix, n, [&]() {
+            exported = snapshot.getEntries(t).size();
+        });
+        int fd = open("/dev/null", O_WRONLY);
+        benchmark("HashTable<std::string>: Snapshot::write() to /dev/null" + suffix, n, [&]() {
+            snapshot.write(fd, " ", t);
+        });
+        close(fd);
+        if(exported != n) {
+            std::cerr << "Exported " << exported << " of " << n << " entries" << std::endl;
+        }
+    }
+}
+
+// Removes 70% of the entries and compares the resident set size before and after compact()
+void benchmarkCompaction(size_t n) {
+    auto mib = [](size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+    auto key = [](size_t i) { return "user:" + std::to_string(i) + ":" + std::string(32, 'k'); };
+
+    HashTable<std::string, std::string> table{};
+    for(size_t i = 0; i < n; ++i) {
+        table.insert(key(i), std::string(200, static_cast<char>('a' + i % 26)));
+    }
+    size_t full = residentBytes();
+    for(size_t i = 0; i < n; ++i) {
+        if(i % 10 < 7)
+            table.remove(key(i));
+    }
+    size_t purged = residentBytes();
+
+    typename HashTable<std::string, std::string>::CompactionStats stats{};
+    benchmark("HashTable<std::string>: compact() after removing 70%", table.size(), [&]() {
+        stats = table.compact();
+    });
+    std::cout << std::fixed << std::setprecision(1)
+              << "  RSS: " << mib(full) << " MiB full, " << mib(purged) << " MiB after removing 70%, "
+              << mib(residentBytes()) << " MiB after compact() (RSS delta " << mib(stats.rssDelta) << " MiB)" << std::endl;
+}
+
+// Compares a burst of writes from several threads into a HashTable with
+// the same burst into a BufferedHashTable, which merges them in the background
+void benchmarkWriteBursts(size_t n) {
+    const size_t writers = 4;
+    auto burst = [&](auto& table) {
+        std::vector<std::thread> threads{};
+        for(size_t t = 0; t < writers; ++t) {
+            threads.emplace_back([&, t]() {
+                for(size_t i = t; i < n; i += writers) {
+                    table.insert_or_assign(i, i);
+                }
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+    };
+    {
+        HashTable<uint64_t, uint64_t> table{};
+        benchmark("HashTable<uint64_t>: insert_or_assign() burst from 4 threads", n, [&]() { burst(table); });
+    }
+    {
+        BufferedHashTable<uint64_t, uint64_t> table{};
+        benchmark("BufferedHashTable<uint64_t>: insert_or_assign() burst from 4 threads", n, [&]() { burst(table); });
+        benchmark("BufferedHashTable<uint64_t>: flush() after the burst", n, [&]() { table.flush(); });
+        if(table.size() != n)
+            std::cerr << "BufferedHashTable<uint64_t>: merged " << table.size() << " of " << n << " writes" << std::endl;
+    }
+}
+
+// Passes `n` elements through the mailbox's queue, first on one thread and
+// then from two producers to two consumers which sleep while it's full or empty
+void benchmarkMailbox(size_t n) {
+    CircularBuffer<uint64_t, 8> queue{};
+    benchmark("CircularBuffer<uint64_t, 8>: push_back() and pop() on one thread", n, [&]() {
+        for(uint64_t i = 0; i < n; ++i) {
+            queue.push_back(i);
+            queue.pop();
+        }
+    });
+    benchmark("CircularBuffer<uint64_t, 8>: 2 producers and 2 consumers", n, [&]() {
+        std::atomic<size_t> popped{0};
+        std::vector<std::thread> threads{};
+        for(size_t t = 0; t < 2; ++t) {
+            threads.emplace_back([&, t]() {
+                for(uint64_t i = t; i < n; i += 2) {
+                    while(queue.push_back(i, 100ms) == -1) { }
+                }
+            });
+            threads.emplace_back([&]() {
+                while(popped < n) {
+                    if(queue.pop(10ms))
+                        ++popped;
+                }
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+    });
+}
+
+// Reads a few hot keys from several threads while another thread keeps overwriting them
+template <typename Table>
+void benchmarkHotKeys(const std::string& name, Table& table, size_t n) {
+    const size_t readers = 3;
+    const uint64_t keys = 16;
+    for(uint64_t k = 0; k < keys; ++k) {
+        table.insert_or_assign(k, std::string(64, 'v'));
+    }
+    std::atomic<bool> done{false};
+    std::thread writer{[&]() {
+        for(uint64_t i = 0; !done; ++i) {
+            table.insert_or_assign(i % keys, std::string(64, static_cast<char>('a' + i % 26)));
+        }
+    }};
+    benchmark(name + ": get() of hot keys during writes", n * readers, [&]() {
+        std::vector<std::thread> threads{};
+        for(size_t t = 0; t < readers; ++t) {
+            threads.emplace_back([&, t]() {
+                size_t found = 0;
+                for(size_t i = 0; i < n; ++i) {
+                    found += table.get((i + t) % keys).has_value();
+                }
+                if(found != n)
+                    std::cerr << name << ": found " << found << " of " << n << " keys" << std::endl;
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+    });
+    done = true;
+    writer.join();
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = 1000000;
+    if(argc > 1) {
+        try {
+            n = std::stoul(argv[1]);
+        } catch(std::exception const& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::cout << "Entries: " << n << std::endl;
+
+    std::mt19937_64 rng{42};
+
+    std::vector<uint64_t> sequential(n);
+    std::vector<uint64_t> sequentialMisses(n);
+    std::vector<uint64_t> strided(n);
+    std::vector<uint64_t> stridedMisses(n);
+    std::vector<uint64_t> aligned(n);
+    std::vector<uint64_t> alignedMisses(n);
+    std::vector<uint64_t> random(n);
+    std::vector<uint64_t> randomMisses(n);
+    for(size_t i = 0; i < n; ++i) {
+        sequential[i]       = i;
+        sequentialMisses[i] = n + i;
+        // e.g. IDs handed out in blocks of 64 per node
+        strided[i]          = i * 64;
+        stridedMisses[i]    = i * 64 + 1;
+        // e.g. IDs whose low 12 bits are a shard or type number, here always 0
+        aligned[i]          = i << 12;
+        alignedMisses[i]    = (i << 12) + 1;
+        random[i]           = rng();
+        randomMisses[i]     = rng();
+    }
+
+    benchmarkIntegerKeys("sequential IDs", sequential, sequentialMisses);
+    benchmarkIntegerKeys("strided IDs", strided, stridedMisses);
+    benchmarkIntegerKeys("aligned IDs", aligned, alignedMisses);
+    benchmarkIntegerKeys("random IDs", random, randomMisses);
+    benchmarkHugePages(random, randomMisses);
+    benchmarkLockPolicies(random, randomMisses);
+
+    benchmarkBulkLoad(n);
+    benchmarkBatchLookups(n);
+    benchmarkInternedValues(n);
+    benchmarkCompaction(n);
+    benchmarkExport(n);
+    benchmarkWriteBursts(n);
+    benchmarkMailbox(n);
+    {
+        HashTable<uint64_t, std::string> table{1024, false};
+        benchmarkHotKeys("HashTable<uint64_t, std::string>", table, n);
+    }
+    {
+        MVCCHashTable<uint64_t, std::string> table{1024};
+        benchmarkHotKeys("MVCCHashTable<uint64_t, std::string>", table, n);
+    }
+    // Every entry takes more than a KiB with fixed-width values
+    benchmarkWireFormat(std::min<size_t>(n, 100000));
+    benchmarkBatchHashing(n);
+
+    return 0;
+}
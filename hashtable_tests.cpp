@@ -4,9 +4,18 @@
 #include <thread>
 #include "doctest.h"
 #include "hashtable.h"
+#include "static_hashtable.h"
+#include "int_hashtable.h"
+#include "fixed_key.h"
+#include "interned.h"
+#include "mvcc_hashtable.h"
+#include "buffered_hashtable.h"
 #include "circular_buffer.h"
 
+#include <algorithm>
+#include <numeric>
 #include <optional>
+#include <random>
 
 
 TEST_CASE("adding new elements to the HashTable") {
@@ -105,6 +114,874 @@ TEST_CASE("removing elements from the HashTable") {
     }
 }
 
+TEST_CASE("fixed-width keys and values") {
+    using Key = FixedKey<128>;
+    using Value = FixedValue<1024>;
+
+    SUBCASE("Conversions") {
+        std::array<uint8_t, 128> field{};
+        memcpy(field.data(), "some key", 8);
+        Key key{field};
+        CHECK(key.size() == 8);
+        CHECK(std::string_view{key} == "some key");
+        CHECK(key == Key{std::string_view{"some key"}});
+
+        // A completely filled field has no terminating zero
+        field.fill('x');
+        CHECK(Key{field}.size() == 128);
+
+        std::array<uint8_t, 128> copy{};
+        key.copy_to(copy);
+        CHECK(Key{copy} == key);
+
+        // Longer strings are truncated
+        CHECK(Value{std::string(2000, 'v')}.size() == 1024);
+    }
+
+    SUBCASE("Equality and hashing") {
+        std::mt19937_64 rng{42};
+        std::vector<Key> keys{};
+        for(size_t length = 0; length <= 128; ++length) {
+            std::string str(length, ' ');
+            for(auto& c : str) {
+                c = static_cast<char>(rng());
+            }
+            Key key{str};
+            CHECK(key == Key{str});
+            CHECK(key.hash() == std::hash<Key>{}(Key{str}));
+            // The SIMD and scalar paths agree, no matter the padding
+            CHECK(hash_bytes(key.data(), 128, length) == hash_bytes_scalar(key.data(), 128, length));
+            keys.push_back(key);
+        }
+        // Trailing zeros are part of the key
+        CHECK_FALSE(Key{std::string_view{"ab\0", 3}} == Key{std::string_view{"ab"}});
+        CHECK(Key{std::string_view{"ab\0", 3}}.hash() != Key{std::string_view{"ab"}}.hash());
+        // Differing only in the last byte
+        CHECK_FALSE(Key{std::string(128, 'a')} == Key{std::string(127, 'a') + "b"});
+        for(size_t i = 1; i < keys.size(); ++i) {
+            CHECK_FALSE(keys[i] == keys[i - 1]);
+            CHECK(keys[i].hash() != keys[i - 1].hash());
+        }
+    }
+
+    SUBCASE("HashTable") {
+        HashTable<Key, Value> table{};
+        for(size_t i = 0; i < 1000; ++i) {
+            REQUIRE(table.insert(Key{std::to_string(i)}, Value{"value " + std::to_string(i)}));
+        }
+        CHECK_FALSE(table.insert(Key{std::string_view{"1"}}, Value{std::string_view{"duplicate"}}));
+        for(size_t i = 0; i < 1000; ++i) {
+            auto value = table.get(Key{std::to_string(i)});
+            REQUIRE(value.has_value());
+            CHECK(std::string_view{*value} == "value " + std::to_string(i));
+        }
+        auto results = table.get_batch({Key{std::string_view{"7"}}, Key{std::string_view{"missing"}}});
+        CHECK(results[0].has_value());
+        CHECK_FALSE(results[1].has_value());
+        for(size_t i = 0; i < 1000; ++i) {
+            REQUIRE(table.remove(Key{std::to_string(i)}).has_value());
+        }
+        CHECK(table.size() == 0);
+    }
+
+    SUBCASE("Batch hashing") {
+        std::mt19937_64 rng{7};
+        std::vector<Key> keys{};
+        for(size_t i = 0; i < 1000; ++i) {
+            // Mixed lengths, so batches end their common stripes at different points
+            std::string str(rng() % 129, ' ');
+            for(auto& c : str) {
+                c = static_cast<char>(rng());
+            }
+            keys.emplace_back(str);
+        }
+        std::vector<const Key*> ptrs{};
+        for(auto& key : keys) {
+            ptrs.push_back(&key);
+        }
+        std::vector<size_t> hashes(keys.size());
+        std::hash<Key>::hash_batch(ptrs.data(), keys.size(), hashes.data());
+        for(size_t i = 0; i < keys.size(); ++i) {
+            REQUIRE(hashes[i] == keys[i].hash());
+        }
+
+        // Batched and single lookups find the same buckets
+        std::vector<std::pair<Key, Value>> pairs{};
+        for(size_t i = 0; i < keys.size(); ++i) {
+            pairs.emplace_back(keys[i], Value{std::to_string(i)});
+        }
+        HashTable<Key, Value> table{};
+        size_t loaded = table.bulk_load(pairs);
+        CHECK(loaded == table.size());
+        auto results = table.get_batch(keys);
+        for(size_t i = 0; i < keys.size(); ++i) {
+            REQUIRE(results[i].has_value());
+            CHECK(results[i] == table.get(keys[i]));
+        }
+    }
+}
+
+TEST_CASE("interned values") {
+    using Value = Interned<std::string>;
+    auto& pool = InternPool<std::string>::global();
+    const size_t before = pool.size();
+    const std::string even = "even " + std::string(64, '.');
+    const std::string odd = "odd " + std::string(64, '.');
+
+    SUBCASE("Sharing values") {
+        {
+            HashTable<std::string, Value> table{};
+            for(size_t i = 0; i < 1000; ++i) {
+                REQUIRE(table.insert(std::to_string(i), i % 2 == 0 ? even : odd));
+            }
+            CHECK(pool.size() == before + 2);
+
+            auto value = table.get("1");
+            REQUIRE(value.has_value());
+            CHECK(**value == odd);
+            CHECK(value->use_count() == 501);
+            CHECK(*value == Value{odd});
+            CHECK_FALSE(*value == Value{even});
+            value.reset();
+
+            for(size_t i = 1; i < 1000; i += 2) {
+                REQUIRE(table.remove(std::to_string(i)).has_value());
+            }
+            CHECK(pool.size() == before + 1);
+            CHECK(table.get("0")->use_count() == 501);
+
+            // Overwriting releases the previous value
+            for(size_t i = 0; i < 1000; i += 2) {
+                table.insert_or_assign(std::to_string(i), odd);
+            }
+            CHECK(pool.size() == before + 1);
+            CHECK(*table.get("0") == Value{odd});
+        }
+        CHECK(pool.size() == before);
+        CHECK(Value{} == Value{std::string{}});
+    }
+
+    SUBCASE("Concurrent interning") {
+        HashTable<size_t, Value> table{64, false};
+        std::vector<std::thread> threads{};
+        for(size_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t]() {
+                for(size_t round = 0; round < 2000; ++round) {
+                    size_t key = t * 16 + round % 16;
+                    table.insert_or_assign(key, std::to_string(round % 7));
+                    auto value = table.get(key);
+                    CHECK(value.has_value());
+                    if(round % 3 == 0)
+                        table.remove(key);
+                }
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        CHECK(pool.size() <= before + 7);
+        for(size_t key = 0; key < 64; ++key) {
+            table.remove(key);
+        }
+        CHECK(pool.size() == before);
+    }
+}
+
+TEST_CASE("multi-version hashtable") {
+    MVCCHashTable<std::string, int> table{16};
+
+    SUBCASE("Single-threaded operations") {
+        CHECK(table.insert("a", 1));
+        CHECK_FALSE(table.insert("a", 2));
+        CHECK(table.get("a") == 1);
+        CHECK_FALSE(table.insert_or_assign("a", 3));
+        CHECK(table.insert_or_assign("b", 4));
+        CHECK(table.get("a") == 3);
+        CHECK(table.size() == 2);
+        CHECK(table.remove("a") == 3);
+        CHECK_FALSE(table.remove("a").has_value());
+        CHECK_FALSE(table.get("a").has_value());
+        CHECK(table.insert("a", 5));
+        CHECK(table.get("a") == 5);
+        CHECK(table.size() == 2);
+    }
+
+    SUBCASE("Read views") {
+        for(int i = 0; i < 100; ++i) {
+            table.insert(std::to_string(i), i);
+        }
+        {
+            auto view = table.read_view();
+            for(int i = 0; i < 100; ++i) {
+                if(i % 2 == 0)
+                    table.remove(std::to_string(i));
+                else
+                    table.insert_or_assign(std::to_string(i), -i);
+            }
+            table.insert("new", 1);
+            table.collect();
+
+            // The view still sees the table as of its creation
+            CHECK(view.get("0") == 0);
+            CHECK(view.get("1") == 1);
+            CHECK_FALSE(view.get("new").has_value());
+            auto keys = view.getKeys();
+            auto values = view.getValues();
+            CHECK(keys.size() == 100);
+            CHECK(std::accumulate(values.begin(), values.end(), 0) == 4950);
+
+            CHECK_FALSE(table.get("0").has_value());
+            CHECK(table.get("1") == -1);
+            CHECK(table.getKeys().size() == 51);
+        }
+
+        // Without readers everything superseded can be freed
+        table.collect();
+        table.collect();
+        CHECK(table.pending() == 0);
+        CHECK(table.size() == 51);
+    }
+
+    SUBCASE("Concurrent readers and writers") {
+        // Writers keep both keys of a pair at the same value, which readers
+        // check within a single view: it has to be consistent with itself
+        const size_t pairs = 32;
+        for(size_t i = 0; i < pairs; ++i) {
+            table.insert("x" + std::to_string(i), 0);
+        }
+        std::atomic<bool> done{false};
+        std::vector<std::thread> writers{};
+        for(size_t t = 0; t < 2; ++t) {
+            writers.emplace_back([&, t]() {
+                for(int round = 1; round <= 2000; ++round) {
+                    auto key = "x" + std::to_string((static_cast<size_t>(round) * 2 + t) % pairs);
+                    table.insert_or_assign(key, round);
+                    if(round % 5 == 0) {
+                        table.remove(key);
+                        table.insert(key, round);
+                    }
+                }
+            });
+        }
+        std::vector<std::thread> readers{};
+        for(size_t t = 0; t < 2; ++t) {
+            readers.emplace_back([&]() {
+                while(!done) {
+                    auto view = table.read_view();
+                    auto first = view.getValues();
+                    auto second = view.getValues();
+                    CHECK(first == second);
+                    CHECK(view.get("x0") == view.get("x0"));
+                }
+            });
+        }
+        for(auto& writer : writers) {
+            writer.join();
+        }
+        done = true;
+        for(auto& reader : readers) {
+            reader.join();
+        }
+        CHECK(table.size() == pairs);
+        CHECK(table.getKeys().size() == pairs);
+        table.collect();
+        table.collect();
+        CHECK(table.pending() == 0);
+    }
+}
+
+TEST_CASE("reverse index") {
+    HashTable<std::string, int> table{16, true};
+    auto sorted = [](std::vector<std::string> keys) {
+        std::sort(keys.begin(), keys.end());
+        return keys;
+    };
+    for(int i = 0; i < 100; ++i) {
+        table.insert(std::to_string(i), i % 10);
+    }
+    // Without the index keysOf() scans the table
+    REQUIRE_FALSE(table.hasReverseIndex());
+    auto scanned = sorted(table.keysOf(3));
+    CHECK(scanned.size() == 10);
+
+    SUBCASE("Indexing existing and new entries") {
+        table.enableReverseIndex();
+        REQUIRE(table.hasReverseIndex());
+        CHECK(sorted(table.keysOf(3)) == scanned);
+        CHECK(table.keysOf(42).empty());
+
+        table.insert("a", 42);
+        table.insert_or_assign("3", 42);
+        table["b"] = 42;
+        table.remove("13");
+        CHECK(sorted(table.keysOf(42)) == std::vector<std::string>{"3", "a", "b"});
+        CHECK(table.keysOf(3).size() == 8);
+
+        using Tx = HashTable<std::string, int>::Transaction;
+        REQUIRE(table.commit(Tx{}.remove("a").assign("b", 7).insert("c", 42)).has_value());
+        CHECK(sorted(table.keysOf(42)) == std::vector<std::string>{"3", "c"});
+        CHECK(table.keysOf(7).size() == 11);
+
+        std::vector<std::pair<std::string, int>> pairs{{"d", 42}, {"c", 0}};
+        table.bulk_load(pairs);
+        CHECK(sorted(table.keysOf(42)) == std::vector<std::string>{"3", "c", "d"});
+
+        // Resizing moves entries, but doesn't change the index
+        for(int i = 100; i < 1000; ++i) {
+            table.insert(std::to_string(i), -1);
+        }
+        CHECK(sorted(table.keysOf(42)) == std::vector<std::string>{"3", "c", "d"});
+        CHECK(table.keysOf(-1).size() == 900);
+    }
+
+    SUBCASE("Concurrent writers") {
+        table.enableReverseIndex();
+        std::vector<std::thread> threads{};
+        for(int t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t]() {
+                for(int round = 0; round < 2000; ++round) {
+                    auto key = std::to_string(t * 25 + round % 25);
+                    table.insert_or_assign(key, round % 10);
+                    if(round % 3 == 0)
+                        table.remove(key);
+                }
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        size_t indexed = 0;
+        for(int value = 0; value < 10; ++value) {
+            for(auto& key : table.keysOf(value)) {
+                CHECK(table.get(key) == value);
+                ++indexed;
+            }
+        }
+        CHECK(indexed == table.size());
+    }
+}
+
+TEST_CASE("reverse index of keys without std::hash") {
+    // Only hashed by the table's Hash parameter
+    struct Id {
+        int id;
+        bool operator==(const Id&) const = default;
+    };
+    struct IdHash {
+        size_t operator()(const Id& key) const {
+            return std::hash<int>{}(key.id);
+        }
+    };
+    HashTable<Id, int, AdaptiveLocks, IdHash> table{16, true};
+    for(int i = 0; i < 20; ++i) {
+        table.insert(Id{i}, i % 2);
+    }
+    table.enableReverseIndex();
+    CHECK(table.keysOf(1).size() == 10);
+    table.remove(Id{1});
+    CHECK(table.keysOf(1).size() == 9);
+}
+
+TEST_CASE("futex words") {
+    std::atomic<uint32_t> word{0};
+
+    // Returns at once if the word changed already, otherwise after the timeout
+    CHECK(futexWait(&word, 1, std::chrono::milliseconds(1000)));
+    CHECK_FALSE(futexWait(&word, 0, std::chrono::milliseconds(10)));
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread waiter([&]() {
+        uint32_t seen = 0;
+        while(!futexWait(&word, seen, std::chrono::milliseconds(10000))) { }
+        CHECK(word.load() == 1);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    word.store(1);
+    futexWake(&word);
+    waiter.join();
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(5000));
+}
+
+TEST_CASE("compacting the HashTable") {
+    HashTable<std::string, std::string> table{64, true};
+    auto value = [](size_t i) { return std::to_string(i) + std::string(100, 'v'); };
+    for(size_t i = 0; i < 20000; ++i) {
+        table.insert("key " + std::to_string(i) + std::string(40, 'k'), value(i));
+    }
+    for(size_t i = 0; i < 20000; ++i) {
+        if(i % 10 < 7)
+            table.remove("key " + std::to_string(i) + std::string(40, 'k'));
+    }
+    REQUIRE(table.size() == 6000);
+
+    SUBCASE("Relocating all entries") {
+        auto snapshot = table.snapshot();
+        auto stats = table.compact();
+        CHECK(stats.buckets == table.capacity());
+        CHECK(stats.entries == 6000);
+        CHECK(table.size() == 6000);
+        for(size_t i = 0; i < 20000; ++i) {
+            auto result = table.get("key " + std::to_string(i) + std::string(40, 'k'));
+            CHECK(result.has_value() == (i % 10 >= 7));
+            if(result)
+                CHECK(*result == value(i));
+        }
+        CHECK(snapshot.getEntries().size() == 6000);
+    }
+
+    SUBCASE("Concurrent readers and writers") {
+        std::atomic<bool> done{false};
+        std::thread writer([&]() {
+            for(size_t i = 0; !done; i = (i + 1) % 1000) {
+                table.insert_or_assign("w" + std::to_string(i), value(i));
+            }
+        });
+        std::thread reader([&]() {
+            while(!done) {
+                auto result = table.get("key 9" + std::string(40, 'k'));
+                CHECK(result == value(9));
+            }
+        });
+        for(size_t round = 0; round < 3; ++round) {
+            table.compact(std::chrono::microseconds(100));
+        }
+        done = true;
+        writer.join();
+        reader.join();
+        CHECK(table.get("key 19999" + std::string(40, 'k')) == value(19999));
+    }
+}
+
+TEST_CASE("zero-initialized buckets") {
+    SUBCASE("Mapping a huge bucket array") {
+        using Slots = SlotBlocks<std::string, std::string>;
+        const size_t n = size_t{1} << 22;
+        size_t before = residentBytes();
+        {
+            BucketArray<Slots> buckets{n};
+            REQUIRE(buckets.size() == n);
+            // Zero pages are valid empty buckets, only written ones take memory
+            CHECK(buckets[n - 1].empty());
+            for(size_t i = 0; i < n; i += n / 16) {
+                buckets[i].emplace(Slots::tag(i), std::to_string(i), std::string(32, 'v'));
+            }
+            CHECK(buckets[n / 2].find(std::to_string(n / 2), Slots::tag(n / 2))->second == std::string(32, 'v'));
+            CHECK(residentBytes() < before + n * sizeof(Slots) / 16);
+        }
+
+        HashTable<int, int> table{n, false};
+        CHECK(table.capacity() == n);
+        CHECK(table.insert(1, 1));
+        CHECK(table.get(1) == 1);
+    }
+
+    SUBCASE("Destroying the written buckets") {
+        // All zero until it counts something
+        struct Counted {
+            int* destroyed;
+            ~Counted() {
+                if(destroyed)
+                    ++*destroyed;
+            }
+        };
+        int destroyed = 0;
+        {
+            BucketArray<Counted> buckets{size_t{1} << 20};
+            for(size_t i = 0; i < buckets.size(); i += 10000) {
+                buckets[i].destroyed = &destroyed;
+            }
+            // Read, but not written
+            CHECK(buckets[buckets.size() - 1].destroyed == nullptr);
+        }
+        CHECK(destroyed == 105);
+    }
+
+    SUBCASE("Bucket locks") {
+        BucketLock lock{};
+        CHECK(lock.try_lock_shared());
+        CHECK(lock.try_lock_shared());
+        CHECK_FALSE(lock.try_lock());
+        lock.unlock_shared();
+        lock.unlock_shared();
+        CHECK(lock.try_lock());
+        CHECK_FALSE(lock.try_lock_shared());
+        lock.unlock();
+
+        // Writers keep both counters equal, readers never see them differ
+        size_t first = 0;
+        size_t second = 0;
+        std::atomic<bool> done{false};
+        std::vector<std::thread> threads{};
+        for(size_t t = 0; t < 2; ++t) {
+            threads.emplace_back([&]() {
+                for(size_t i = 0; i < 20000; ++i) {
+                    std::unique_lock writer(lock);
+                    ++first;
+                    ++second;
+                }
+            });
+        }
+        std::thread reader([&]() {
+            while(!done) {
+                std::shared_lock shared(lock);
+                CHECK(first == second);
+            }
+        });
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        done = true;
+        reader.join();
+        CHECK(first == 40000);
+    }
+}
+
+TEST_CASE("adaptive bucket locks") {
+    SUBCASE("Choosing a mode") {
+        CHECK(BucketLock::classify(0, 0, 0) == LockMode::ReaderBiased);
+        CHECK(BucketLock::classify(100, 20, 0) == LockMode::Spin);
+        CHECK(BucketLock::classify(800, 100, 10) == LockMode::ReaderBiased);
+        CHECK(BucketLock::classify(800, 100, 50) == LockMode::Fair);
+        CHECK(BucketLock::classify(0, 10, 9) == LockMode::Fair);
+    }
+
+    SUBCASE("Contended locks") {
+        LockStats before = HashTable<int, int>::lockStats();
+        CHECK(before.spin + before.readerBiased + before.fair == LOCK_STRIPES);
+
+        // Enough contention for several samples, whichever modes they lead to
+        BucketLock lock{};
+        size_t first = 0;
+        size_t second = 0;
+        std::atomic<size_t> writersDone{0};
+        std::vector<std::thread> threads{};
+        for(size_t t = 0; t < 2; ++t) {
+            threads.emplace_back([&]() {
+                for(size_t i = 0; i < 4 * LOCK_SAMPLE_WINDOW; ++i) {
+                    std::unique_lock writer(lock);
+                    ++first;
+                    std::this_thread::yield();
+                    ++second;
+                }
+                ++writersDone;
+            });
+        }
+        for(size_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&]() {
+                while(writersDone < 2) {
+                    std::shared_lock shared(lock);
+                    REQUIRE(first == second);
+                    std::this_thread::yield();
+                }
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        CHECK(first == 8 * LOCK_SAMPLE_WINDOW);
+
+        LockStats after = HashTable<int, int>::lockStats();
+        CHECK(after.spin + after.readerBiased + after.fair == LOCK_STRIPES);
+        CHECK(after.contendedReads + after.contendedWrites > before.contendedReads + before.contendedWrites);
+        CHECK(after.parkedWrites <= after.contendedWrites);
+        CHECK(lock.try_lock());
+        lock.unlock();
+    }
+}
+
+TEST_CASE_TEMPLATE("lock policies", Locks, AdaptiveLocks, SharedMutexLocks, SpinLocks, ProcessSharedLocks, NullLocks) {
+    SUBCASE("Locks") {
+        typename Locks::Bucket lock{};
+        CHECK(lock.try_lock_shared());
+        CHECK(lock.try_lock_shared());
+        if constexpr(Locks::threadSafe)
+            CHECK_FALSE(lock.try_lock());
+        lock.unlock_shared();
+        lock.unlock_shared();
+        CHECK(lock.try_lock());
+        if constexpr(Locks::threadSafe)
+            CHECK_FALSE(lock.try_lock_shared());
+        lock.unlock();
+    }
+
+    SUBCASE("Growing, shrinking and transactions") {
+        HashTable<int, int, Locks> table{};
+        for(int i = 0; i < 10000; ++i) {
+            REQUIRE(table.insert(i, i));
+        }
+        CHECK(table.size() == 10000);
+        CHECK(table.capacity() > 10000);
+        for(int i = 0; i < 10000; i += 2) {
+            REQUIRE(table.remove(i) == i);
+        }
+
+        typename HashTable<int, int, Locks>::Transaction tx{};
+        tx.assign(1, 2);
+        tx.remove(3);
+        tx.insert(4, 4);
+        REQUIRE(table.commit(tx).has_value());
+        CHECK(table.get(1) == 2);
+        CHECK_FALSE(table.get(3).has_value());
+        CHECK(table.get(4) == 4);
+
+        auto snapshot = table.snapshot();
+        CHECK(snapshot.size() == 5000);
+        auto values = table.get_batch({1, 2, 5});
+        CHECK(values[0] == 2);
+        CHECK_FALSE(values[1].has_value());
+        CHECK(values[2] == 5);
+    }
+
+    SUBCASE("Thread-confined tables") {
+        if constexpr(!Locks::threadSafe) {
+            // No locks, so the buckets are smaller
+            CHECK(std::is_empty_v<typename Locks::Bucket>);
+            // One table per thread, each only used by its owner
+            std::vector<HashTable<int, int, Locks>> partitions(4);
+            std::vector<std::thread> workers{};
+            for(int t = 0; t < 4; ++t) {
+                workers.emplace_back([&partitions, t]() {
+                    for(int i = 0; i < 10000; ++i) {
+                        partitions[static_cast<size_t>(t)].insert(i, i * t);
+                    }
+                });
+            }
+            for(auto& worker : workers) {
+                worker.join();
+            }
+            for(int t = 0; t < 4; ++t) {
+                CHECK(partitions[static_cast<size_t>(t)].size() == 10000);
+                CHECK(partitions[static_cast<size_t>(t)].get(9999) == 9999 * t);
+            }
+        }
+    }
+}
+
+TEST_CASE("huge page bucket arrays") {
+    for(auto pages : {HugePages::Transparent, HugePages::Explicit}) {
+        BucketArray<SlotBlocks<int, int>> buckets{1000, pages};
+        // Without huge pages, the array falls back to base pages
+        if(buckets.pages() != HugePages::None) {
+            CHECK(reinterpret_cast<uintptr_t>(buckets.get()) % HUGE_PAGE_SIZE == 0);
+        }
+        CHECK((pages == HugePages::Explicit || buckets.pages() != HugePages::Explicit));
+        CHECK(buckets[999].empty());
+
+        // Resizing keeps the requested kind of pages
+        HashTable<int, int> table{4, true, pages};
+        for(int i = 0; i < 10000; ++i) {
+            table.insert(i, i);
+        }
+        CHECK(table.capacity() > 4);
+        CHECK(table.hugePages() == buckets.pages());
+        for(int i = 0; i < 10000; ++i) {
+            REQUIRE(table.get(i) == i);
+        }
+    }
+}
+
+TEST_CASE("buffered writes") {
+    SUBCASE("Applying deltas") {
+        HashTable<std::string, int> table{};
+        table.insert("kept", 1);
+        table.insert("removed", 2);
+        std::vector<std::pair<std::string, std::optional<int>>> deltas{};
+        for(int i = 0; i < 1000; ++i) {
+            deltas.emplace_back(std::to_string(i), i);
+        }
+        // Later deltas for the same key win
+        deltas.emplace_back("0", 42);
+        deltas.emplace_back("1", std::nullopt);
+        deltas.emplace_back("removed", std::nullopt);
+        deltas.emplace_back("missing", std::nullopt);
+        table.apply(deltas);
+        CHECK(table.size() == 1000);
+        CHECK(table.get("0") == 42);
+        CHECK_FALSE(table.get("1").has_value());
+        CHECK(table.get("999") == 999);
+        CHECK(table.get("kept") == 1);
+        CHECK_FALSE(table.get("removed").has_value());
+    }
+
+    SUBCASE("Reading buffered writes") {
+        BufferedHashTable<std::string, std::string> table{};
+        table.insert_or_assign("a", "1");
+        table.insert_or_assign("a", "2");
+        CHECK(table.get("a") == "2");
+        table.remove("a");
+        CHECK_FALSE(table.get("a").has_value());
+        table.insert_or_assign("b", "3");
+        table.flush();
+        CHECK(table.size() == 1);
+        CHECK(table.table().get("b") == "3");
+        CHECK_FALSE(table.table().get("a").has_value());
+        // Buffered writes shadow merged ones
+        table.remove("b");
+        CHECK_FALSE(table.get("b").has_value());
+    }
+
+    SUBCASE("Concurrent writers") {
+        const size_t threads = 4;
+        const size_t keys = 3 * WRITE_BUFFER_CHUNK;
+        BufferedHashTable<size_t, size_t> table{};
+        std::vector<std::thread> writers{};
+        for(size_t t = 0; t < threads; ++t) {
+            writers.emplace_back([&, t]() {
+                // Every thread writes its own keys twice and reads its own writes
+                for(size_t round = 0; round < 2; ++round) {
+                    for(size_t i = 0; i < keys; ++i) {
+                        size_t key = i * threads + t;
+                        table.insert_or_assign(key, key + round);
+                        REQUIRE(table.get(key) == key + round);
+                    }
+                }
+                for(size_t i = 0; i < keys; i += 2) {
+                    table.remove(i * threads + t);
+                }
+            });
+        }
+        for(auto& writer : writers) {
+            writer.join();
+        }
+        table.flush();
+        CHECK(table.size() == threads * keys / 2);
+        for(size_t key = 0; key < threads * keys; ++key) {
+            if((key / threads) % 2 == 0)
+                REQUIRE_FALSE(table.table().get(key).has_value());
+            else
+                REQUIRE(table.table().get(key) == key + 1);
+        }
+    }
+}
+
+TEST_CASE("erasing entries matching a predicate") {
+    SUBCASE("One sweep") {
+        HashTable<int, int> table{};
+        for(int i = 0; i < 100000; ++i) {
+            table.insert(i, i % 10);
+        }
+        size_t capacity = table.capacity();
+        auto snap = table.snapshot();
+
+        CHECK(table.erase_if([](const int&, const int& value) { return value != 0; }) == 90000);
+        CHECK(table.size() == 10000);
+        for(int i = 0; i < 100000; ++i) {
+            REQUIRE(table.get(i).has_value() == (i % 10 == 0));
+        }
+        // Shrunk once all buckets were swept
+        CHECK(table.capacity() < capacity);
+        CHECK(table.load_factor() >= ALPHA_MIN);
+        CHECK(snap.getEntries().size() == 100000);
+
+        CHECK(table.retain([](const int& key, const int&) { return key < 50000; }) == 5000);
+        CHECK(table.size() == 5000);
+        CHECK(table.get(40000) == 0);
+        CHECK_FALSE(table.get(50000).has_value());
+        CHECK(table.erase_if([](const int&, const int&) { return false; }) == 0);
+    }
+
+    SUBCASE("Parallel sweeps next to writers") {
+        HashTable<std::string, int> table{4 * SWEEP_MIN_BUCKETS, true};
+        for(int i = 0; i < 100000; ++i) {
+            table.insert((i % 2 ? "tenant1:" : "tenant2:") + std::to_string(i), i);
+        }
+        std::atomic<bool> done{false};
+        std::thread writer([&]() {
+            for(int i = 0; !done || i < 1000; ++i) {
+                table.insert_or_assign("tenant3:" + std::to_string(i % 1000), i);
+            }
+        });
+        size_t removed = table.erase_if([](const std::string& key, const int&) { return key.starts_with("tenant1:"); }, 4);
+        done = true;
+        writer.join();
+
+        CHECK(removed == 50000);
+        CHECK(table.size() == 50000 + 1000);
+        for(int i = 0; i < 100000; ++i) {
+            REQUIRE(table.get((i % 2 ? "tenant1:" : "tenant2:") + std::to_string(i)).has_value() == (i % 2 == 0));
+        }
+    }
+}
+
+// Strings stored in the blocks themselves and fixed-width strings, which are boxed
+TEST_CASE_TEMPLATE("storing entries in slot blocks", Slots, SlotBlocks<std::string, std::string>, SlotBlocks<FixedKey<64>, FixedValue<256>>) {
+    using K = typename Slots::value_type::first_type;
+    using V = typename Slots::value_type::second_type;
+    static_assert(Slots::slots >= BUCKET_MIN_SLOTS);
+    static_assert(Slots::boxed == (sizeof(typename Slots::value_type) > BUCKET_INLINE_BYTES / BUCKET_MIN_SLOTS));
+    auto key = [](size_t i) { return K{std::to_string(i)}; };
+    auto value = [](size_t i) { return V{std::string(32, 'a') + std::to_string(i)}; };
+    Slots slots{};
+    const size_t n = 5 * Slots::slots + 1;
+
+    // All entries share one tag, so every lookup has to compare the keys
+    for(size_t i = 0; i < n; ++i) {
+        slots.emplace(Slots::tag(0), key(i), value(i));
+    }
+    REQUIRE(slots.size() == n);
+    REQUIRE(static_cast<size_t>(std::distance(slots.begin(), slots.end())) == n);
+    for(size_t i = 0; i < n; ++i) {
+        auto it = slots.find(key(i), Slots::tag(0));
+        REQUIRE(it != slots.end());
+        CHECK(it->second == value(i));
+    }
+    CHECK(slots.find(key(0), Slots::tag(SIZE_MAX)) == slots.end());
+    CHECK(slots.find(key(n), Slots::tag(0)) == slots.end());
+
+    // Relocating moves the entries of further blocks into new ones
+    const auto* second = slots.head()->next();
+    const auto* first = &*slots.begin();
+    size_t relocated = 0;
+    slots.relocate([&relocated](typename Slots::value_type&) { ++relocated; });
+    CHECK(relocated == n);
+    CHECK(slots.head()->next() != second);
+    // Boxed entries of the first block get new boxes, too
+    CHECK((&*slots.begin() != first) == Slots::boxed);
+    REQUIRE(static_cast<size_t>(std::distance(slots.begin(), slots.end())) == n);
+    CHECK(slots.find(key(n - 1), Slots::tag(0))->second == value(n - 1));
+
+    // Erasing fills the holes with the last entry and releases empty blocks
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937{42});
+    for(size_t k = 0; k < n; ++k) {
+        slots.erase(slots.find(key(order[k]), Slots::tag(0)));
+        REQUIRE(slots.size() == n - k - 1);
+        REQUIRE(static_cast<size_t>(std::distance(slots.begin(), slots.end())) == n - k - 1);
+        if(k + 1 < n)
+            CHECK(slots.find(key(order[k + 1]), Slots::tag(0)) != slots.end());
+    }
+    CHECK(slots.empty());
+    CHECK(slots.head()->next() == nullptr);
+}
+
+TEST_CASE_TEMPLATE("comparing integer keys with SIMD", K, uint8_t, int32_t, uint64_t) {
+    using Slots = SlotBlocks<K, int, true>;
+    static_assert(Slots::simdKeys);
+    static_assert(!SlotBlocks<K, int>::simdKeys);
+    Slots slots{};
+    // Unused slots hold 0, which must not match
+    CHECK(slots.find(K{0}, Slots::tag(0)) == slots.end());
+
+    // Tags are ignored, only the keys decide
+    const size_t n = 3 * Slots::slots + 2;
+    for(size_t i = 0; i < n; ++i) {
+        slots.emplace(Slots::tag(i), static_cast<K>(i), static_cast<int>(i));
+    }
+    for(size_t i = 0; i < n; ++i) {
+        auto it = slots.find(static_cast<K>(i), Slots::tag(SIZE_MAX));
+        REQUIRE(it != slots.end());
+        CHECK(it->second == static_cast<int>(i));
+    }
+    CHECK(slots.find(static_cast<K>(n), Slots::tag(0)) == slots.end());
+
+    // Erasing moves the last key into the hole
+    slots.erase(slots.find(K{0}, 0));
+    CHECK(slots.find(K{0}, 0) == slots.end());
+    CHECK(slots.find(static_cast<K>(n - 1), 0)->second == static_cast<int>(n - 1));
+    REQUIRE(slots.size() == n - 1);
+}
+
 TEST_CASE("growing and shrinking the HashTable") {
     HashTable<int, int> table{10, true};
 
@@ -132,9 +1009,678 @@ TEST_CASE("growing and shrinking the HashTable") {
     REQUIRE(table.capacity() == 10);
 }
 
-TEST_CASE("stress tests (dynamic)") {
+TEST_CASE("growing and shrinking the HashTable in the background") {
+    HashTable<int, int> table{10, true};
+    table.startMaintenance(1ms);
+
+    REQUIRE(table.hasMaintenance() == true);
+
+    // Waits until the maintenance thread brought the load factor back into bounds
+    auto settle = [&table]() {
+        for(int i = 0; i < 1000 && table.needsResize(0); ++i) {
+            std::this_thread::sleep_for(1ms);
+        }
+    };
+
+    for(int i = 0; i < 1000; ++i) {
+        table.insert(i, i);
+        // Mutators only resize themselves if the maintenance thread falls behind too far
+        REQUIRE(table.load_factor() < ALPHA_HARD_MAX);
+    }
+    settle();
+    REQUIRE(table.size() == 1000);
+    CHECK(table.load_factor() < ALPHA_MAX);
+
+    for(int i = 0; i < 1000; ++i) {
+        auto elem = table.get(i);
+        REQUIRE(elem.has_value() == true);
+        CHECK(*elem == i);
+    }
+
+    size_t grownCapacity = table.capacity();
+    for(int i = 0; i < 990; ++i) {
+        table.remove(i);
+    }
+    settle();
+    REQUIRE(table.size() == 10);
+    CHECK(table.capacity() < grownCapacity);
+    CHECK(table.load_factor() > ALPHA_MIN);
+
+    table.stopMaintenance();
+    REQUIRE(table.hasMaintenance() == false);
+
+    // Without the maintenance thread, mutators resize the HashTable themselves again
+    for(int i = 0; i < 1000; ++i) {
+        table.insert(i, i);
+    }
+    CHECK(table.load_factor() < ALPHA_MAX);
+}
+
+TEST_CASE("atomically computing values") {
+    HashTable<std::string, int> table{4, true};
+
+    SUBCASE("compute()") {
+        auto result = table.compute("a", [](std::optional<int> v) -> std::optional<int> { return v ? *v + 1 : 1; });
+        REQUIRE(result.has_value() == true);
+        CHECK(*result == 1);
+        result = table.compute("a", [](std::optional<int> v) -> std::optional<int> { return v ? *v + 1 : 1; });
+        CHECK(*result == 2);
+        CHECK(*table.get("a") == 2);
+        REQUIRE(table.size() == 1);
+
+        // Returning std::nullopt removes the entry
+        result = table.compute("a", [](std::optional<int>) -> std::optional<int> { return std::nullopt; });
+        CHECK(result.has_value() == false);
+        CHECK(table.get("a").has_value() == false);
+        REQUIRE(table.size() == 0);
+    }
+    SUBCASE("compute_if_absent()") {
+        int calls = 0;
+        auto factory = [&calls]() { ++calls; return 42; };
+        CHECK(table.compute_if_absent("a", factory) == 42);
+        CHECK(table.compute_if_absent("a", factory) == 42);
+        CHECK(calls == 1);
+        REQUIRE(table.size() == 1);
+    }
+    SUBCASE("compute_if_present()") {
+        auto twice = [](const int& v) -> std::optional<int> { return 2 * v; };
+        CHECK(table.compute_if_present("a", twice).has_value() == false);
+        REQUIRE(table.size() == 0);
+
+        table.insert("a", 21);
+        auto result = table.compute_if_present("a", twice);
+        REQUIRE(result.has_value() == true);
+        CHECK(*result == 42);
+        CHECK(*table.get("a") == 42);
+
+        table.compute_if_present("a", [](const int&) -> std::optional<int> { return std::nullopt; });
+        CHECK(table.get("a").has_value() == false);
+        REQUIRE(table.size() == 0);
+    }
+    SUBCASE("merge()") {
+        auto sum = [](const int& a, const int& b) -> std::optional<int> { return a + b; };
+        CHECK(*table.merge("a", 1, sum) == 1);
+        CHECK(*table.merge("a", 2, sum) == 3);
+        CHECK(*table.get("a") == 3);
+
+        table.merge("a", 0, [](const int&, const int&) -> std::optional<int> { return std::nullopt; });
+        CHECK(table.get("a").has_value() == false);
+        REQUIRE(table.size() == 0);
+    }
+    SUBCASE("insert_or_assign()") {
+        CHECK(table.insert_or_assign("a", 1) == true);
+        CHECK(table.insert_or_assign("a", 2) == false);
+        CHECK(*table.get("a") == 2);
+        REQUIRE(table.size() == 1);
+    }
+    SUBCASE("parallel counters") {
+        const size_t slots = 8;
+        std::array<std::thread, slots> threads{};
+
+        auto f = [&table]() {
+            for(int i = 0; i < 10000; ++i) {
+                table.increment(std::to_string(i % 100));
+                table.merge(std::to_string(i % 100 + 100), 1, [](const int& a, const int& b) -> std::optional<int> { return a + b; });
+            }
+        };
+
+        for(size_t i = 0; i < slots; ++i) {
+            threads[i] = std::thread{f};
+        }
+
+        for(auto& t : threads) {
+            t.join();
+        }
+
+        REQUIRE(table.size() == 200);
+        for(int i = 0; i < 200; ++i) {
+            auto elem = table.get(std::to_string(i));
+            REQUIRE(elem.has_value() == true);
+            CHECK(*elem == static_cast<int>(slots) * 100);
+        }
+    }
+    SUBCASE("in-place increments") {
+        HashTable<int, double> doubles{4, true};
+        CHECK(doubles.increment(1, 0.5) == 0.5);
+        CHECK(doubles.increment(1, 0.25) == 0.75);
+        CHECK(*doubles.get(1) == 0.75);
+
+        // Once a hook observes changes, increments take the bucket's lock in write mode
+        CHECK(table.increment("a") == 1);
+        CHECK(table.increment("a", 2) == 3);
+        std::vector<std::string> changed{};
+        table.enableChangeHook([&changed](const std::string& key) { changed.push_back(key); });
+        CHECK(table.increment("a") == 4);
+        CHECK(changed == std::vector<std::string>{"a"});
+    }
+}
+
+TEST_CASE("transactions") {
+    using Tx = HashTable<std::string, int>::Transaction;
+    HashTable<std::string, int> table{4, true};
+    table.insert("a", 1);
+    table.insert("b", 2);
+
+    SUBCASE("moving a value from one key to another") {
+        auto result = table.commit(Tx{}.remove("a").insert("c", 1));
+        REQUIRE(result.has_value() == true);
+        REQUIRE(result->size() == 2);
+        CHECK(*(*result)[0] == 1);
+        CHECK((*result)[1].has_value() == false);
+
+        CHECK(table.get("a").has_value() == false);
+        CHECK(*table.get("c") == 1);
+        REQUIRE(table.size() == 2);
+    }
+    SUBCASE("operations see the effects of earlier ones") {
+        auto result = table.commit(Tx{}.assign("a", 10).get("a").remove("a").get("a").insert("a", 11));
+        REQUIRE(result.has_value() == true);
+        CHECK(*(*result)[0] == 1);
+        CHECK(*(*result)[1] == 10);
+        CHECK(*(*result)[2] == 10);
+        CHECK((*result)[3].has_value() == false);
+        CHECK(*table.get("a") == 11);
+        REQUIRE(table.size() == 2);
+    }
+    SUBCASE("failed transactions are not applied") {
+        // "b" exists already
+        CHECK(table.commit(Tx{}.remove("a").insert("b", 1)).has_value() == false);
+        // "c" is missing
+        CHECK(table.commit(Tx{}.assign("b", 3).remove("c")).has_value() == false);
+
+        CHECK(*table.get("a") == 1);
+        CHECK(*table.get("b") == 2);
+        REQUIRE(table.size() == 2);
+    }
+    SUBCASE("parallel moves between keys") {
+        // 16 tokens are moved around between 32 keys while a reader checks
+        // that none of them ever gets lost or duplicated
+        const size_t slots = 8;
+        constexpr int keys = 32;
+        constexpr int tokens = 16;
+        table.remove("a");
+        table.remove("b");
+        for(int i = 0; i < tokens; ++i) {
+            table.insert(std::to_string(i), 1);
+        }
+        std::array<std::thread, slots> threads{};
+        std::atomic<bool> done{false};
+
+        auto f = [&table](int x) {
+            for(int i = 0; i < 20000; ++i) {
+                auto from = std::to_string((x + i) % keys);
+                auto to   = std::to_string((x + 7 * i + 1) % keys);
+                if(from == to)
+                    continue;
+                table.commit(Tx{}.remove(from).insert(to, 1));
+            }
+        };
+        auto reader = [&table, &done, tokens]() {
+            Tx all{};
+            for(int i = 0; i < keys; ++i) {
+                all.get(std::to_string(i));
+            }
+            while(!done) {
+                auto result = table.commit(all);
+                REQUIRE(result.has_value() == true);
+                REQUIRE(std::count_if(result->begin(), result->end(),
+                            [](const std::optional<int>& v) { return v.has_value(); }) == tokens);
+            }
+        };
+
+        std::thread r{reader};
+        for(size_t i = 0; i < slots; ++i) {
+            threads[i] = std::thread{f, static_cast<int>(i)};
+        }
+
+        for(auto& t : threads) {
+            t.join();
+        }
+        done = true;
+        r.join();
+
+        REQUIRE(table.size() == tokens);
+    }
+}
+
+TEST_CASE("batched lookups") {
+    HashTable<std::string, std::string> table{1000, false};
+    std::vector<std::string> keys{};
+    for(int i = 0; i < 10000; ++i) {
+        // Long enough to be stored out of line
+        std::string key = "a rather long key number " + std::to_string(i);
+        if(i % 2 == 0)
+            table.insert(key, std::to_string(i));
+        keys.push_back(key);
+    }
+
+    SUBCASE("results are in the order of the keys") {
+        for(size_t width : {1, 3, 8, 16}) {
+            auto results = table.get_batch(keys, width);
+            REQUIRE(results.size() == keys.size());
+            for(size_t i = 0; i < keys.size(); ++i) {
+                REQUIRE(results[i] == table.get(keys[i]));
+            }
+        }
+        CHECK(table.get_batch({}).empty());
+        CHECK(*table.get_batch({keys[0], keys[0]}, 0)[1] == "0");
+    }
+    SUBCASE("parallel writers") {
+        std::atomic<bool> done{false};
+        std::thread writer{[&table, &keys, &done]() {
+            while(!done) {
+                for(size_t i = 1; i < keys.size(); i += 2) {
+                    table.insert(keys[i], "odd");
+                    table.remove(keys[i]);
+                }
+            }
+        }};
+
+        for(int n = 0; n < 20; ++n) {
+            auto results = table.get_batch(keys);
+            for(size_t i = 0; i < keys.size(); i += 2) {
+                REQUIRE(*results[i] == std::to_string(i));
+            }
+        }
+        done = true;
+        writer.join();
+    }
+}
+
+TEST_CASE("batched lookups of duplicate keys with SharedMutexLocks") {
+    // Lookups of the same bucket in one batch must not hold its lock at the same time
+    HashTable<int, int, SharedMutexLocks> table{16, false};
+    for(int i = 0; i < 8; ++i) {
+        table.insert(i, -i);
+    }
+    std::vector<int> keys{};
+    for(int i = 0; i < 1000; ++i) {
+        keys.push_back(i % 3);
+    }
+
+    std::atomic<bool> done{false};
+    std::thread writer{[&table, &done]() {
+        while(!done) {
+            table.insert_or_assign(1, -1);
+        }
+    }};
+    for(size_t width : {2, 8, 16}) {
+        auto results = table.get_batch(keys, width);
+        for(size_t i = 0; i < keys.size(); ++i) {
+            REQUIRE(*results[i] == -keys[i]);
+        }
+    }
+    done = true;
+    writer.join();
+}
+
+TEST_CASE("bulk loading pairs") {
+    std::vector<std::pair<int, int>> pairs{};
+    for(int i = 0; i < 100000; ++i) {
+        pairs.emplace_back(i, i);
+    }
+
+    SUBCASE("into a resizable HashTable") {
+        HashTable<int, int> table{10, true};
+        table.insert(5, -5);
+        // Duplicates within the input: the first pair wins
+        pairs.emplace_back(7, -7);
+
+        REQUIRE(table.bulk_load(pairs, false, 4) == 99999);
+        REQUIRE(table.size() == 100000);
+        CHECK(table.load_factor() < ALPHA_MAX);
+
+        // Existing entries are not overwritten
+        CHECK(*table.get(5) == -5);
+        CHECK(*table.get(7) == 7);
+        for(int i = 0; i < 100000; ++i) {
+            if(i == 5)
+                continue;
+            auto elem = table.get(i);
+            REQUIRE(elem.has_value() == true);
+            CHECK(*elem == i);
+        }
+
+        // The HashTable keeps working as usual afterwards
+        CHECK(table.insert(100000, 100000) == true);
+        CHECK(table.remove(0).has_value() == true);
+        REQUIRE(table.size() == 100000);
+    }
+    SUBCASE("trusting the input to be duplicate-free") {
+        HashTable<int, int> table{10, true};
+
+        REQUIRE(table.bulk_load(pairs, true) == 100000);
+        REQUIRE(table.size() == 100000);
+        CHECK(table.getKeys().size() == 100000);
+        CHECK(*table.get(99999) == 99999);
+    }
+    SUBCASE("into a static HashTable") {
+        HashTable<int, int> table{1000, false};
+
+        REQUIRE(table.bulk_load(pairs, false, 3) == 100000);
+        REQUIRE(table.capacity() == 1000);
+        REQUIRE(table.size() == 100000);
+        CHECK(*table.get(4242) == 4242);
+    }
+    SUBCASE("moving from an rvalue container") {
+        HashTable<std::string, std::string> table{10, true};
+        std::vector<std::pair<std::string, std::string>> strings{};
+        for(int i = 0; i < 1000; ++i) {
+            strings.emplace_back(std::to_string(i), std::string(100, 'a') + std::to_string(i));
+        }
+        const auto copied = strings;
+
+        // A container passed by reference is only copied from
+        REQUIRE(table.bulk_load(strings) == 1000);
+        CHECK(strings == copied);
+
+        HashTable<std::string, std::string> moved{10, true};
+        REQUIRE(moved.bulk_load(std::move(strings)) == 1000);
+        CHECK(*moved.get("42") == copied[42].second);
+        // The values now belong to the HashTable
+        CHECK(std::ranges::all_of(strings, [](const auto& pair) { return pair.second.empty(); }));
+    }
+}
+
+TEST_CASE("snapshots") {
+    HashTable<int, int> table{};
+    for(int i = 0; i < 100; ++i) {
+        table.insert(i, i);
+    }
+
+    // Returns the snapshot's entries sorted by key
+    auto sorted = [](const HashTable<int, int>::Snapshot& snap) {
+        auto entries = snap.getEntries();
+        std::sort(entries.begin(), entries.end());
+        return entries;
+    };
+
+    SUBCASE("modifications after the snapshot are not visible") {
+        auto snap = table.snapshot();
+        table.insert(100, 100);
+        table.remove(0);
+        table.insert_or_assign(1, -1);
+
+        REQUIRE(snap.size() == 100);
+        auto entries = sorted(snap);
+        REQUIRE(entries.size() == 100);
+        for(int i = 0; i < 100; ++i) {
+            CHECK(entries[static_cast<size_t>(i)] == std::pair{i, i});
+        }
+
+        // A later snapshot sees them
+        auto later = table.snapshot();
+        CHECK(later.size() == 100);
+        CHECK(sorted(later).front() == std::pair{1, -1});
+    }
+    SUBCASE("snapshots survive resizes and their HashTable") {
+        std::optional<HashTable<int, int>::Snapshot> snap;
+        {
+            HashTable<int, int> t{};
+            for(int i = 0; i < 10; ++i) {
+                t.insert(i, i);
+            }
+            snap = t.snapshot();
+            for(int i = 10; i < 10000; ++i) {
+                t.insert(i, i);
+            }
+            REQUIRE(t.capacity() > snap->capacity());
+            t.remove(0);
+        }
+        REQUIRE(snap->getEntries().size() == 10);
+        CHECK(sorted(*snap).back() == std::pair{9, 9});
+    }
+    SUBCASE("parallel writers and scanners") {
+        // Writers move tokens between keys in transactions, so every snapshot
+        // has to contain exactly all tokens
+        constexpr int tokens = 100;
+        std::atomic<bool> done{false};
+        std::vector<std::thread> writers{};
+        for(int t = 0; t < 4; ++t) {
+            writers.emplace_back([&table, &done, t]() {
+                std::mt19937 rng{static_cast<unsigned>(t)};
+                while(!done) {
+                    int from = static_cast<int>(rng() % 100);
+                    int to   = static_cast<int>(rng() % 200);
+                    auto value = table.get(from);
+                    if(!value || from == to)
+                        continue;
+                    HashTable<int, int>::Transaction tx{};
+                    tx.remove(from).insert(to, *value);
+                    table.commit(tx);
+                }
+            });
+        }
+
+        for(int i = 0; i < 100; ++i) {
+            auto snap = table.snapshot();
+            // Scan both halves of the buckets in parallel
+            std::atomic<size_t> count{0};
+            auto scan = [&snap, &count](size_t first, size_t last) {
+                snap.for_each([&count](const int&, const int&) { ++count; }, first, last);
+            };
+            std::thread other{scan, snap.capacity() / 2, snap.capacity()};
+            scan(0, snap.capacity() / 2);
+            other.join();
+            REQUIRE(count == tokens);
+            REQUIRE(snap.size() == tokens);
+        }
+
+        done = true;
+        for(auto& w : writers) {
+            w.join();
+        }
+        CHECK(table.size() == tokens);
+    }
+    SUBCASE("parallel exports") {
+        HashTable<int, int> big{};
+        const int n = 200000;
+        for(int i = 0; i < n; ++i) {
+            big.insert(i, 2 * i);
+        }
+        REQUIRE(big.capacity() >= 4 * EXPORT_MIN_BUCKETS);
+        auto snap = big.snapshot();
+
+        // Several threads export the same entries in the same order as one
+        auto entries = snap.getEntries(4);
+        CHECK(entries == snap.getEntries(1));
+        auto keys = big.getKeys(4);
+        auto values = big.getValues(4);
+        REQUIRE(keys.size() == static_cast<size_t>(n));
+        REQUIRE(values.size() == static_cast<size_t>(n));
+        for(size_t i = 0; i < keys.size(); ++i) {
+            REQUIRE(values[i] == 2 * keys[i]);
+            REQUIRE(entries[i] == std::pair{keys[i], values[i]});
+        }
+
+        // Every line written to a file is a whole entry
+        std::FILE* file = std::tmpfile();
+        REQUIRE(file != nullptr);
+        big.insert(n, 2 * n);
+        REQUIRE(snap.write(fileno(file), " ", 4));
+        std::rewind(file);
+        std::vector<bool> seen(n, false);
+        int key = 0;
+        int value = 0;
+        while(std::fscanf(file, "%d %d\n", &key, &value) == 2) {
+            REQUIRE(key < n);
+            REQUIRE(value == 2 * key);
+            REQUIRE_FALSE(seen[static_cast<size_t>(key)]);
+            seen[static_cast<size_t>(key)] = true;
+        }
+        std::fclose(file);
+        CHECK(std::count(seen.begin(), seen.end(), true) == n);
+    }
+}
+
+/**
+ * Lets 4 threads append to a MutationLog of records `R{writer, i, ...}` and
+ * checks that a consumer reading through a const reference sees every
+ * writer's records in order and never a partially written one.
+ */
+template <typename R>
+void parallelMutationLog() {
+    constexpr int writers = 4;
+    constexpr int records = 100000;
+    MutationLog<R, 1024> log{};
+    const auto& reader = log;
+
+    std::vector<std::thread> threads{};
+    for(int t = 0; t < writers; ++t) {
+        threads.emplace_back([&log, t]() {
+            for(int i = 0; i < records; ++i) {
+                R record{};
+                record.first = t;
+                record.second = i;
+                if constexpr(requires { record.copies; })
+                    record.copies.fill(i);
+                log.append(record);
+            }
+        });
+    }
+
+    // Records of the same writer arrive in order, possibly with gaps
+    std::array<int, writers> last{-1, -1, -1, -1};
+    LogCursor cursor{};
+    uint64_t read = 0;
+    bool ordered = true;
+    bool complete = true;
+    while(cursor.next < static_cast<uint64_t>(writers * records)) {
+        read += reader.read(cursor, [&](const R& r) {
+            ordered = ordered && r.second > last[static_cast<size_t>(r.first)];
+            last[static_cast<size_t>(r.first)] = r.second;
+            if constexpr(requires { r.copies; })
+                complete = complete && std::ranges::count(r.copies, r.second) == 6;
+        });
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+
+    CHECK(ordered);
+    CHECK(complete);
+    CHECK(read + cursor.dropped == static_cast<uint64_t>(writers * records));
+}
+
+TEST_CASE("mutation log") {
+    SUBCASE("recording changes of a HashTable") {
+        HashTable<int, int> table{};
+        table.insert(0, 0);
+        REQUIRE(table.mutationLog() == nullptr);
+
+        auto& log = table.enableMutationLog();
+        REQUIRE(table.mutationLog() == &log);
+        auto cursor = log.tail();
+
+        table.insert(1, 1);
+        table.insert(1, 2);
+        table.insert_or_assign(1, 3);
+        table.increment(2);
+        table.remove(0);
+        table.remove(0);
+
+        std::vector<Mutation<int, int>> records{};
+        REQUIRE(log.read(cursor, [&records](const Mutation<int, int>& m) { records.push_back(m); }) == 4);
+        CHECK(records[0].op == Mutation<int, int>::INSERT);
+        CHECK(records[0].key == 1);
+        CHECK(*records[0].value == 1);
+        CHECK(records[1].op == Mutation<int, int>::ASSIGN);
+        CHECK(*records[1].value == 3);
+        CHECK(records[2].op == Mutation<int, int>::INSERT);
+        CHECK(records[2].key == 2);
+        CHECK(records[3].op == Mutation<int, int>::REMOVE);
+        CHECK(records[3].key == 0);
+        CHECK(records[3].value.has_value() == false);
+
+        // Nothing new
+        CHECK(log.read(cursor, [](const Mutation<int, int>&) { }) == 0);
+        CHECK(cursor.dropped == 0);
+    }
+    SUBCASE("slow consumers skip overwritten records") {
+        MutationLog<int, 8> log{};
+        LogCursor cursor{};
+        for(int i = 0; i < 20; ++i) {
+            log.append(i);
+        }
+
+        std::vector<int> records{};
+        log.read(cursor, [&records](const int& i) { records.push_back(i); });
+        REQUIRE(records.size() == 8);
+        CHECK(records.front() == 12);
+        CHECK(records.back() == 19);
+        CHECK(cursor.dropped == 12);
+        CHECK(cursor.next == 20);
+    }
+    SUBCASE("parallel writers and a consumer") {
+        // A record which isn't trivially copyable, read through a shared reference
+        parallelMutationLog<std::pair<int, int>>();
+    }
+    SUBCASE("a slow consumer doesn't block writers") {
+        MutationLog<std::string, 4> slow{};
+        slow.append("first");
+        LogCursor cursor{};
+        std::string seen{};
+        CHECK(slow.read(cursor, [&slow, &seen](const std::string& record) {
+            // Overwrite the whole ring, including this record, while it's being read
+            std::thread writer([&slow]() {
+                for(int i = 0; i < 8; ++i) {
+                    slow.append(std::to_string(i));
+                }
+            });
+            writer.join();
+            seen = record;
+        }, 1) == 1);
+        CHECK(seen == "first");
+
+        std::vector<std::string> records{};
+        slow.read(cursor, [&records](const std::string& record) { records.push_back(record); });
+        CHECK(records == std::vector<std::string>{"4", "5", "6", "7"});
+        CHECK(cursor.dropped == 4);
+    }
+    SUBCASE("parallel writers and a lock-free consumer") {
+        // A record consisting of several words, which a torn read would mix up
+        struct Record {
+            int first;
+            int second;
+            std::array<int, 6> copies;
+        };
+        static_assert(std::is_trivially_copyable_v<Record>);
+        parallelMutationLog<Record>();
+    }
+}
+
+TEST_CASE("change hook") {
+    HashTable<int, int> table{};
+    table.insert(0, 0);
+
+    std::vector<int> changed{};
+    table.enableChangeHook([&changed](const int& key) { changed.push_back(key); });
+    // Only the first hook is installed
+    table.enableChangeHook([](const int&) { FAIL("replaced the first hook"); });
+
+    table.insert(1, 1);
+    table.insert(1, 2);
+    table.insert_or_assign(1, 3);
+    // Assigning the same value again isn't a change
+    table.insert_or_assign(1, 3);
+    table.remove(0);
+    table.remove(0);
+    // Every change is reported, even more than a MutationLog would keep
+    for(int i = 2; i < MUTATION_LOG_SIZE + 2; ++i) {
+        table.insert(i, i);
+    }
+
+    // Failed insertions, removals and repeated assignments don't change anything
+    REQUIRE(changed.size() == static_cast<size_t>(MUTATION_LOG_SIZE + 3));
+    CHECK(changed[0] == 1);
+    CHECK(changed[1] == 1);
+    CHECK(changed[2] == 0);
+    CHECK(changed.back() == MUTATION_LOG_SIZE + 1);
+}
+
+TEST_CASE_TEMPLATE("stress tests (dynamic)", Locks, AdaptiveLocks, SharedMutexLocks, SpinLocks, ProcessSharedLocks) {
     const size_t slots = 12;
-    HashTable<int, int> table{slots * 1000000, true};
+    HashTable<int, int, Locks> table{slots * 1000000, true};
 
     SUBCASE("parallel access with different keys/values for each thread (dynamic)") {
         std::cout << "Running stress tests: Parallel access with different keys/values (dynamic)" << std::endl;
@@ -236,9 +1782,9 @@ TEST_CASE("stress tests (dynamic)") {
     }
 }
 
-TEST_CASE("stress tests (static)") {
+TEST_CASE_TEMPLATE("stress tests (static)", Locks, AdaptiveLocks, SharedMutexLocks, SpinLocks, ProcessSharedLocks) {
     const size_t slots = 12;
-    HashTable<int, int> table{slots * 1000000, false};
+    HashTable<int, int, Locks> table{slots * 1000000, false};
 
     SUBCASE("parallel access with different keys/values for each thread (static)") {
         std::cout << "Running stress tests: Parallel access with different keys/values (static)" << std::endl;
@@ -424,6 +1970,182 @@ TEST_CASE("parallel insertions via the subscript operator (static)") {
     REQUIRE(table.size() == 0);
 }
 
+// Buckets are stored inline, so this one lives in static storage
+static StaticHashTable<int, int, 1 << 16> static_table{};
+
+TEST_CASE("StaticHashTable") {
+    StaticHashTable<std::string, int, 7> table{};
+
+    static_assert(StaticHashTable<std::string, int, 7>::capacity() == 7);
+    REQUIRE(table.isResizable() == false);
+    REQUIRE(table.size() == 0);
+
+    SUBCASE("inserting, getting and removing elements") {
+        for(int i = 0; i < 20; ++i) {
+            REQUIRE(table.insert(std::to_string(i), i) == true);
+        }
+        REQUIRE(table.size() == 20);
+        CHECK(table.load_factor() == doctest::Approx(20.0 / 7.0));
+
+        // No duplicates
+        REQUIRE(table.insert("3", 4) == false);
+        auto elem = table.get("3");
+        REQUIRE(elem.has_value() == true);
+        CHECK(*elem == 3);
+
+        elem = table.remove("3");
+        REQUIRE(elem.has_value() == true);
+        CHECK(*elem == 3);
+        REQUIRE(table.size() == 19);
+        CHECK(table.get("3").has_value() == false);
+        CHECK(table.remove("3").has_value() == false);
+
+        CHECK(table.getKeys().size() == 19);
+        CHECK(table.getValues().size() == 19);
+        size_t total = 0;
+        for(size_t i = 0; i < table.capacity(); ++i) {
+            total += table.getBucket(i).size();
+        }
+        CHECK(total == 19);
+    }
+    SUBCASE("parallel access with different keys/values for each thread") {
+        const size_t slots = 8;
+        std::array<std::thread, slots> threads{};
+
+        auto f = [](int x) {
+            for(int i = 1 + 100000 * x; i <= 100000 + 100000 * x; ++i) {
+                CHECK(static_table.insert(i, i) == true);
+                CHECK(static_table.insert(i, i) == false);
+                auto getRes = static_table.get(i);
+                REQUIRE(getRes.has_value() == true);
+                CHECK(*getRes == i);
+                auto remRes = static_table.remove(i);
+                REQUIRE(remRes.has_value() == true);
+                REQUIRE(static_table.get(i).has_value() == false);
+            }
+        };
+
+        for(size_t i = 0; i < slots; ++i) {
+            threads[i] = std::thread{f, i};
+        }
+
+        for(auto& t : threads) {
+            t.join();
+        }
+
+        REQUIRE(static_table.size() == 0);
+    }
+    SUBCASE("operations which block the whole table") {
+        std::vector<std::pair<std::string, int>> pairs{};
+        for(int i = 0; i < 100; ++i) {
+            pairs.emplace_back(std::to_string(i), i % 10);
+        }
+        REQUIRE(table.bulk_load(pairs) == 100);
+        REQUIRE(table.capacity() == 7);
+
+        // Taking a snapshot locks every bucket instead of a global lock
+        auto snapshot = table.snapshot();
+        REQUIRE(table.remove("42").has_value() == true);
+        CHECK(snapshot.size() == 100);
+        CHECK(snapshot.getEntries().size() == 100);
+        CHECK(table.size() == 99);
+
+        table.enableReverseIndex();
+        CHECK(table.keysOf(2).size() == 9);
+    }
+}
+
+TEST_CASE_TEMPLATE("searching integers with simd_find()", T, uint8_t, int16_t, int32_t, uint64_t) {
+    std::vector<T> keys{};
+    for(size_t i = 0; i < 70; ++i) {
+        keys.push_back(static_cast<T>(3 * i + 1));
+    }
+
+    for(size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(simd_find(keys.data(), keys.size(), keys[i]) == i);
+    }
+    CHECK(simd_find(keys.data(), keys.size(), static_cast<T>(0)) == keys.size());
+    CHECK(simd_find(keys.data(), static_cast<size_t>(0), keys[0]) == 0);
+    // Only the first n integers are searched
+    CHECK(simd_find(keys.data(), static_cast<size_t>(5), keys[5]) == 5);
+}
+
+TEST_CASE("IntHashTable") {
+    static_assert(SimdKeysHasher<IntegerHash<uint64_t>, uint64_t>);
+    static_assert(!SimdKeysHasher<std::hash<uint64_t>, uint64_t>);
+    IntHashTable<uint64_t, std::string> table{10, true};
+
+    REQUIRE(table.size() == 0);
+    REQUIRE(table.capacity() == 10);
+
+    for(uint64_t i = 0; i < 1000; ++i) {
+        REQUIRE(table.insert(i, std::to_string(i)) == true);
+    }
+    REQUIRE(table.size() == 1000);
+    CHECK(table.capacity() > 1000);
+    CHECK(table.load_factor() < ALPHA_MAX);
+
+    // No duplicates
+    REQUIRE(table.insert(42, "43") == false);
+
+    for(uint64_t i = 0; i < 1000; ++i) {
+        auto elem = table.get(i);
+        REQUIRE(elem.has_value() == true);
+        CHECK(*elem == std::to_string(i));
+    }
+    CHECK(table.get(1000).has_value() == false);
+    CHECK(table.getKeys().size() == 1000);
+    CHECK(table.getValues().size() == 1000);
+
+    for(uint64_t i = 0; i < 995; ++i) {
+        auto elem = table.remove(i);
+        REQUIRE(elem.has_value() == true);
+        CHECK(*elem == std::to_string(i));
+    }
+    CHECK(table.remove(0).has_value() == false);
+    REQUIRE(table.size() == 5);
+    CHECK(table.load_factor() > ALPHA_MIN);
+
+    size_t total = 0;
+    for(size_t i = 0; i < table.capacity(); ++i) {
+        for(auto& [k, v] : table.getBucket(i)) {
+            CHECK(v == std::to_string(k));
+            ++total;
+        }
+    }
+    CHECK(total == 5);
+
+    SUBCASE("parallel access with different keys/values for each thread") {
+        const size_t slots = 8;
+        IntHashTable<int64_t, int64_t> ptable{16, true};
+        std::array<std::thread, slots> threads{};
+
+        auto f = [&ptable](int64_t x) {
+            for(int64_t i = 1 + 100000 * x; i <= 100000 + 100000 * x; ++i) {
+                CHECK(ptable.insert(i, i) == true);
+                CHECK(ptable.insert(i, i) == false);
+                auto getRes = ptable.get(i);
+                REQUIRE(getRes.has_value() == true);
+                CHECK(*getRes == i);
+            }
+            for(int64_t i = 1 + 100000 * x; i <= 100000 + 100000 * x; ++i) {
+                REQUIRE(ptable.remove(i).has_value() == true);
+                REQUIRE(ptable.get(i).has_value() == false);
+            }
+        };
+
+        for(size_t i = 0; i < slots; ++i) {
+            threads[i] = std::thread{f, static_cast<int64_t>(i)};
+        }
+
+        for(auto& t : threads) {
+            t.join();
+        }
+
+        REQUIRE(ptable.size() == 0);
+    }
+}
+
 TEST_CASE("Add elements to the CircularBuffer") {
     CircularBuffer<int, 5> cb{};
 
@@ -501,6 +2223,24 @@ TEST_CASE("Remove elements from the CircularBuffer") {
         REQUIRE(cb.size() == 0);
         REQUIRE(cb.capacity() == 5);
     }
+    SUBCASE("Remove without blocking") {
+        REQUIRE(cb.try_pop().has_value() == false);
+        cb.push_back(2);
+        cb.push_back(3);
+
+        auto elem = cb.try_pop();
+        REQUIRE(elem.has_value() == true);
+        CHECK((*elem).first == 2);
+        CHECK((*elem).second == 0);
+        elem = cb.try_pop();
+        CHECK((*elem).first == 3);
+        REQUIRE(cb.try_pop().has_value() == false);
+        REQUIRE(cb.size() == 0);
+
+        // The freed slots can be reused
+        REQUIRE(cb.push_back(4) == 2);
+        CHECK((*cb.pop()).first == 4);
+    }
 }
 
 TEST_CASE("Add and remove elements to/from the CircularBuffer") {
@@ -525,3 +2265,68 @@ TEST_CASE("Add and remove elements to/from the CircularBuffer") {
 
     cb.printBuffer();
 }
+
+TEST_CASE("Several producers and consumers on the CircularBuffer") {
+    CircularBuffer<int, 5> cb{};
+
+    SUBCASE("Waiting while empty or full") {
+        REQUIRE(cb.pop(std::chrono::milliseconds(10)).has_value() == false);
+        for(int i = 0; i < 5; ++i) {
+            CHECK(cb.push_back(i, std::chrono::milliseconds(10)) == i);
+        }
+        REQUIRE(cb.push_back(5, std::chrono::milliseconds(10)) == -1);
+
+        // A consumer frees a slot while the producer sleeps
+        std::thread consumer{[&cb]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            CHECK((*cb.pop()).first == 0);
+        }};
+        CHECK(cb.push_back(5, std::chrono::milliseconds(10000)) == 0);
+        consumer.join();
+        REQUIRE(cb.isFull() == true);
+
+        for(int i = 1; i <= 5; ++i) {
+            CHECK((*cb.pop(std::chrono::milliseconds(10))).first == i);
+        }
+        // And a producer fills one while the consumer sleeps
+        std::thread producer{[&cb]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            CHECK(cb.push_back(6) != -1);
+        }};
+        auto elem = cb.pop(std::chrono::milliseconds(10000));
+        producer.join();
+        REQUIRE(elem.has_value() == true);
+        CHECK((*elem).first == 6);
+        REQUIRE(cb.isEmpty() == true);
+    }
+    SUBCASE("Every element is popped exactly once") {
+        const int threads = 4;
+        const int n = 20000;
+        std::vector<std::atomic<int>> seen(threads * n);
+        std::atomic<int> popped{0};
+
+        std::vector<std::thread> workers{};
+        for(int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t]() {
+                for(int i = 0; i < n; ++i) {
+                    while(cb.push_back(t * n + i, std::chrono::milliseconds(100)) == -1) { }
+                }
+            });
+            workers.emplace_back([&]() {
+                while(popped < threads * n) {
+                    if(auto elem = cb.pop(std::chrono::milliseconds(10))) {
+                        seen[static_cast<size_t>(elem->first)]++;
+                        popped++;
+                    }
+                }
+            });
+        }
+        for(auto& w : workers) {
+            w.join();
+        }
+
+        REQUIRE(popped == threads * n);
+        CHECK(std::all_of(seen.begin(), seen.end(), [](const auto& count) { return count == 1; }));
+        REQUIRE(cb.isEmpty() == true);
+    }
+}
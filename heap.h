@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <unistd.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+/**
+ * Returns the process' resident set size, i.e. the memory it actually occupies.
+ *
+ * @returns the resident set size in bytes, 0 if it is unknown
+ */
+inline size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    if(!(statm >> pages >> resident))
+        return 0;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+/**
+ * Hands the free memory of the heap back to the OS. glibc only returns the
+ * top of the heap on its own, malloc_trim() additionally releases every free
+ * page in between with madvise(MADV_DONTNEED).
+ * Elsewhere, freed memory is left to the allocator.
+ */
+inline void releaseFreeMemory() {
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+}
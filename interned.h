@@ -0,0 +1,194 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+// Number of independently locked shards of an InternPool
+#define INTERN_POOL_SHARDS 16
+
+template <typename V>
+concept Internable = std::equality_comparable<V> && std::copy_constructible<V> && requires(const V& v) {
+    { std::hash<V>{}(v) } -> std::convertible_to<std::size_t>;
+};
+
+template <typename V> requires Internable<V>
+class Interned;
+
+/**
+ * The distinct values referenced by Interned handles, each stored once along
+ * with its reference count.
+ * Values are spread over INTERN_POOL_SHARDS shards by their hash, each guarded
+ * by its own mutex, so writers only contend when interning values of the same
+ * shard. A value is freed as soon as its last handle is destroyed.
+ */
+template <typename V> requires Internable<V>
+class InternPool {
+    public:
+        InternPool(const InternPool&) = delete;
+        InternPool& operator=(const InternPool&) = delete;
+
+        /**
+         * Returns the pool shared by all Interned<V> handles.
+         * It is never destroyed, so handles in static objects can still be
+         * released at exit.
+         *
+         * @returns the pool
+         */
+        static InternPool& global() {
+            static InternPool* pool = new InternPool{};
+            return *pool;
+        }
+
+        /**
+         * Returns the number of distinct values currently referenced.
+         *
+         * @returns the number of values in the pool
+         */
+        size_t size() const {
+            size_t size = 0;
+            for(auto& shard : _shards) {
+                std::scoped_lock lock(shard.mutex);
+                size += shard.values.size();
+            }
+            return size;
+        }
+
+    private:
+        friend class Interned<V>;
+
+        struct Entry {
+            std::atomic<size_t> refs{0};
+            size_t shard{0};
+        };
+        using Node = std::pair<const V, Entry>;
+
+        struct Shard {
+            mutable std::mutex mutex;
+            std::unordered_map<V, Entry> values;
+        };
+
+        InternPool() = default;
+
+        // Returns the pool's copy of `value` with an additional reference
+        Node* acquire(V value) {
+            size_t shard = std::hash<V>{}(value) % INTERN_POOL_SHARDS;
+            auto& s = _shards[shard];
+
+            std::scoped_lock lock(s.mutex);
+            auto [it, inserted] = s.values.try_emplace(std::move(value));
+            if(inserted)
+                it->second.shard = shard;
+            it->second.refs.fetch_add(1, std::memory_order_relaxed);
+            return &*it;
+        }
+
+        // Drops a reference. Only the last one is dropped under the shard's lock,
+        // so acquire() can never find a value which is being freed.
+        void release(Node* node) {
+            auto& refs = node->second.refs;
+            size_t r = refs.load(std::memory_order_relaxed);
+            while(r > 1) {
+                if(refs.compare_exchange_weak(r, r - 1, std::memory_order_release, std::memory_order_relaxed))
+                    return;
+            }
+
+            auto& s = _shards[node->second.shard];
+            std::scoped_lock lock(s.mutex);
+            // acquire() may have added a reference in the meantime
+            if(refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                s.values.erase(node->first);
+        }
+
+        std::array<Shard, INTERN_POOL_SHARDS> _shards{};
+};
+
+/**
+ * A handle to a value stored once in the InternPool, e.g. as the value type of
+ * HashTable<K, Interned<V>>. Entries with equal values share a single copy
+ * instead of each holding their own, which saves memory if values repeat.
+ * Copying a handle only increments the value's reference count, comparing two
+ * handles only compares their pointers.
+ * Interning a value (i.e. constructing a handle from it) locks a shard of the pool.
+ */
+template <typename V> requires Internable<V>
+class Interned {
+    public:
+        // A handle to V{}, which does not occupy the pool
+        Interned() = default;
+
+        Interned(V value) : _node(value == V{} ? nullptr : InternPool<V>::global().acquire(std::move(value))) { }
+
+        Interned(const Interned& other) : _node(other._node) {
+            if(_node)
+                _node->second.refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        Interned(Interned&& other) noexcept : _node(std::exchange(other._node, nullptr)) { }
+
+        Interned& operator=(Interned other) noexcept {
+            std::swap(_node, other._node);
+            return *this;
+        }
+
+        ~Interned() {
+            if(_node)
+                InternPool<V>::global().release(_node);
+        }
+
+        const V& get() const {
+            static const V empty{};
+            return _node ? _node->first : empty;
+        }
+
+        const V& operator*() const {
+            return get();
+        }
+
+        const V* operator->() const {
+            return &get();
+        }
+
+        explicit operator std::string_view() const requires std::constructible_from<std::string_view, const V&> {
+            return std::string_view{get()};
+        }
+
+        /**
+         * Returns the number of handles sharing the value, 0 for V{}.
+         *
+         * @returns the value's reference count
+         */
+        size_t use_count() const {
+            return _node ? _node->second.refs.load(std::memory_order_relaxed) : 0;
+        }
+
+        bool operator==(const Interned& other) const {
+            // Equal values share their node, V{} is never stored in the pool
+            return _node == other._node;
+        }
+
+        size_t hash() const {
+            return std::hash<const void*>{}(_node);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const Interned& value) {
+            return os << value.get();
+        }
+
+    private:
+        typename InternPool<V>::Node* _node{nullptr};
+};
+
+template <typename V>
+struct std::hash<Interned<V>> {
+    size_t operator()(const Interned<V>& value) const noexcept {
+        return value.hash();
+    }
+};
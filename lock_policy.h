@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <cstdint>
+#include <shared_mutex>
+#include <thread>
+
+#include "bucket_lock.h"
+#include "mutex.h"
+
+/**
+ * A reader/writer spinlock. Like BucketLock, it takes 4 bytes which are all
+ * zero while it is unlocked, but blocked threads never sleep. They only yield
+ * every LOCK_SPIN_LIMIT checks, in case the holder isn't running. A waiting
+ * writer keeps new readers out.
+ */
+class SpinLock {
+    public:
+        constexpr SpinLock() = default;
+        SpinLock(const SpinLock&) = delete;
+        SpinLock& operator=(const SpinLock&) = delete;
+
+        void lock() {
+            size_t spins = 0;
+            uint32_t state = _state.load(std::memory_order_relaxed);
+            while(true) {
+                if((state & ~WAITING) == 0) {
+                    if(_state.compare_exchange_weak(state, WRITER, std::memory_order_acquire, std::memory_order_relaxed))
+                        return;
+                    continue;
+                }
+                if(!(state & WAITING))
+                    _state.fetch_or(WAITING, std::memory_order_relaxed);
+                backoff(spins);
+                state = _state.load(std::memory_order_relaxed);
+            }
+        }
+
+        bool try_lock() {
+            uint32_t state = _state.load(std::memory_order_relaxed);
+            return (state & ~WAITING) == 0
+                && _state.compare_exchange_strong(state, WRITER, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        void unlock() {
+            _state.store(0, std::memory_order_release);
+        }
+
+        void lock_shared() {
+            size_t spins = 0;
+            uint32_t state = _state.load(std::memory_order_relaxed);
+            while(true) {
+                if(!(state & (WRITER | WAITING))) {
+                    if(_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                        return;
+                    continue;
+                }
+                backoff(spins);
+                state = _state.load(std::memory_order_relaxed);
+            }
+        }
+
+        bool try_lock_shared() {
+            uint32_t state = _state.load(std::memory_order_relaxed);
+            while(!(state & (WRITER | WAITING))) {
+                if(_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                    return true;
+            }
+            return false;
+        }
+
+        void unlock_shared() {
+            _state.fetch_sub(1, std::memory_order_release);
+        }
+
+    private:
+        static constexpr uint32_t WRITER  = 1u << 31;
+        static constexpr uint32_t WAITING = 1u << 30;
+
+        static void backoff(size_t& spins) {
+            if(++spins % LOCK_SPIN_LIMIT == 0)
+                std::this_thread::yield();
+            else
+                cpu_relax();
+        }
+
+        // WRITER if a writer holds the lock, otherwise the number of readers,
+        // plus WAITING if a writer waits for it
+        std::atomic<uint32_t> _state{0};
+};
+
+/**
+ * A lock which doesn't lock at all, for data only one thread ever uses.
+ * It is empty, so with [[no_unique_address]] it takes no space either.
+ */
+struct NullLock {
+    void lock() { }
+    bool try_lock() { return true; }
+    void unlock() { }
+    void lock_shared() { }
+    bool try_lock_shared() { return true; }
+    void unlock_shared() { }
+};
+
+/**
+ * The locks of a HashTable: `Global` for the whole table, `Bucket` for each
+ * bucket. Both are used with std::unique_lock and std::shared_lock.
+ * `zeroInitialized` tells whether an all-zero `Bucket` is unlocked, which
+ * lets the bucket array skip constructing its buckets (see BucketArray).
+ * `threadSafe` is false if the table may only be used by one thread at a
+ * time, which rules out background maintenance.
+ */
+template <typename P>
+concept LockPolicy = requires {
+    typename P::Global;
+    typename P::Bucket;
+    { P::zeroInitialized } -> std::convertible_to<bool>;
+    { P::threadSafe } -> std::convertible_to<bool>;
+};
+
+/**
+ * The default: std::shared_mutex for the table and a 4-byte BucketLock,
+ * which adapts to contention, per bucket.
+ */
+struct AdaptiveLocks {
+    using Global = std::shared_mutex;
+    using Bucket = BucketLock;
+    static constexpr bool zeroInitialized = true;
+    static constexpr bool threadSafe = true;
+};
+
+/**
+ * std::shared_mutex for the table and every bucket.
+ * Every bucket takes 56 bytes more and has to be constructed.
+ */
+struct SharedMutexLocks {
+    using Global = std::shared_mutex;
+    using Bucket = std::shared_mutex;
+    static constexpr bool zeroInitialized = false;
+    static constexpr bool threadSafe = true;
+};
+
+/**
+ * SpinLocks for the table and every bucket, for short critical sections
+ * with at most one thread per core.
+ */
+struct SpinLocks {
+    using Global = SpinLock;
+    using Bucket = SpinLock;
+    static constexpr bool zeroInitialized = true;
+    static constexpr bool threadSafe = true;
+};
+
+/**
+ * Process-shared pthread_rwlocks (PRWLock) for the table and every bucket.
+ * Unlike std::shared_mutex, they keep working if the table is placed in
+ * memory shared between processes, although the bucket array and the entries
+ * are still private to the process for now. Requires linking mutex.o.
+ */
+struct ProcessSharedLocks {
+    using Global = PRWLock;
+    using Bucket = PRWLock;
+    static constexpr bool zeroInitialized = false;
+    static constexpr bool threadSafe = true;
+};
+
+/**
+ * No locking at all, for tables confined to a single thread, e.g. one
+ * partition per worker. All locking compiles away and buckets get smaller.
+ */
+struct NullLocks {
+    using Global = NullLock;
+    using Bucket = NullLock;
+    static constexpr bool zeroInitialized = true;
+    static constexpr bool threadSafe = false;
+};
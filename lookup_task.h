@@ -0,0 +1,107 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * A minimal coroutine type for interleaving lookups, see HashTable::get_batch().
+ * A LookupTask starts suspended and is resumed by its owner until done().
+ * Since a batch creates one coroutine per key, the frames are recycled per
+ * thread instead of going through the allocator each time.
+ */
+class LookupTask {
+    public:
+        struct promise_type {
+            LookupTask get_return_object() {
+                return LookupTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() { }
+            void unhandled_exception() {
+                exception = std::current_exception();
+            }
+
+            static void* operator new(size_t size) {
+                auto& pool = framePool();
+                if(size == pool.size && !pool.frames.empty()) {
+                    void* frame = pool.frames.back();
+                    pool.frames.pop_back();
+                    return frame;
+                }
+                return ::operator new(size);
+            }
+
+            static void operator delete(void* frame, size_t size) {
+                auto& pool = framePool();
+                if(pool.size == 0)
+                    pool.size = size;
+                if(size == pool.size && pool.frames.size() < 64) {
+                    pool.frames.push_back(frame);
+                    return;
+                }
+                ::operator delete(frame);
+            }
+
+            std::exception_ptr exception;
+        };
+
+        LookupTask(LookupTask&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) { }
+
+        LookupTask& operator=(LookupTask&& other) noexcept {
+            if(this != &other) {
+                if(_handle)
+                    _handle.destroy();
+                _handle = std::exchange(other._handle, nullptr);
+            }
+            return *this;
+        }
+
+        ~LookupTask() {
+            if(_handle)
+                _handle.destroy();
+        }
+
+        /**
+         * Runs the coroutine until its next suspension point.
+         * Rethrows an exception which escaped the coroutine.
+         */
+        void resume() {
+            _handle.resume();
+            if(_handle.done() && _handle.promise().exception)
+                std::rethrow_exception(_handle.promise().exception);
+        }
+
+        /**
+         * @returns whether the coroutine ran to completion
+         */
+        bool done() const {
+            return _handle.done();
+        }
+
+    private:
+        // Frames of a single size, which is the size of the first freed frame
+        struct FramePool {
+            size_t size{0};
+            std::vector<void*> frames{};
+
+            ~FramePool() {
+                for(void* frame : frames) {
+                    ::operator delete(frame);
+                }
+            }
+        };
+
+        static FramePool& framePool() {
+            thread_local FramePool pool{};
+            return pool;
+        }
+
+        explicit LookupTask(std::coroutine_handle<promise_type> handle) : _handle(handle) { }
+
+        std::coroutine_handle<promise_type> _handle;
+};
@@ -2,14 +2,20 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <algorithm>
 #include <array>
 #include <atomic>
+#include <optional>
 #include <pthread.h>
 #include <queue>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "circular_buffer.h"
+#include "mutation_log.h"
 #include "mutex.h"
 
 // The maximum allowed lengths of keys and values
@@ -18,6 +24,16 @@
 
 constexpr const size_t slots = 8;
 
+// The number of changes kept in the change feed, see SUBSCRIBE
+#define CHANGE_FEED_SLOTS 1024
+// The name of the change feed's shared memory object
+#define CHANGE_FEED_NAME "/shm_ipc_changes"
+
+// The maximum number of distinct keys watched at once, see WATCH
+#define WATCH_SLOTS 4096
+// The name of the watch table's shared memory object
+#define WATCH_TABLE_NAME "/shm_ipc_watches"
+
 
 /**
  * A struct representing a single message which can be written by
@@ -38,7 +54,12 @@ typedef struct Message {
         CLOSE_SHM, // Signals the server to close a shared memory segment opened by READ_BUCKET
         DELETE,
         RESPONSE,
-        EXIT // Signals the reading thread to exit and is pushed by the server when a SIGINT occurs
+        EXIT, // Signals the reading thread to exit and is pushed by the server when a SIGINT occurs
+        MULTI, // A batch of GET, INSERT and DELETE operations executed atomically, see encodeMulti()
+        SUBSCRIBE, // Asks the server for its change feed, see ChangeFeed
+        GET_KEYS_BY_VALUE, // Looks up all keys mapped to the value in data, see encodeKeys()
+        WATCH, // Asks the server for a word in shared memory which changes along with the key, see WatchTable
+        ERASE_IF // Removes all keys matching the glob pattern in key in one sweep, see HashTable::erase_if()
     }; //mode;
 
     mode_t mode;
@@ -105,6 +126,221 @@ typedef struct Message {
     }
 } Message;
 
+/**
+ * A single operation of a MULTI request.
+ */
+struct MultiOp {
+    Message::mode_t mode; // GET, INSERT or DELETE
+    std::string key;
+    std::string value;    // Only used by INSERT
+};
+
+/**
+ * Encodes the operations of a MULTI request into a Message's data field:
+ *   number of operations (1 byte)
+ *   per operation: mode (1 byte) | key length (1 byte) | key | value length (2 bytes) | value
+ *
+ * @param ops the operations
+ * @param data the Message's data field
+ * @returns false if the operations do not fit into the data field
+ */
+inline bool encodeMulti(const std::vector<MultiOp>& ops, std::array<uint8_t, MAX_LENGTH_VAL>& data) {
+    if(ops.size() > UINT8_MAX)
+        return false;
+
+    size_t pos = 0;
+    data[pos++] = static_cast<uint8_t>(ops.size());
+    for(auto& op : ops) {
+        if(op.key.length() > MAX_LENGTH_KEY || op.value.length() > MAX_LENGTH_VAL)
+            return false;
+        if(pos + 4 + op.key.length() + op.value.length() > data.size())
+            return false;
+
+        data[pos++] = static_cast<uint8_t>(op.mode);
+        data[pos++] = static_cast<uint8_t>(op.key.length());
+        memcpy(data.data() + pos, op.key.data(), op.key.length());
+        pos += op.key.length();
+        data[pos++] = static_cast<uint8_t>(op.value.length() & 0xff);
+        data[pos++] = static_cast<uint8_t>(op.value.length() >> 8);
+        memcpy(data.data() + pos, op.value.data(), op.value.length());
+        pos += op.value.length();
+    }
+    return true;
+}
+
+/**
+ * Decodes the operations of a MULTI request, see encodeMulti().
+ *
+ * @param data the Message's data field
+ * @returns the operations or std::nullopt if the data field is malformed
+ */
+inline std::optional<std::vector<MultiOp>> decodeMulti(const std::array<uint8_t, MAX_LENGTH_VAL>& data) {
+    std::vector<MultiOp> ops{};
+
+    size_t pos = 0;
+    size_t n = data[pos++];
+    for(size_t i = 0; i < n; ++i) {
+        if(pos + 2 > data.size())
+            return std::nullopt;
+        MultiOp op{};
+        op.mode = static_cast<Message::mode_t>(data[pos++]);
+        size_t keyLength = data[pos++];
+        if(pos + keyLength + 2 > data.size())
+            return std::nullopt;
+        op.key.assign(reinterpret_cast<const char*>(data.data() + pos), keyLength);
+        pos += keyLength;
+        size_t valueLength = static_cast<size_t>(data[pos]) | (static_cast<size_t>(data[pos + 1]) << 8);
+        pos += 2;
+        if(pos + valueLength > data.size())
+            return std::nullopt;
+        op.value.assign(reinterpret_cast<const char*>(data.data() + pos), valueLength);
+        pos += valueLength;
+
+        if(op.mode != Message::GET && op.mode != Message::INSERT && op.mode != Message::DELETE)
+            return std::nullopt;
+        ops.push_back(std::move(op));
+    }
+    return std::make_optional(std::move(ops));
+}
+
+/**
+ * Encodes the results of a MULTI request into the response's data field:
+ *   number of results (1 byte)
+ *   per result: found (1 byte) | value length (2 bytes) | value
+ * Values which do not fit into the data field anymore are truncated to length 0.
+ *
+ * @param results one optional value per operation, e.g. std::string or FixedValue
+ * @param data the response's data field
+ */
+template <typename V>
+void encodeMultiResults(const std::vector<std::optional<V>>& results, std::array<uint8_t, MAX_LENGTH_VAL>& data) {
+    size_t pos = 0;
+    data[pos++] = static_cast<uint8_t>(results.size());
+    for(auto& result : results) {
+        if(pos + 3 > data.size())
+            break;
+        std::string_view value = result ? std::string_view{*result} : std::string_view{};
+        size_t length = value.size();
+        if(pos + 3 + length > data.size())
+            length = 0;
+        data[pos++] = result.has_value();
+        data[pos++] = static_cast<uint8_t>(length & 0xff);
+        data[pos++] = static_cast<uint8_t>(length >> 8);
+        if(length > 0)
+            memcpy(data.data() + pos, value.data(), length);
+        pos += length;
+    }
+}
+
+/**
+ * Decodes the results of a MULTI request, see encodeMultiResults().
+ *
+ * @param data the response's data field
+ * @returns one optional value per operation
+ */
+inline std::vector<std::optional<std::string>> decodeMultiResults(const std::array<uint8_t, MAX_LENGTH_VAL>& data) {
+    std::vector<std::optional<std::string>> results{};
+
+    size_t pos = 0;
+    size_t n = data[pos++];
+    for(size_t i = 0; i < n && pos + 3 <= data.size(); ++i) {
+        bool found = data[pos++] != 0;
+        size_t length = static_cast<size_t>(data[pos]) | (static_cast<size_t>(data[pos + 1]) << 8);
+        pos += 2;
+        if(pos + length > data.size())
+            break;
+        if(found)
+            results.emplace_back(std::string(reinterpret_cast<const char*>(data.data() + pos), length));
+        else
+            results.emplace_back(std::nullopt);
+        pos += length;
+    }
+    return results;
+}
+
+/**
+ * Encodes the keys of a GET_KEYS_BY_VALUE response into its data field:
+ *   number of keys (2 bytes)
+ *   per key: key length (1 byte) | key
+ * Keys which do not fit into the data field anymore are left out.
+ *
+ * @param keys the keys, e.g. std::string or FixedKey
+ * @param data the response's data field
+ * @returns the number of keys encoded
+ */
+template <typename K>
+size_t encodeKeys(const std::vector<K>& keys, std::array<uint8_t, MAX_LENGTH_VAL>& data) {
+    size_t pos = 2;
+    size_t n = 0;
+    for(auto& k : keys) {
+        std::string_view key{k};
+        size_t length = std::min<size_t>(key.size(), MAX_LENGTH_KEY);
+        if(pos + 1 + length > data.size())
+            break;
+        data[pos++] = static_cast<uint8_t>(length);
+        memcpy(data.data() + pos, key.data(), length);
+        pos += length;
+        ++n;
+    }
+    data[0] = static_cast<uint8_t>(n & 0xff);
+    data[1] = static_cast<uint8_t>(n >> 8);
+    return n;
+}
+
+/**
+ * Decodes the keys of a GET_KEYS_BY_VALUE response, see encodeKeys().
+ *
+ * @param data the response's data field
+ * @returns the keys
+ */
+inline std::vector<std::string> decodeKeys(const std::array<uint8_t, MAX_LENGTH_VAL>& data) {
+    std::vector<std::string> keys{};
+
+    size_t pos = 0;
+    size_t n = static_cast<size_t>(data[pos]) | (static_cast<size_t>(data[pos + 1]) << 8);
+    pos += 2;
+    for(size_t i = 0; i < n && pos + 1 <= data.size(); ++i) {
+        size_t length = data[pos++];
+        if(pos + length > data.size())
+            break;
+        keys.emplace_back(reinterpret_cast<const char*>(data.data() + pos), length);
+        pos += length;
+    }
+    return keys;
+}
+
+/**
+ * A single change in the server's change feed.
+ * mode is INSERT for insertions and assignments and DELETE for removals.
+ */
+struct ChangeRecord {
+    Message::mode_t mode;
+    std::array<uint8_t, MAX_LENGTH_KEY> key;
+    std::array<uint8_t, MAX_LENGTH_VAL> value;
+};
+
+/**
+ * The server's change feed: the last CHANGE_FEED_SLOTS changes of its HashTable,
+ * stored in the shared memory object CHANGE_FEED_NAME.
+ * A SUBSCRIBE request creates it if necessary and returns its name in the
+ * response's key and the sequence number of the next change in its data,
+ * from where the client can tail it with a LogCursor.
+ */
+using ChangeFeed = MutationLog<ChangeRecord, CHANGE_FEED_SLOTS>;
+static_assert(std::is_trivially_copyable_v<ChangeRecord>, "ChangeRecord is not trivially copyable and the change feed can't be read from a read-only mapping");
+
+/**
+ * The server's watched keys, stored in the shared memory object WATCH_TABLE_NAME.
+ * A WATCH request assigns the key one of the table's versions (unless it has
+ * one already) and returns the version's index and current value in the
+ * response's data. The server increments the version and wakes its waiters
+ * with futexWake() whenever the key is inserted, assigned or removed, so a
+ * client can block in futexWait() until the key changes instead of polling it.
+ */
+struct WatchTable {
+    std::array<std::atomic<uint32_t>, WATCH_SLOTS> versions;
+};
+
 template <size_t slots = 10>
 struct Mailbox {
     Mailbox() : msgs(CircularBuffer<Message, slots>{}), responses() {
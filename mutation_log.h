@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+
+/**
+ * The position of a consumer in a MutationLog.
+ * Every consumer keeps its own cursor, so any number of them can tail the same log.
+ */
+struct LogCursor {
+    // The sequence number of the next record to read
+    uint64_t next{0};
+    // The amount of records which were overwritten before they could be read
+    uint64_t dropped{0};
+};
+
+/**
+ * A change of a single entry as recorded by HashTable::enableMutationLog().
+ */
+template <typename K, typename V>
+struct Mutation {
+    enum op_t {
+        INSERT,
+        ASSIGN,
+        REMOVE
+    };
+
+    op_t op;
+    K key;
+    // The new value, std::nullopt for REMOVE
+    std::optional<V> value;
+};
+
+/**
+ * A bounded ring of the last N records appended by any amount of writers.
+ * Writers never wait for consumers: once the ring is full, the oldest records
+ * are overwritten and slow consumers skip them (see LogCursor::dropped).
+ * Appending claims a sequence number with a single fetch_add and then only
+ * touches its own slot, which no other writer uses unless it's a whole lap ahead.
+ * Records of a trivially copyable and default constructible T are stored as
+ * atomic words and read like a seqlock: a consumer copies the slot and checks
+ * its version before and after, so it never writes to the log and can't block
+ * writers or other consumers. Such a MutationLog consists of address-free
+ * atomics only, so it may be placed into shared memory and mapped read-only
+ * by consumers in other processes.
+ * Other records are allocated one by one and published by swapping a
+ * std::shared_ptr in the slot under a per-slot spinlock. Consumers only hold
+ * it for taking a reference to the record and read the record afterwards, so
+ * a slow consumer doesn't delay writers either, which append while holding a
+ * HashTable bucket lock.
+ */
+template <typename T, size_t N>
+class MutationLog {
+    public:
+        static_assert(N > 0, "A MutationLog needs at least one slot");
+
+        /**
+         * Appends a record, overwriting the oldest one if the ring is full.
+         *
+         * @param elem the record
+         */
+        void append(T elem) {
+            uint64_t seq = _next.fetch_add(1, std::memory_order_relaxed);
+            auto& slot = _slots[seq % N];
+
+            if constexpr(lockFree) {
+                // Mark the slot as being written by making its version odd
+                uint64_t version = slot.version.load(std::memory_order_relaxed);
+                while(true) {
+                    // A writer a whole lap ahead may have overtaken us, its record is newer
+                    if(version >= written(seq))
+                        return;
+                    if(version % 2 == 1) {
+                        // Another writer of an older lap is still busy with the slot
+                        std::this_thread::yield();
+                        version = slot.version.load(std::memory_order_relaxed);
+                    } else if(slot.version.compare_exchange_weak(version, written(seq) - 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                // Orders the odd version before the record's words
+                std::atomic_thread_fence(std::memory_order_release);
+
+                std::array<uint64_t, Words> words{};
+                std::memcpy(words.data(), &elem, sizeof(T));
+                for(size_t i = 0; i < Words; ++i) {
+                    slot.words[i].store(words[i], std::memory_order_relaxed);
+                }
+                slot.version.store(written(seq), std::memory_order_release);
+            } else {
+                auto record = std::make_shared<const Record>(written(seq), std::move(elem));
+                lock(slot);
+                // A writer a whole lap ahead may have overtaken us, its record is newer
+                if(!slot.record || slot.record->version < written(seq))
+                    slot.record.swap(record);
+                unlock(slot);
+                // The replaced record is released here, unless a consumer still reads it
+            }
+        }
+
+        /**
+         * Reads up to `max` records starting at `cursor` and calls f(record) for each of them.
+         * Stops early at the first record which has not been completely written yet.
+         * Never blocks writers: It only loads from the log if T is trivially
+         * copyable and otherwise holds a reference to the record while calling `f`.
+         *
+         * @param cursor the consumer's position, which is advanced past the read records
+         * @param f a callable taking a const T&
+         * @param max the maximum amount of records to read
+         * @returns the amount of records passed to `f`
+         */
+        template <typename F> requires std::is_invocable_v<F, const T&>
+        size_t read(LogCursor& cursor, F&& f, size_t max = N) const {
+            size_t count = 0;
+            while(count < max && cursor.next < _next.load(std::memory_order_acquire)) {
+                auto& slot = _slots[cursor.next % N];
+                std::optional<T> copy{};
+                std::shared_ptr<const Record> record{};
+                const T* elem = nullptr;
+
+                uint64_t version;
+                if constexpr(lockFree) {
+                    version = slot.version.load(std::memory_order_acquire);
+                    if(version == written(cursor.next)) {
+                        std::array<uint64_t, Words> words{};
+                        for(size_t i = 0; i < Words; ++i) {
+                            words[i] = slot.words[i].load(std::memory_order_relaxed);
+                        }
+                        // Orders the record's words before checking the version again
+                        std::atomic_thread_fence(std::memory_order_acquire);
+                        if(slot.version.load(std::memory_order_relaxed) != version) {
+                            // A writer of a later lap started overwriting it meanwhile
+                            continue;
+                        }
+                        copy.emplace();
+                        std::memcpy(static_cast<void*>(&*copy), words.data(), sizeof(T));
+                        elem = &*copy;
+                    }
+                } else {
+                    lock(slot);
+                    record = slot.record;
+                    unlock(slot);
+                    version = record ? record->version : 0;
+                    elem = record ? &record->elem : nullptr;
+                }
+
+                if(version < written(cursor.next)) {
+                    // Claimed, but not written yet
+                    break;
+                }
+                if(version > written(cursor.next)) {
+                    // Overwritten, continue with the oldest record still in the ring
+                    uint64_t next = _next.load(std::memory_order_acquire);
+                    uint64_t oldest = std::max(cursor.next + 1, next > N ? next - N : 0);
+                    cursor.dropped += oldest - cursor.next;
+                    cursor.next = oldest;
+                    continue;
+                }
+
+                f(*elem);
+                ++cursor.next;
+                ++count;
+            }
+            return count;
+        }
+
+        /**
+         * Returns a cursor pointing behind the newest record, i.e. one which
+         * only reads records appended from now on.
+         *
+         * @returns a LogCursor at the log's current end
+         */
+        LogCursor tail() const {
+            return LogCursor{_next.load(std::memory_order_acquire), 0};
+        }
+
+        /**
+         * Returns the capacity of the ring.
+         *
+         * @returns the maximum amount of records kept
+         */
+        static constexpr size_t capacity() {
+            return N;
+        }
+
+    private:
+        static constexpr bool lockFree = std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>;
+        // The amount of atomic words a record is stored in
+        static constexpr size_t Words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        // A slot's version once the record with sequence number seq is
+        // completely written, it's written(seq) - 1 while that's in progress
+        static constexpr uint64_t written(uint64_t seq) {
+            return 2 * (seq + 1);
+        }
+
+        struct AtomicSlot {
+            // 0 while the slot was never written, see written()
+            std::atomic<uint64_t> version{0};
+            std::array<std::atomic<uint64_t>, Words> words{};
+        };
+
+        // A record which is not trivially copyable, see SharedSlot
+        struct Record {
+            // written() of the record's sequence number
+            uint64_t version;
+            T elem;
+        };
+
+        struct SharedSlot {
+            mutable std::atomic_flag busy;
+            // nullptr while the slot was never written
+            std::shared_ptr<const Record> record{};
+        };
+
+        using Slot = std::conditional_t<lockFree, AtomicSlot, SharedSlot>;
+
+        // Slots are only held for copying or swapping a pointer, so spinning is fine
+        static void lock(const SharedSlot& slot) {
+            while(slot.busy.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+
+        static void unlock(const SharedSlot& slot) {
+            slot.busy.clear(std::memory_order_release);
+        }
+
+        // The sequence number the next append() claims
+        alignas(64) std::atomic<uint64_t> _next{0};
+        std::array<Slot, N> _slots{};
+};
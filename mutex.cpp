@@ -1,8 +1,15 @@
 #include <cerrno>
 #include <cstdio>
 #include <cstdlib>
+#include <climits>
 #include <pthread.h>
 #include <sys/time.h>
+#include <thread>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include "mutex.h"
 
@@ -45,6 +52,60 @@ pthread_mutex_t* PMutex::getHandle() {
 }
 
 
+PRWLock::PRWLock() {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+
+    errno = pthread_rwlock_init(&_handle, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    if(errno != 0) {
+        std::perror("PRWLock::pthread_rwlock_init()");
+        std::exit(-1);
+    }
+}
+
+PRWLock::~PRWLock() {
+    if((errno = pthread_rwlock_destroy(&_handle)) != 0) {
+        std::perror("PRWLock::pthread_rwlock_destroy()");
+        std::exit(-1);
+    }
+}
+
+void PRWLock::lock() {
+    if((errno = pthread_rwlock_wrlock(&_handle)) != 0) {
+        std::perror("PRWLock::pthread_rwlock_wrlock()");
+        std::exit(-1);
+    }
+}
+
+bool PRWLock::try_lock() {
+    return pthread_rwlock_trywrlock(&_handle) == 0;
+}
+
+void PRWLock::unlock() {
+    if((errno = pthread_rwlock_unlock(&_handle)) != 0) {
+        std::perror("PRWLock::pthread_rwlock_unlock()");
+        std::exit(-1);
+    }
+}
+
+void PRWLock::lock_shared() {
+    if((errno = pthread_rwlock_rdlock(&_handle)) != 0) {
+        std::perror("PRWLock::pthread_rwlock_rdlock()");
+        std::exit(-1);
+    }
+}
+
+bool PRWLock::try_lock_shared() {
+    return pthread_rwlock_tryrdlock(&_handle) == 0;
+}
+
+void PRWLock::unlock_shared() {
+    unlock();
+}
+
+
 CountingSemaphore::CountingSemaphore(unsigned int value) {
 #ifdef __APPLE__
     //_count = value;
@@ -148,6 +209,35 @@ void CountingSemaphore::wait() {
 #endif
 }
 
+bool CountingSemaphore::try_wait() {
+#ifdef __APPLE__
+    // Lock Mutex
+    if((errno = pthread_mutex_lock(&_mutex)) != 0) {
+        std::perror("CountingSemaphore::try_wait(): pthread_mutex_lock()");
+        std::exit(-1);
+    }
+
+    bool acquired = _count.load() > 0;
+    if(acquired)
+        _count.store(_count.load() - 1);
+
+    // Unlock Mutex
+    if((errno = pthread_mutex_unlock(&_mutex)) != 0) {
+        std::perror("CountingSemaphore::try_wait(): pthread_mutex_unlock()");
+        std::exit(-1);
+    }
+    return acquired;
+#else
+    if(sem_trywait(&_sem) == -1) {
+        if(errno == EAGAIN)
+            return false;
+        std::perror("CountingSemaphore::sem_trywait()");
+        std::exit(-1);
+    }
+    return true;
+#endif
+}
+
 void CountingSemaphore::post() {
 #ifdef __APPLE__
     //dispatch_semaphore_signal(_sem);
@@ -193,3 +283,30 @@ unsigned int CountingSemaphore::current_value() {
     return static_cast<unsigned int>(val);
 #endif
 }
+
+bool futexWait(std::atomic<uint32_t>* word, uint32_t expected, std::chrono::milliseconds timeout) {
+#if defined(__linux__)
+    struct timespec ts{};
+    ts.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+    ts.tv_nsec = static_cast<long>(timeout.count() % 1000 * 1000000);
+    // Not FUTEX_WAIT_PRIVATE since the word may be shared with other processes.
+    // EAGAIN (the word changed already), EINTR and ETIMEDOUT are all answered
+    // by checking the word below.
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+#else
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while(word->load() == expected && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+#endif
+    return word->load() != expected;
+}
+
+void futexWake(std::atomic<uint32_t>* word) {
+#if defined(__linux__)
+    if(syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0) == -1)
+        std::perror("futexWake(): futex()");
+#else
+    (void) word;
+#endif
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <pthread.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #ifdef __APPLE__
 // macOS does not support POSIX semaphores, but those from System V
 //#include <sys/sem.h>
@@ -29,6 +32,30 @@ class PMutex {
         pthread_mutex_t _handle;
 };
 
+/**
+ * Simple wrapper class for process-shared pthread_rwlocks,
+ * usable with std::unique_lock and std::shared_lock
+ */
+class PRWLock {
+    public:
+        PRWLock();
+        ~PRWLock();
+
+        PRWLock(const PRWLock&) = delete;
+        PRWLock& operator=(const PRWLock&) = delete;
+
+        void lock();
+        bool try_lock();
+        void unlock();
+
+        void lock_shared();
+        bool try_lock_shared();
+        void unlock_shared();
+
+    private:
+        pthread_rwlock_t _handle;
+};
+
 /**
  * Simple wrapper class for pthread_countingblbla since
  * C++ std::counting_semaphores do have a bug leading to
@@ -41,6 +68,7 @@ class CountingSemaphore {
         ~CountingSemaphore();
 
         void wait(); // acquire, P
+        bool try_wait(); // acquire if possible without blocking
         void post(); // release, signal V
         
         //bool try_post();
@@ -60,3 +88,26 @@ class CountingSemaphore {
 #endif
 };
 
+static_assert(std::atomic<uint32_t>::is_always_lock_free && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+        "atomic<uint32_t> can't be used as a futex word");
+
+/**
+ * Blocks until `word` is woken by futexWake() or the timeout expires,
+ * unless it does not hold `expected` in the first place. Works between
+ * processes if the word lies in shared memory.
+ * On systems without futexes, the word is polled every millisecond instead.
+ *
+ * @param word the futex word
+ * @param expected the value the caller has seen last
+ * @param timeout the maximum time to block
+ * @returns whether the word holds a different value than `expected` afterwards
+ */
+bool futexWait(std::atomic<uint32_t>* word, uint32_t expected, std::chrono::milliseconds timeout);
+
+/**
+ * Wakes all threads and processes blocked in futexWait() on `word`.
+ * Has to be called after changing the word.
+ *
+ * @param word the futex word
+ */
+void futexWake(std::atomic<uint32_t>* word);
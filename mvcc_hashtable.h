@@ -0,0 +1,512 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "hashtable.h"
+
+// Number of readers (get() calls and ReadViews) which can be active at once,
+// further readers wait for a free slot
+#define MVCC_READER_SLOTS 64
+// Number of retired versions after which a writer runs collect()
+#define MVCC_GC_INTERVAL 256
+
+/**
+ * A hashtable keeping several versions of every value, so that readers never lock.
+ * Every write prepends a new version to its entry, stamped with the value of a
+ * global commit counter. Readers take the current commit counter as their read
+ * timestamp and pick the newest version at or below it, only following atomic
+ * pointers. A ReadView keeps its timestamp, so all of its reads see the table
+ * as of a single point in time, unlike HashTable::getKeys() and getValues().
+ *
+ * Writers of the same bucket are serialized by a mutex, which readers never take.
+ * Versions which no reader can see anymore (as well as removed entries) are
+ * freed by collect(), which writers run every MVCC_GC_INTERVAL retired versions.
+ * Long-lived ReadViews hold back this garbage collection.
+ *
+ * The number of buckets is fixed at construction.
+ */
+template <typename K, typename V> requires Hashable<K> && std::equality_comparable<K> && std::copy_constructible<V>
+class MVCCHashTable {
+    struct Version;
+    struct Entry;
+
+    public:
+        /**
+         * A consistent view of the table as of the moment it was created.
+         * Writes committed afterwards are not visible to it.
+         */
+        class ReadView {
+            public:
+                ReadView(const ReadView&) = delete;
+                ReadView& operator=(const ReadView&) = delete;
+
+                ReadView(ReadView&& other) noexcept : _table(std::exchange(other._table, nullptr)),
+                                                      _slot(other._slot),
+                                                      _ts(other._ts) { }
+
+                ~ReadView() {
+                    if(_table)
+                        _table->releaseSlot(_slot);
+                }
+
+                /**
+                 * Returns the commit timestamp the view reads at.
+                 *
+                 * @returns the view's read timestamp
+                 */
+                uint64_t timestamp() const {
+                    return _ts;
+                }
+
+                /**
+                 * Tries to fetch the value associated with the given `key`.
+                 *
+                 * @param key the entry's key
+                 * @return the value as of the view's timestamp or std::nullopt
+                 */
+                std::optional<V> get(const K& key) const {
+                    return _table->lookup(key, _ts);
+                }
+
+                /**
+                 * Calls f(key, value) for every entry as of the view's timestamp.
+                 *
+                 * @param f a callable taking a const K& and a const V&
+                 */
+                template <typename F> requires std::is_invocable_v<F, const K&, const V&>
+                void for_each(F&& f) const {
+                    for(size_t i = 0; i < _table->_capacity; ++i) {
+                        for(auto* entry = _table->_buckets[i].head.load(std::memory_order_acquire); entry; entry = entry->next.load(std::memory_order_acquire)) {
+                            auto* version = visible(entry, _ts);
+                            if(version && version->value)
+                                f(entry->key, *version->value);
+                        }
+                    }
+                }
+
+                std::vector<K> getKeys() const {
+                    std::vector<K> keys{};
+                    for_each([&keys](const K& key, [[maybe_unused]] const V& value) {
+                        keys.push_back(key);
+                    });
+                    return keys;
+                }
+
+                std::vector<V> getValues() const {
+                    std::vector<V> values{};
+                    for_each([&values]([[maybe_unused]] const K& key, const V& value) {
+                        values.push_back(value);
+                    });
+                    return values;
+                }
+
+            private:
+                friend class MVCCHashTable;
+
+                explicit ReadView(const MVCCHashTable* table) : _table(table), _slot(table->acquireSlot()) {
+                    _ts = _table->_readers[_slot].ts.load(std::memory_order_relaxed);
+                }
+
+                const MVCCHashTable* _table;
+                size_t _slot;
+                uint64_t _ts{0};
+        };
+
+        /**
+         * Constructor.
+         *
+         * @param cap the (fixed) number of buckets
+         */
+        explicit MVCCHashTable(size_t cap = 1024) : _capacity(cap < 1 ? 1 : cap),
+                                                    _buckets(std::make_unique<Bucket[]>(cap < 1 ? 1 : cap)) { }
+
+        MVCCHashTable(const MVCCHashTable&) = delete;
+        MVCCHashTable& operator=(const MVCCHashTable&) = delete;
+
+        ~MVCCHashTable() {
+            for(size_t i = 0; i < _capacity; ++i) {
+                for(auto* entry = _buckets[i].head.load(std::memory_order_relaxed); entry; ) {
+                    auto* next = entry->next.load(std::memory_order_relaxed);
+                    deleteEntry(entry);
+                    entry = next;
+                }
+            }
+            // Unlinked entries which were not freed yet
+            for(auto& retired : _retired) {
+                if(retired.kind == Retired::ENTRY)
+                    deleteEntry(static_cast<Entry*>(retired.ptr));
+            }
+        }
+
+        /**
+         * Inserts `value` into the MVCCHashTable given the `key`.
+         * If the entry exists already, insert() returns false and does
+         * not overwrite the existing entry.
+         *
+         * @param key the entry's key
+         * @param value the value which is to be inserted
+         * @return True if successful, false otherwise
+         */
+        bool insert(K key, V value) {
+            return write(std::move(key), std::move(value), false).first;
+        }
+
+        /**
+         * Inserts `value` or overwrites the existing value of `key`.
+         *
+         * @param key the entry's key
+         * @param value the new value
+         * @return True if the entry was inserted, false if it was overwritten
+         */
+        bool insert_or_assign(K key, V value) {
+            return !write(std::move(key), std::move(value), true).second.has_value();
+        }
+
+        /**
+         * Removes the entry of the given `key`. Older versions stay visible to
+         * readers with an earlier read timestamp.
+         *
+         * @param key the entry's key
+         * @return the removed value or std::nullopt if there was none
+         */
+        std::optional<V> remove(const K& key) {
+            return write(key, std::nullopt, true).second;
+        }
+
+        /**
+         * Tries to fetch the newest committed value associated with the given `key`.
+         *
+         * @param key the entry's key
+         * @return the value or std::nullopt
+         */
+        std::optional<V> get(const K& key) const {
+            return read_view().get(key);
+        }
+
+        /**
+         * Returns a ReadView reading at the newest commit timestamp.
+         *
+         * @returns the ReadView
+         */
+        ReadView read_view() const {
+            return ReadView{this};
+        }
+
+        /**
+         * Returns all keys as of a single point in time.
+         *
+         * @returns the keys
+         */
+        std::vector<K> getKeys() const {
+            return read_view().getKeys();
+        }
+
+        /**
+         * Returns all values as of a single point in time.
+         *
+         * @returns the values
+         */
+        std::vector<V> getValues() const {
+            return read_view().getValues();
+        }
+
+        size_t size() const {
+            return _size.load(std::memory_order_relaxed);
+        }
+
+        size_t capacity() const {
+            return _capacity;
+        }
+
+        /**
+         * Frees all versions and removed entries which no active reader can see anymore.
+         *
+         * @returns the number of freed versions
+         */
+        size_t collect() {
+            std::unique_lock gc(_gcMutex);
+            return collectRetired();
+        }
+
+        /**
+         * Returns the number of retired versions and entries waiting to be freed.
+         *
+         * @returns the number of pending retirements
+         */
+        size_t pending() const {
+            std::scoped_lock lock(_retireMutex);
+            return _retired.size();
+        }
+
+    private:
+        // The value of a free reader slot
+        static constexpr uint64_t FREE = UINT64_MAX;
+
+        struct Version {
+            uint64_t stamp;
+            // std::nullopt marks a removal
+            std::optional<V> value;
+            std::atomic<Version*> older;
+        };
+
+        struct Entry {
+            K key;
+            size_t hash;
+            // The newest version
+            std::atomic<Version*> versions;
+            std::atomic<Entry*> next;
+        };
+
+        struct Bucket {
+            // Only taken by writers
+            std::mutex mutex;
+            std::atomic<Entry*> head{nullptr};
+        };
+
+        // The read timestamp of an active reader, 0 while it is being taken
+        struct alignas(64) ReaderSlot {
+            std::atomic<uint64_t> ts{FREE};
+        };
+
+        struct Retired {
+            enum kind_t {
+                VERSIONS,  // ptr is a Version whose older versions can be freed
+                TOMBSTONE, // ptr is an Entry whose newest version is a removal, which can be unlinked
+                ENTRY      // ptr is an unlinked Entry which can be freed
+            };
+
+            uint64_t stamp;
+            kind_t kind;
+            void* ptr;
+        };
+
+        size_t hashOf(const K& key) const {
+            return std::hash<K>{}(key);
+        }
+
+        // Returns the newest version of `entry` at or below `ts`
+        static const Version* visible(const Entry* entry, uint64_t ts) {
+            auto* version = entry->versions.load(std::memory_order_acquire);
+            while(version && version->stamp > ts) {
+                version = version->older.load(std::memory_order_acquire);
+            }
+            return version;
+        }
+
+        std::optional<V> lookup(const K& key, uint64_t ts) const {
+            size_t h = hashOf(key);
+            for(auto* entry = _buckets[h % _capacity].head.load(std::memory_order_acquire); entry; entry = entry->next.load(std::memory_order_acquire)) {
+                if(entry->hash == h && entry->key == key) {
+                    auto* version = visible(entry, ts);
+                    return version ? version->value : std::nullopt;
+                }
+            }
+            return std::nullopt;
+        }
+
+        // Must be called with the bucket's lock held
+        static Entry* find(Bucket& bucket, const K& key, size_t h) {
+            for(auto* entry = bucket.head.load(std::memory_order_relaxed); entry; entry = entry->next.load(std::memory_order_relaxed)) {
+                if(entry->hash == h && entry->key == key)
+                    return entry;
+            }
+            return nullptr;
+        }
+
+        // Writes a new version of `key` (a removal for std::nullopt) unless the key
+        // exists and !overwrite, or a removal finds no value.
+        // Returns whether a version was written and the previous value.
+        std::pair<bool, std::optional<V>> write(K key, std::optional<V> value, bool overwrite) {
+            size_t h = hashOf(key);
+            auto& bucket = _buckets[h % _capacity];
+            std::pair<bool, std::optional<V>> result{false, std::nullopt};
+            {
+                std::scoped_lock lock(bucket.mutex);
+                Entry* entry = find(bucket, key, h);
+                Version* head = entry ? entry->versions.load(std::memory_order_relaxed) : nullptr;
+                if(head)
+                    result.second = head->value;
+                if((result.second && !overwrite) || (!result.second && !value))
+                    return result;
+
+                uint64_t stamp = claim();
+                bool removal = !value;
+                auto* version = new Version{stamp, std::move(value), head};
+                if(entry) {
+                    entry->versions.store(version, std::memory_order_release);
+                } else {
+                    entry = new Entry{std::move(key), h, version, bucket.head.load(std::memory_order_relaxed)};
+                    bucket.head.store(entry, std::memory_order_release);
+                }
+                commit(stamp);
+
+                if(removal)
+                    _size.fetch_sub(1, std::memory_order_relaxed);
+                else if(!result.second)
+                    _size.fetch_add(1, std::memory_order_relaxed);
+
+                if(head)
+                    retire(Retired{stamp, Retired::VERSIONS, version});
+                if(removal)
+                    retire(Retired{stamp, Retired::TOMBSTONE, entry});
+                result.first = true;
+            }
+
+            if(_retiredCount.load(std::memory_order_relaxed) >= MVCC_GC_INTERVAL) {
+                std::unique_lock gc(_gcMutex, std::try_to_lock);
+                if(gc.owns_lock())
+                    collectRetired();
+            }
+            return result;
+        }
+
+        // Claims the next commit timestamp
+        uint64_t claim() {
+            return _next.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        // Makes everything written with `stamp` visible to new readers.
+        // Timestamps are committed in order, so a reader never misses an older
+        // write which is still in progress.
+        void commit(uint64_t stamp) {
+            while(_committed.load(std::memory_order_acquire) != stamp - 1) {
+                std::this_thread::yield();
+            }
+            _committed.store(stamp, std::memory_order_seq_cst);
+        }
+
+        void retire(Retired retired) {
+            std::scoped_lock lock(_retireMutex);
+            _retired.push_back(retired);
+            _retiredCount.store(_retired.size(), std::memory_order_relaxed);
+        }
+
+        size_t acquireSlot() const {
+            size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+            for(size_t i = 0; ; ++i) {
+                auto& slot = _readers[(start + i) % MVCC_READER_SLOTS];
+                uint64_t expected = FREE;
+                if(slot.ts.load(std::memory_order_relaxed) == FREE && slot.ts.compare_exchange_strong(expected, 0)) {
+                    // A collector which misses the slot has loaded an older (or the same)
+                    // timestamp than this one and won't free anything this reader can see
+                    slot.ts.store(_committed.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+                    return (start + i) % MVCC_READER_SLOTS;
+                }
+                if((i + 1) % MVCC_READER_SLOTS == 0)
+                    std::this_thread::yield();
+            }
+        }
+
+        void releaseSlot(size_t slot) const {
+            _readers[slot].ts.store(FREE, std::memory_order_release);
+        }
+
+        // Returns the oldest timestamp any current or future reader can read at
+        uint64_t horizon() const {
+            uint64_t horizon = _committed.load(std::memory_order_seq_cst);
+            for(auto& slot : _readers) {
+                horizon = std::min(horizon, slot.ts.load(std::memory_order_seq_cst));
+            }
+            return horizon;
+        }
+
+        // Must be called with _gcMutex held
+        size_t collectRetired() {
+            uint64_t oldest = horizon();
+
+            std::vector<Retired> ready{};
+            {
+                std::scoped_lock lock(_retireMutex);
+                auto it = std::partition(_retired.begin(), _retired.end(), [oldest](const Retired& r) {
+                    return r.stamp > oldest;
+                });
+                ready.assign(it, _retired.end());
+                _retired.erase(it, _retired.end());
+                _retiredCount.store(_retired.size(), std::memory_order_relaxed);
+            }
+            // A newer version's older versions include the older ones' older versions,
+            // so the older ones must be cut off first
+            std::sort(ready.begin(), ready.end(), [](const Retired& a, const Retired& b) {
+                return a.stamp < b.stamp || (a.stamp == b.stamp && a.kind < b.kind);
+            });
+
+            size_t freed = 0;
+            for(auto& retired : ready) {
+                switch(retired.kind) {
+                    case Retired::VERSIONS:
+                        freed += deleteVersions(static_cast<Version*>(retired.ptr)->older.exchange(nullptr, std::memory_order_relaxed));
+                        break;
+                    case Retired::TOMBSTONE:
+                        unlinkRemoved(static_cast<Entry*>(retired.ptr), retired.stamp);
+                        break;
+                    case Retired::ENTRY:
+                        freed += deleteEntry(static_cast<Entry*>(retired.ptr));
+                        break;
+                }
+            }
+            return freed;
+        }
+
+        // Unlinks `entry` if its newest version is still the removal with `stamp`.
+        // Readers may still be traversing it, so it is only freed once they are done.
+        void unlinkRemoved(Entry* entry, uint64_t stamp) {
+            auto& bucket = _buckets[entry->hash % _capacity];
+            std::scoped_lock lock(bucket.mutex);
+            if(entry->versions.load(std::memory_order_relaxed)->stamp != stamp)
+                return; // Inserted again
+
+            auto* link = &bucket.head;
+            while(link->load(std::memory_order_relaxed) != entry) {
+                link = &link->load(std::memory_order_relaxed)->next;
+            }
+            link->store(entry->next.load(std::memory_order_relaxed), std::memory_order_release);
+
+            // Readers starting after this timestamp can't reach the entry
+            uint64_t unlinked = claim();
+            commit(unlinked);
+            retire(Retired{unlinked, Retired::ENTRY, entry});
+        }
+
+        static size_t deleteVersions(Version* version) {
+            size_t freed = 0;
+            while(version) {
+                auto* older = version->older.load(std::memory_order_relaxed);
+                delete version;
+                version = older;
+                ++freed;
+            }
+            return freed;
+        }
+
+        static size_t deleteEntry(Entry* entry) {
+            size_t freed = deleteVersions(entry->versions.load(std::memory_order_relaxed));
+            delete entry;
+            return freed;
+        }
+
+        size_t _capacity;
+        std::unique_ptr<Bucket[]> _buckets;
+        std::atomic<size_t> _size{0};
+
+        // The last claimed and the last committed timestamp
+        alignas(64) std::atomic<uint64_t> _next{0};
+        alignas(64) std::atomic<uint64_t> _committed{0};
+
+        mutable std::array<ReaderSlot, MVCC_READER_SLOTS> _readers{};
+
+        std::mutex _gcMutex;
+        mutable std::mutex _retireMutex;
+        std::vector<Retired> _retired{};
+        std::atomic<size_t> _retiredCount{0};
+};
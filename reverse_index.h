@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Number of independently locked stripes of a ReverseIndex
+#define REVERSE_INDEX_STRIPES 64
+
+/**
+ * Values which a ReverseIndex can map back to their keys.
+ */
+template <typename V>
+concept ReverseIndexable = std::equality_comparable<V> && requires(const V& v) {
+    { std::hash<V>{}(v) } -> std::convertible_to<std::size_t>;
+};
+
+/**
+ * A secondary index from values to the set of keys mapped to them, see
+ * HashTable::enableReverseIndex().
+ * Values are spread over REVERSE_INDEX_STRIPES stripes by their hash, each
+ * guarded by its own mutex. Synchronizing the index with the table is left
+ * to the table, which updates it while holding the entry's bucket lock.
+ * Keys are hashed with the table's `Hash`, so they don't need a std::hash.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>>
+class ReverseIndex {
+    public:
+        /**
+         * Records that `key` is mapped to `value`.
+         */
+        void add(const V& value, const K& key) {
+            auto& s = stripe(value);
+            std::scoped_lock lock(s.mutex);
+            s.keys[value].insert(key);
+        }
+
+        /**
+         * Records that `key` is not mapped to `value` anymore.
+         */
+        void remove(const V& value, const K& key) {
+            auto& s = stripe(value);
+            std::scoped_lock lock(s.mutex);
+            auto it = s.keys.find(value);
+            if(it == s.keys.end())
+                return;
+            it->second.erase(key);
+            if(it->second.empty())
+                s.keys.erase(it);
+        }
+
+        /**
+         * Returns all keys mapped to `value`.
+         *
+         * @param value the value to look up
+         * @returns the keys in no particular order
+         */
+        std::vector<K> keysOf(const V& value) const {
+            auto& s = stripe(value);
+            std::scoped_lock lock(s.mutex);
+            auto it = s.keys.find(value);
+            if(it == s.keys.end())
+                return {};
+            return std::vector<K>(it->second.begin(), it->second.end());
+        }
+
+    private:
+        struct alignas(64) Stripe {
+            mutable std::mutex mutex;
+            std::unordered_map<V, std::unordered_set<K, Hash>> keys;
+        };
+
+        Stripe& stripe(const V& value) {
+            return _stripes[std::hash<V>{}(value) % REVERSE_INDEX_STRIPES];
+        }
+        const Stripe& stripe(const V& value) const {
+            return _stripes[std::hash<V>{}(value) % REVERSE_INDEX_STRIPES];
+        }
+
+        std::array<Stripe, REVERSE_INDEX_STRIPES> _stripes{};
+};
+
+// Stands in for the ReverseIndex of tables whose values can't be indexed
+struct NoReverseIndex { };
@@ -1,4 +1,5 @@
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/shm.h>
@@ -11,6 +12,8 @@
 #include <memory>
 #include <mutex>
 #include <numeric>
+#include <shared_mutex>
+#include <unordered_map>
 
 #include <atomic>
 #include <algorithm>
@@ -23,6 +26,7 @@
 #include "hashtable.h"
 #include "mutex.h"
 
+#include <fstream>
 #include <sstream>
 #include <iomanip>
 
@@ -41,7 +45,125 @@ void signal_handler([[maybe_unused]] int signal) {
 }
 
 // Our HashTable which is managed by the server
-std::unique_ptr<HashTable<std::string, std::string>> table;
+using Table = HashTable<TableKey, TableValue>;
+std::unique_ptr<Table> table;
+
+// The change feed in shared memory, created by the first SUBSCRIBE request
+std::once_flag feed_once;
+std::atomic<ChangeFeed*> feed = nullptr;
+
+// The watch table in shared memory, created by the first WATCH request.
+// watched_keys maps every watched key to its version in the table.
+std::once_flag watches_once;
+std::atomic<WatchTable*> watches = nullptr;
+std::shared_mutex watched_mutex;
+std::unordered_map<TableKey, size_t> watched_keys;
+
+// Forwards the table's changes to the change feed, started along with it
+std::thread pump_thread;
+
+/**
+ * Copies the changes recorded in the table's MutationLog into the change
+ * feed until the server shuts down.
+ * Keeping this off the writers' path means they only append to the in-process log.
+ */
+void pumpChanges(LogCursor cursor) {
+    auto& log = *table->mutationLog();
+    uint64_t dropped = 0;
+    while(running) {
+        size_t n = log.read(cursor, [](const Mutation<TableKey, TableValue>& m) {
+            ChangeRecord record{};
+            record.mode = m.op == Mutation<TableKey, TableValue>::REMOVE ? Message::DELETE : Message::INSERT;
+            copyBytes(std::string_view{m.key}, record.key);
+            if(m.value)
+                copyBytes(std::string_view{*m.value}, record.value);
+            feed.load()->append(record);
+        });
+        if(cursor.dropped != dropped) {
+            // The feed can't tell its readers, so at least the server's log does
+            std::lock_guard lock(cout_lock);
+            std::cerr << "The change feed missed " << cursor.dropped - dropped << " changes" << std::endl;
+            dropped = cursor.dropped;
+        }
+        if(n == 0)
+            std::this_thread::sleep_for(1ms);
+    }
+}
+
+/**
+ * Bumps the version of `key` in the watch table if it is watched and wakes
+ * its watchers. Installed as the table's change hook, so it runs in the
+ * writer's thread with the key's bucket locked and no change is ever missed,
+ * while writes of the value a key already has don't abort transactions.
+ */
+void bumpWatched(const TableKey& key) {
+    auto versions = watches.load();
+    std::shared_lock lock(watched_mutex);
+    auto it = watched_keys.find(key);
+    if(it != watched_keys.end()) {
+        versions->versions[it->second].fetch_add(1);
+        futexWake(&versions->versions[it->second]);
+    }
+}
+
+/**
+ * Creates a shared memory object of the given size and maps it.
+ *
+ * @param name the object's name
+ * @param size the object's size in bytes
+ * @returns a pointer to the mapping, nullptr on failure
+ */
+void* createShared(const char* name, size_t size) {
+    int shm_fd = shm_open(name, O_RDWR | O_CREAT, 0666);
+    if(shm_fd == -1) {
+        perror("server.cpp: createShared(): shm_open() failed");
+        return nullptr;
+    }
+    if(ftruncate(shm_fd, static_cast<off_t>(size)) != 0) {
+        perror("server.cpp: createShared(): ftruncate() failed");
+        shm_unlink(name);
+        close(shm_fd);
+        return nullptr;
+    }
+    void* shm_ptr = mmap(NULL,
+                         size,
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED,
+                         shm_fd,
+                         0);
+    close(shm_fd);
+    if(shm_ptr == MAP_FAILED) {
+        perror("server.cpp: createShared(): mmap() failed");
+        shm_unlink(name);
+        return nullptr;
+    }
+    return shm_ptr;
+}
+
+/**
+ * Creates the change feed's shared memory object and starts copying the
+ * table's changes into it.
+ */
+void startChangeFeed() {
+    void* shm_ptr = createShared(CHANGE_FEED_NAME, sizeof(ChangeFeed));
+    if(!shm_ptr)
+        return;
+    auto cursor = table->enableMutationLog().tail();
+    feed = new(shm_ptr) ChangeFeed{}; // Placement new
+    pump_thread = std::thread{pumpChanges, cursor};
+}
+
+/**
+ * Creates the watch table's shared memory object and starts bumping the
+ * versions of watched keys.
+ */
+void startWatches() {
+    void* shm_ptr = createShared(WATCH_TABLE_NAME, sizeof(WatchTable));
+    if(!shm_ptr)
+        return;
+    watches = new(shm_ptr) WatchTable{}; // Placement new
+    table->enableChangeHook(bumpWatched);
+}
 
 // from https://gist.github.com/miguelmota/4fc9b46cf21111af5fa613555c14de92
 std::string uint8_to_hex_string(const uint8_t* v, const size_t s) {
@@ -67,6 +189,45 @@ std::string uint8_to_string(const uint8_t* v, const size_t len) {
     return ss.str();
 }
 
+/**
+ * Returns a predicate for HashTable::erase_if() which matches keys against the
+ * glob `pattern` (see fnmatch(3)). Patterns which only end in a `*`, e.g.
+ * "tenant42:*", are compared as prefixes instead.
+ */
+auto globMatcher(std::string pattern) {
+    const bool prefix = !pattern.empty() && pattern.back() == '*'
+        && pattern.find_first_of("*?[\\") == pattern.size() - 1;
+    return [pattern = std::move(pattern), prefix](const TableKey& k, const TableValue&) {
+        std::string_view key{k};
+        if(prefix)
+            return key.starts_with(std::string_view{pattern}.substr(0, pattern.size() - 1));
+        // fnmatch() needs a null-terminated key
+        char str[MAX_LENGTH_KEY + 1];
+        size_t length = std::min<size_t>(key.size(), MAX_LENGTH_KEY);
+        memcpy(str, key.data(), length);
+        str[length] = 0;
+        return fnmatch(pattern.c_str(), str, 0) == 0;
+    };
+}
+
+#if defined(FIXED_LAYOUT)
+TableKey toKey(const std::array<uint8_t, MAX_LENGTH_KEY>& key) {
+    return TableKey{key};
+}
+
+TableValue toValue(const std::array<uint8_t, MAX_LENGTH_VAL>& data) {
+    return TableValue{StoredValue{data}};
+}
+#else
+TableKey toKey(const std::array<uint8_t, MAX_LENGTH_KEY>& key) {
+    return uint8_to_string(key.data(), key.size());
+}
+
+TableValue toValue(const std::array<uint8_t, MAX_LENGTH_VAL>& data) {
+    return TableValue{uint8_to_string(data.data(), data.size())};
+}
+#endif
+
 std::ostream& operator<<(std::ostream& output, const Message& other) {
     switch(other.mode) {
         case Message::GET:
@@ -87,6 +248,21 @@ std::ostream& operator<<(std::ostream& output, const Message& other) {
         case Message::RESPONSE:
             output << "(RESPONSE)";
             break;
+        case Message::MULTI:
+            output << "(MULTI)";
+            break;
+        case Message::SUBSCRIBE:
+            output << "(SUBSCRIBE)";
+            break;
+        case Message::GET_KEYS_BY_VALUE:
+            output << "(GET_KEYS_BY_VALUE)";
+            break;
+        case Message::WATCH:
+            output << "(WATCH)";
+            break;
+        case Message::ERASE_IF:
+            output << "(ERASE_IF)";
+            break;
         default:
             output << "(DEFAULT)";
             break;
@@ -105,21 +281,67 @@ std::ostream& operator<<(std::ostream& output, const Message& other) {
 }
 
 void receiveMsg(Mailbox<slots>* mailbox) {
-    while(true) {
+    // GET requests drained from the mailbox, which are looked up together
+    std::vector<std::pair<Message, size_t>> gets{};
+    bool exit = false;
+
+    while(!exit) {
         // TODO: Prevent a deadlock if the client does not exist anymore?
         //       This could be done via cond_wait() with timeouts
 
-        auto elem = mailbox->msgs.pop();
-        if(elem) {
+        // Sleeps on a futex while the mailbox is empty
+        auto elem = mailbox->msgs.pop(1s);
+        // Drain up to BATCH_WIDTH requests which are already waiting
+        for(size_t n = 0; elem; ) {
             auto& msg = elem->first;
             auto idx = elem->second;
 
             // Check for exit condition
-            if(msg.mode == Message::EXIT)
+            if(msg.mode == Message::EXIT) {
+                exit = true;
                 break;
+            }
+
+            if(msg.mode == Message::GET)
+                gets.emplace_back(msg, idx);
+            else
+                respond(mailbox, idx, msg);
 
-            respond(mailbox, idx, msg);
+            if(++n == BATCH_WIDTH)
+                break;
+            elem = mailbox->msgs.try_pop();
         }
+
+        if(!gets.empty()) {
+            respondGets(mailbox, gets);
+            gets.clear();
+        }
+    }
+}
+
+void respondGets(Mailbox<slots>* mailbox, std::vector<std::pair<Message, size_t>>& requests) {
+    std::vector<TableKey> keys{};
+    for(auto& [msg, idx] : requests) {
+        keys.push_back(toKey(msg.key));
+    }
+
+    auto results = table->get_batch(keys);
+
+    for(size_t i = 0; i < requests.size(); ++i) {
+        auto& msg = requests[i].first;
+        Message response{};
+        response.mode = Message::RESPONSE;
+        response.client_id.store(msg.client_id.load());
+        response.key = msg.key;
+        if(results[i]) {
+            copyBytes(std::string_view{*results[i]}, response.data);
+            response.success = true;
+        } else {
+            // Entry was not found in the HashTable
+            response.data[0] = 0;
+            response.success = false;
+        }
+        sendResponse(mailbox, requests[i].second, response);
     }
 }
 
@@ -132,10 +354,9 @@ void respond(Mailbox<slots>* mailbox, size_t idx, Message msg) {
 
     switch(msg.mode) {
         case Message::GET: {
-            auto result = table->get(uint8_to_string(msg.key.data(), msg.key.size()));
+            auto result = table->get(toKey(msg.key));
             if(result) {
-                auto& value = *result;
-                memcpy(response.data.data(), value.c_str(), strlen(value.c_str()) + 1);
+                copyBytes(std::string_view{*result}, response.data);
                 response.success = true;
             } else {
                 // Entry was not found in the HashTable
@@ -145,7 +366,7 @@ void respond(Mailbox<slots>* mailbox, size_t idx, Message msg) {
             break;
             }
         case Message::INSERT: {
-            bool result = table->insert(uint8_to_string(msg.key.data(), msg.key.size()), uint8_to_string(msg.data.data(), msg.data.size()));
+            bool result = table->insert(toKey(msg.key), toValue(msg.data));
             if(result) {
                 memcpy(response.data.data(), &result, sizeof(bool));
                 response.success = true;
@@ -179,7 +400,7 @@ void respond(Mailbox<slots>* mailbox, size_t idx, Message msg) {
 
             // Calculate the needed amount of memory to fit our data in
             size_t totalLength{0};
-            auto f = [](const size_t& acc, [[maybe_unused]] const std::pair<std::string, std::string>& x) -> size_t {
+            auto f = [](const size_t& acc, [[maybe_unused]] const std::pair<TableKey, TableValue>& x) -> size_t {
                 return std::move(acc) + sizeof(std::pair<std::array<uint8_t, MAX_LENGTH_KEY>, std::array<uint8_t, MAX_LENGTH_VAL>>);
             };
             totalLength = std::accumulate(result.begin(), result.end(), static_cast<size_t>(0), f);
@@ -227,10 +448,10 @@ void respond(Mailbox<slots>* mailbox, size_t idx, Message msg) {
             // First, we need to convert the std::strings to uint8_t arrays
             std::vector<std::pair<std::array<uint8_t, MAX_LENGTH_KEY>, std::array<uint8_t, MAX_LENGTH_VAL>>> uint8_vec{result.size()};
             std::transform(result.begin(), result.end(), uint8_vec.begin(),
-                    [](std::pair<std::string, std::string> p) {
-                    std::pair<std::array<uint8_t, MAX_LENGTH_KEY>, std::array<uint8_t, MAX_LENGTH_VAL>> newP;
-                    memcpy(&(newP.first), p.first.c_str(), p.first.length() + 1);
-                    memcpy(&(newP.second), p.second.c_str(), p.second.length() + 1);
+                    [](const std::pair<TableKey, TableValue>& p) {
+                    std::pair<std::array<uint8_t, MAX_LENGTH_KEY>, std::array<uint8_t, MAX_LENGTH_VAL>> newP{};
+                    copyBytes(std::string_view{p.first}, newP.first);
+                    copyBytes(std::string_view{p.second}, newP.second);
                     return newP;
                         });
 
@@ -259,10 +480,9 @@ void respond(Mailbox<slots>* mailbox, size_t idx, Message msg) {
             return;
             //break;
         case Message::DELETE: {
-            auto result = table->remove(uint8_to_string(msg.key.data(), msg.key.size()));
+            auto result = table->remove(toKey(msg.key));
             if(result) {
-                auto& value = *result;
-                memcpy(response.data.data(), value.c_str(), strlen(value.c_str()) + 1);
+                copyBytes(std::string_view{*result}, response.data);
                 response.success = true;
 
             } else {
@@ -272,6 +492,111 @@ void respond(Mailbox<slots>* mailbox, size_t idx, Message msg) {
             }
             }
             break;
+        case Message::MULTI: {
+            auto ops = decodeMulti(msg.data);
+            if(!ops) {
+                // Malformed request
+                response.data[0] = 0;
+                response.success = false;
+                break;
+            }
+
+            Table::Transaction tx{};
+            for(auto& op : *ops) {
+                switch(op.mode) {
+                    case Message::GET:
+                        tx.get(TableKey{op.key});
+                        break;
+                    case Message::INSERT:
+                        tx.insert(TableKey{op.key}, TableValue{StoredValue{op.value}});
+                        break;
+                    default:
+                        tx.remove(TableKey{op.key});
+                        break;
+                }
+            }
+
+            auto results = table->commit(tx);
+            if(results) {
+                encodeMultiResults(*results, response.data);
+                response.success = true;
+            } else {
+                response.data[0] = 0;
+                response.success = false;
+            }
+            }
+            break;
+        case Message::SUBSCRIBE: {
+            std::call_once(feed_once, startChangeFeed);
+            auto changes = feed.load();
+            if(!changes) {
+                response.data[0] = 0;
+                response.success = false;
+                break;
+            }
+
+            // Tell the client where to find the feed and where to start reading
+            std::string next = std::to_string(changes->tail().next);
+            memcpy(response.key.data(), CHANGE_FEED_NAME, strlen(CHANGE_FEED_NAME) + 1);
+            memcpy(response.data.data(), next.c_str(), next.length() + 1);
+            response.success = true;
+            }
+            break;
+        case Message::GET_KEYS_BY_VALUE: {
+            // The first lookup builds the index, later ones reuse it
+            table->enableReverseIndex();
+            auto keys = table->keysOf(toValue(msg.data));
+
+            // The response's key holds the total number of keys, which
+            // may be more than fit into its data
+            std::string total = std::to_string(keys.size());
+            memcpy(response.key.data(), total.c_str(), total.length() + 1);
+            encodeKeys(keys, response.data);
+            response.success = !keys.empty();
+            }
+            break;
+        case Message::ERASE_IF: {
+            // One parallel sweep over all buckets instead of a DELETE per key
+            std::string pattern = uint8_to_string(msg.key.data(), msg.key.size());
+            std::string removed = std::to_string(table->erase_if(globMatcher(std::move(pattern)), 0));
+            memcpy(response.data.data(), removed.c_str(), removed.length() + 1);
+            response.success = true;
+            }
+            break;
+        case Message::WATCH: {
+            std::call_once(watches_once, startWatches);
+            auto versions = watches.load();
+            if(!versions) {
+                response.data[0] = 0;
+                response.success = false;
+                break;
+            }
+
+            size_t slot = 0;
+            {
+                std::unique_lock lock(watched_mutex);
+                auto key = toKey(msg.key);
+                auto it = watched_keys.find(key);
+                if(it == watched_keys.end()) {
+                    if(watched_keys.size() == WATCH_SLOTS) {
+                        // Every version is taken
+                        response.data[0] = 0;
+                        response.success = false;
+                        break;
+                    }
+                    it = watched_keys.emplace(std::move(key), watched_keys.size()).first;
+                }
+                slot = it->second;
+            }
+
+            // Tell the client where to find the version and which value it has seen,
+            // every change from now on increments it
+            std::string version = std::to_string(slot) + " " + std::to_string(versions->versions[slot].load());
+            memcpy(response.key.data(), WATCH_TABLE_NAME, strlen(WATCH_TABLE_NAME) + 1);
+            memcpy(response.data.data(), version.c_str(), version.length() + 1);
+            response.success = true;
+            }
+            break;
         case Message::RESPONSE:
             // Should never happen
             std::cout << "response case!" << std::endl;
@@ -286,7 +611,10 @@ void respond(Mailbox<slots>* mailbox, size_t idx, Message msg) {
             break;
     }
 
-    
+    sendResponse(mailbox, idx, response);
+}
+
+void sendResponse(Mailbox<slots>* mailbox, size_t idx, Message& response) {
     // Respond
     mailbox->mutexes[idx].lock();
     // Wait for the response's slot to be ready to be written to
@@ -319,18 +647,26 @@ void respond(Mailbox<slots>* mailbox, size_t idx, Message msg) {
 int main(int argc, char* argv[]) {
     std::cout << "Hello from the server!" << std::endl;
 
-    if(argc != 2) {
-        std::cerr << "Wrong number of arguments! Expecting exactly \
+    if(argc < 2) {
+        std::cerr << "Wrong number of arguments! Expecting \
             one integer argument (size of the HashTable). \
             If 0 is provided, the HashTable dynamically grows \
             and shrinks (which is currently only working \
-            with a single client)." << std::endl;
+            with a single client). \
+            Optional flags: --maintenance (resize a dynamic \
+            HashTable in a background thread), --load FILE \
+            (bulk-load \"key value\" lines at startup), \
+            --huge-pages (store the buckets in transparent \
+            huge pages), --hugetlb (in reserved huge pages)." << std::endl;
         return EXIT_FAILURE;
     }
 
     // TODO: --resizable flag
 
     size_t tableSize{0};
+    bool maintenance{false};
+    std::string loadFile{};
+    HugePages pages{HugePages::None};
   
     // TODO: Check for bit widths of size_t and unsigned long
     try {
@@ -340,11 +676,70 @@ int main(int argc, char* argv[]) {
         std::exit(-1);
     }
 
+    for(int i = 2; i < argc; ++i) {
+        std::string flag{argv[i]};
+        if(flag == "--maintenance") {
+            maintenance = true;
+        } else if(flag == "--load" && i + 1 < argc) {
+            loadFile = argv[++i];
+        } else if(flag == "--huge-pages") {
+            pages = HugePages::Transparent;
+        } else if(flag == "--hugetlb") {
+            pages = HugePages::Explicit;
+        } else {
+            std::cerr << "Unknown flag: " << flag << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
     // Initialize our HashTable which is managed by the server
     if(tableSize == 0) {
-        table = std::make_unique<HashTable<std::string, std::string>>();
+        table = std::make_unique<Table>(4, true, pages);
+        if(maintenance)
+            table->startMaintenance();
     } else {
-        table = std::make_unique<HashTable<std::string, std::string>>(tableSize, false);
+        table = std::make_unique<Table>(tableSize, false, pages);
+    }
+    if(pages != HugePages::None && table->hugePages() != pages) {
+        std::cerr << "Huge pages are unavailable, using "
+                  << (table->hugePages() == HugePages::Transparent ? "transparent huge pages" : "base pages") << std::endl;
+    }
+
+    if(!loadFile.empty()) {
+        // Every line holds a key and a value, optionally preceded by INSERT
+        // (like input_examples.txt)
+        std::ifstream input{loadFile};
+        if(!input) {
+            std::cerr << "Could not open " << loadFile << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::vector<std::pair<TableKey, TableValue>> pairs{};
+        std::string line;
+        while(std::getline(input, line)) {
+            std::stringstream ss(line);
+            std::vector<std::string> tokens{};
+            std::string token;
+            while(ss >> token) {
+                tokens.push_back(token);
+            }
+            // Other requests like GET or DELETE are of no interest here
+            if(!tokens.empty() && (tokens[0] == "GET" || tokens[0] == "DELETE"))
+                continue;
+            if(tokens.size() == 3 && tokens[0] == "INSERT")
+                tokens.erase(tokens.begin());
+            if(tokens.size() != 2 || tokens[0].length() > MAX_LENGTH_KEY || tokens[1].length() > MAX_LENGTH_VAL) {
+                std::cerr << "Skipping malformed line: " << line << std::endl;
+                continue;
+            }
+            pairs.emplace_back(TableKey{std::move(tokens[0])}, TableValue{StoredValue{std::move(tokens[1])}});
+        }
+        auto start = std::chrono::steady_clock::now();
+        const size_t total = pairs.size();
+        // The pairs are moved into the table instead of being copied
+        size_t loaded = table->bulk_load(std::move(pairs));
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "Loaded " << loaded << " of " << total << " pairs in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
     }
 
 
@@ -418,6 +813,10 @@ int main(int argc, char* argv[]) {
         std::cout << "---------------" << std::endl;
         std::cout << "HashTable:" << std::endl;
         std::cout << "Size: " << table->size() << "; Capacity: " << table->capacity() << "; Load Factor: " << table->load_factor() << std::endl;
+        LockStats locks = Table::lockStats();
+        std::cout << "Lock stripes: " << locks.spin << " spin, " << locks.readerBiased << " reader-biased, "
+                  << locks.fair << " fair; Contended reads: " << locks.contendedReads
+                  << "; Contended writes: " << locks.contendedWrites << " (" << locks.parkedWrites << " parked)" << std::endl;
         std::cout << "---------------" << std::endl;
     }
 
@@ -425,7 +824,7 @@ int main(int argc, char* argv[]) {
     Message exit_msg{};
     exit_msg.mode = Message::EXIT;
     for(size_t i = 0; i < slots; ++i) {
-        mailbox_ptr->msgs.push_back(exit_msg); 
+        while(mailbox_ptr->msgs.push_back(exit_msg, 1s) == -1) { }
     }
 
     // Wait for all threads to finish their jobs
@@ -435,6 +834,20 @@ int main(int argc, char* argv[]) {
 
     table->print_table();
 
+    // Tear down the change feed and the watch table
+    if(pump_thread.joinable())
+        pump_thread.join();
+    if(auto changes = feed.load()) {
+        changes->~ChangeFeed();
+        munmap(changes, sizeof(ChangeFeed));
+        shm_unlink(CHANGE_FEED_NAME);
+    }
+    if(auto versions = watches.load()) {
+        versions->~WatchTable();
+        munmap(versions, sizeof(WatchTable));
+        shm_unlink(WATCH_TABLE_NAME);
+    }
+
     // Destroy the MMap struct
     shared_mem->~MMap();
 
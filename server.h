@@ -1,8 +1,31 @@
 #pragma once
 
 #include <cstdint>
+#include <string>
+#include <string_view>
+#include "fixed_key.h"
+#include "interned.h"
 #include "message.h"
 
+// The types of the keys and values stored by the server. Building with
+// FIXED_LAYOUT=1 (see the Makefile) stores them inline in the HashTable's
+// entries, so requests are copied from the mailbox into the table with a
+// memcpy instead of allocating strings.
+#if defined(FIXED_LAYOUT)
+using TableKey    = FixedKey<MAX_LENGTH_KEY>;
+using StoredValue = FixedValue<MAX_LENGTH_VAL>;
+#else
+using TableKey    = std::string;
+using StoredValue = std::string;
+#endif
+
+// Building with INTERN_VALUES=1 stores every distinct value only once, see Interned
+#if defined(INTERN_VALUES)
+using TableValue = Interned<StoredValue>;
+#else
+using TableValue = StoredValue;
+#endif
+
 // Used to convert uint8_t arrays to uint32_t or uint64_t respectively
 union uint8_to_uint32 {
     uint32_t uint32;
@@ -33,3 +56,48 @@ void receiveMsg(Mailbox<slots>* mailbox);
  */
 void respond(Mailbox<slots>* mailbox, size_t idx, Message msg);
 
+/**
+ * Answers several GET requests at once using HashTable::get_batch(),
+ * which interleaves their lookups.
+ *
+ * @param mailbox a pointer to the Mailbox object in shared memory
+ * @param requests the GET requests and their slots' indices in the underlying CircularBuffer
+ */
+void respondGets(Mailbox<slots>* mailbox, std::vector<std::pair<Message, size_t>>& requests);
+
+/**
+ * Writes a response into the given slot and notifies the waiting client.
+ *
+ * @param mailbox a pointer to the Mailbox object in shared memory
+ * @param idx the slot's index in the underlying CircularBuffer
+ * @param response the response in the format of a struct Message
+ */
+void sendResponse(Mailbox<slots>* mailbox, size_t idx, Message& response);
+
+
+/**
+ * Converts a Message's key field into the table's key type.
+ *
+ * @param key the zero-terminated key field
+ * @returns the key
+ */
+TableKey toKey(const std::array<uint8_t, MAX_LENGTH_KEY>& key);
+
+/**
+ * Converts a Message's data field into the table's value type.
+ *
+ * @param data the zero-terminated data field
+ * @returns the value
+ */
+TableValue toValue(const std::array<uint8_t, MAX_LENGTH_VAL>& data);
+
+/**
+ * Copies a key or value into a zeroed Message field, truncating it if necessary.
+ *
+ * @param str the key or value
+ * @param bytes the Message field
+ */
+template <size_t N>
+void copyBytes(std::string_view str, std::array<uint8_t, N>& bytes) {
+    memcpy(bytes.data(), str.data(), std::min(str.size(), N));
+}
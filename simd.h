@@ -0,0 +1,412 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// hash_bytes_batch() has an AVX2 version on x86-64 even if the compiler doesn't
+// target AVX2, it's picked at runtime if the CPU supports it (see hash_batch_width())
+#if defined(__AVX2__) || (defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)))
+#define SIMD_HASH_AVX2 1
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(__AVX2__) || defined(SIMD_HASH_AVX2)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Small helpers for comparing several keys at once with SIMD instructions.
+ * AVX2 is used if the compiler targets it (e.g. -mavx2 or -march=native),
+ * otherwise SSE2, which every x86-64 CPU supports. Other platforms fall back
+ * to plain loops.
+ */
+
+#if defined(__AVX2__)
+using simd_vec_t = __m256i;
+#define SIMD_WIDTH 32
+#elif defined(__SSE2__)
+using simd_vec_t = __m128i;
+#define SIMD_WIDTH 16
+#else
+#define SIMD_WIDTH 0
+#endif
+
+#if SIMD_WIDTH > 0
+/**
+ * Compares SIMD_WIDTH / sizeof(T) integers at `keys` with `needle`.
+ *
+ * @returns a bitmask containing sizeof(T) set bits for every matching integer
+ */
+template <std::integral T>
+inline uint32_t simd_match_mask(const T* keys, T needle) {
+#if defined(__AVX2__)
+    simd_vec_t v = _mm256_loadu_si256(reinterpret_cast<const simd_vec_t*>(keys));
+    simd_vec_t cmp;
+    if constexpr(sizeof(T) == 1) {
+        cmp = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(static_cast<char>(needle)));
+    } else if constexpr(sizeof(T) == 2) {
+        cmp = _mm256_cmpeq_epi16(v, _mm256_set1_epi16(static_cast<short>(needle)));
+    } else if constexpr(sizeof(T) == 4) {
+        cmp = _mm256_cmpeq_epi32(v, _mm256_set1_epi32(static_cast<int>(needle)));
+    } else {
+        cmp = _mm256_cmpeq_epi64(v, _mm256_set1_epi64x(static_cast<long long>(needle)));
+    }
+    return static_cast<uint32_t>(_mm256_movemask_epi8(cmp));
+#else
+    simd_vec_t v = _mm_loadu_si128(reinterpret_cast<const simd_vec_t*>(keys));
+    simd_vec_t cmp;
+    if constexpr(sizeof(T) == 1) {
+        cmp = _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(needle)));
+    } else if constexpr(sizeof(T) == 2) {
+        cmp = _mm_cmpeq_epi16(v, _mm_set1_epi16(static_cast<short>(needle)));
+    } else if constexpr(sizeof(T) == 4) {
+        cmp = _mm_cmpeq_epi32(v, _mm_set1_epi32(static_cast<int>(needle)));
+    } else {
+        // SSE2 has no 64-bit comparison: Both 32-bit halves have to match
+        cmp = _mm_cmpeq_epi32(v, _mm_set1_epi64x(static_cast<long long>(needle)));
+        cmp = _mm_and_si128(cmp, _mm_shuffle_epi32(cmp, _MM_SHUFFLE(2, 3, 0, 1)));
+    }
+    return static_cast<uint32_t>(_mm_movemask_epi8(cmp));
+#endif
+}
+#endif
+
+// The number of integers of type T compared by a single SIMD instruction
+#define SIMD_LANES(T) std::max<size_t>(1, SIMD_WIDTH / sizeof(T))
+// `n` rounded up to whole SIMD registers of integers of type T
+#define SIMD_PADDED(T, n) (((n) + SIMD_LANES(T) - 1) / SIMD_LANES(T) * SIMD_LANES(T))
+
+/**
+ * Compares the first N (at most 8) integers at `keys` with `needle`,
+ * SIMD_WIDTH bytes at a time. `keys` has to be readable for
+ * SIMD_PADDED(T, N) integers.
+ *
+ * @returns a bitmask with the high bit set in byte i if keys[i] == needle, like swar_match()
+ */
+template <size_t N, std::integral T>
+inline uint64_t simd_match_bytes(const T* keys, T needle) {
+    static_assert(N <= 8);
+    uint64_t result = 0;
+#if SIMD_WIDTH > 0
+    constexpr size_t lanes = SIMD_LANES(T);
+    // The lowest of the sizeof(T) bits which simd_match_mask() sets per integer
+    constexpr uint32_t firsts = [] {
+        uint32_t bits = 0;
+        for(size_t i = 0; i < lanes; ++i) {
+            bits |= uint32_t{1} << (i * sizeof(T));
+        }
+        return bits;
+    }();
+    for(size_t i = 0; i < N; i += lanes) {
+        for(uint32_t mask = simd_match_mask(keys + i, needle) & firsts; mask; mask &= mask - 1) {
+            size_t j = i + static_cast<size_t>(__builtin_ctz(mask)) / sizeof(T);
+            if(j < N)
+                result |= uint64_t{0x80} << (j * 8);
+        }
+    }
+#else
+    for(size_t i = 0; i < N; ++i) {
+        if(keys[i] == needle)
+            result |= uint64_t{0x80} << (i * 8);
+    }
+#endif
+    return result;
+}
+
+/**
+ * Searches `n` contiguous integers for `needle`.
+ *
+ * @returns the index of the first integer equal to `needle`, `n` if there is none
+ */
+template <std::integral T>
+inline size_t simd_find(const T* keys, size_t n, T needle) {
+    size_t i = 0;
+#if SIMD_WIDTH > 0
+    constexpr size_t lanes = SIMD_WIDTH / sizeof(T);
+    for(; i + lanes <= n; i += lanes) {
+        uint32_t mask = simd_match_mask(keys + i, needle);
+        if(mask != 0)
+            return i + static_cast<size_t>(__builtin_ctz(mask)) / sizeof(T);
+    }
+#endif
+    for(; i < n; ++i) {
+        if(keys[i] == needle)
+            return i;
+    }
+    return n;
+}
+
+/**
+ * Compares the 8 bytes of `word` with `byte` at once (SIMD within a register).
+ * Bytes above a match may be reported as well, so callers have to verify them.
+ * A zero byte is never reported as long as `byte` has its high bit set.
+ *
+ * @returns a bitmask with the high bit set in every (possibly) matching byte
+ */
+inline uint64_t swar_match(uint64_t word, uint8_t byte) {
+    constexpr uint64_t lows  = 0x0101010101010101ULL;
+    constexpr uint64_t highs = 0x8080808080808080ULL;
+    uint64_t x = word ^ (lows * byte);
+    return (x - lows) & ~x & highs;
+}
+
+/**
+ * Compares `n` bytes at `a` and `b`, SIMD_WIDTH bytes at a time.
+ *
+ * @returns whether all bytes are equal
+ */
+inline bool simd_equal(const uint8_t* a, const uint8_t* b, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for(; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        simd_vec_t va = _mm256_loadu_si256(reinterpret_cast<const simd_vec_t*>(a + i));
+        simd_vec_t vb = _mm256_loadu_si256(reinterpret_cast<const simd_vec_t*>(b + i));
+        if(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb))) != UINT32_MAX)
+            return false;
+    }
+#elif defined(__SSE2__)
+    for(; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        simd_vec_t va = _mm_loadu_si128(reinterpret_cast<const simd_vec_t*>(a + i));
+        simd_vec_t vb = _mm_loadu_si128(reinterpret_cast<const simd_vec_t*>(b + i));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff)
+            return false;
+    }
+#endif
+    return std::memcmp(a + i, b + i, n - i) == 0;
+}
+
+// The number of bytes hash_bytes() consumes per step: four 64-bit lanes
+#define HASH_STRIPE 32
+
+namespace simd_detail {
+    // Every lane starts with and xors its input with its own constant
+    constexpr uint64_t hash_secret[4] = {
+        0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL
+    };
+    // Added to the secrets for every further stripe, so that stripes do not commute
+    constexpr uint64_t hash_stripe_key = 0x9e3779b97f4a7c15ULL;
+
+    // Folds the lanes and the length into the final hash
+    inline uint64_t hash_finalize(const uint64_t (&acc)[4], uint64_t length) {
+        uint64_t h = length * hash_stripe_key;
+        for(uint64_t lane : acc) {
+            h = (h ^ lane) * 0xff51afd7ed558ccdULL;
+            h ^= h >> 32;
+        }
+        h ^= h >> 29;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 32;
+        return h;
+    }
+
+    // Adds the stripes from byte `first` up to byte `n` to the lanes
+    inline void hash_stripes(uint64_t (&acc)[4], const uint8_t* bytes, size_t first, size_t n) {
+        uint64_t stripeKey = first / HASH_STRIPE * hash_stripe_key;
+        for(size_t i = first; i < n; i += HASH_STRIPE) {
+            for(size_t j = 0; j < 4; ++j) {
+                uint64_t word;
+                std::memcpy(&word, bytes + i + j * 8, sizeof(word));
+                uint64_t k = word ^ (hash_secret[j] + stripeKey);
+                acc[j] += (k & 0xffffffff) * (k >> 32);
+                acc[j ^ 1] += word;
+            }
+            stripeKey += hash_stripe_key;
+        }
+    }
+}
+
+/**
+ * The scalar version of hash_bytes(), which returns the same hashes.
+ */
+inline uint64_t hash_bytes_scalar(const uint8_t* bytes, size_t n, uint64_t length) {
+    uint64_t acc[4] = {simd_detail::hash_secret[0], simd_detail::hash_secret[1],
+                       simd_detail::hash_secret[2], simd_detail::hash_secret[3]};
+    simd_detail::hash_stripes(acc, bytes, 0, n);
+    return simd_detail::hash_finalize(acc, length);
+}
+
+/**
+ * Hashes `n` bytes, where `n` is a multiple of HASH_STRIPE, i.e. the caller
+ * pads its input with zeros. Every stripe is spread over four independent
+ * 64-bit lanes which only need 32x32 bit multiplications, so SSE2 processes
+ * two lanes per instruction.
+ *
+ * @param bytes the (padded) input
+ * @param n the padded length
+ * @param length the actual length, which is mixed into the hash
+ * @returns the hash
+ */
+inline uint64_t hash_bytes(const uint8_t* bytes, size_t n, uint64_t length) {
+#if defined(__SSE2__)
+    __m128i acc0 = _mm_set_epi64x(static_cast<long long>(simd_detail::hash_secret[1]), static_cast<long long>(simd_detail::hash_secret[0]));
+    __m128i acc1 = _mm_set_epi64x(static_cast<long long>(simd_detail::hash_secret[3]), static_cast<long long>(simd_detail::hash_secret[2]));
+    const __m128i secret0 = acc0;
+    const __m128i secret1 = acc1;
+    __m128i stripeKey = _mm_setzero_si128();
+    const __m128i stripeStep = _mm_set1_epi64x(static_cast<long long>(simd_detail::hash_stripe_key));
+    for(size_t i = 0; i < n; i += HASH_STRIPE) {
+        __m128i d0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+        __m128i d1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i + 16));
+        __m128i k0 = _mm_xor_si128(d0, _mm_add_epi64(secret0, stripeKey));
+        __m128i k1 = _mm_xor_si128(d1, _mm_add_epi64(secret1, stripeKey));
+        // Low times high half of every lane
+        acc0 = _mm_add_epi64(acc0, _mm_mul_epu32(k0, _mm_shuffle_epi32(k0, _MM_SHUFFLE(2, 3, 0, 1))));
+        acc1 = _mm_add_epi64(acc1, _mm_mul_epu32(k1, _mm_shuffle_epi32(k1, _MM_SHUFFLE(2, 3, 0, 1))));
+        // Every lane also adds its neighbour's input
+        acc0 = _mm_add_epi64(acc0, _mm_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc1 = _mm_add_epi64(acc1, _mm_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2)));
+        stripeKey = _mm_add_epi64(stripeKey, stripeStep);
+    }
+    uint64_t acc[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(acc), acc0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + 2), acc1);
+    return simd_detail::hash_finalize(acc, length);
+#else
+    return hash_bytes_scalar(bytes, n, length);
+#endif
+}
+
+// The number of inputs hash_bytes_batch() hashes side by side with AVX2, one per 64-bit lane
+#define HASH_BATCH 4
+
+/**
+ * Returns how many inputs hash_bytes_batch() hashes side by side on this CPU:
+ * HASH_BATCH if it supports AVX2, 1 otherwise. With SSE2, hash_bytes() already
+ * fills both lanes with a single input, so callers should then hash their
+ * inputs one by one instead of gathering them for hash_bytes_batch().
+ *
+ * @returns the batch width
+ */
+inline size_t hash_batch_width() {
+#if defined(__AVX2__)
+    return HASH_BATCH;
+#elif defined(SIMD_HASH_AVX2)
+    static const size_t width = []() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? size_t{HASH_BATCH} : size_t{1};
+    }();
+    return width;
+#else
+    return 1;
+#endif
+}
+
+#if defined(SIMD_HASH_AVX2)
+namespace simd_detail {
+    // The low 64 bits of a * b, from three 32x32 bit multiplications
+    SIMD_TARGET_AVX2 inline __m256i mul_avx2(__m256i a, __m256i b) {
+        __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                         _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+        return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+    }
+
+    // Low times high half of every lane of `word` xor `secret` + `stripeKey`
+    SIMD_TARGET_AVX2 inline __m256i product_avx2(__m256i word, __m256i secret, __m256i stripeKey) {
+        __m256i k = _mm256_xor_si256(word, _mm256_add_epi64(secret, stripeKey));
+        return _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32));
+    }
+
+    // A round of hash_finalize() for all four inputs
+    SIMD_TARGET_AVX2 inline __m256i fold_avx2(__m256i h, __m256i lane) {
+        const __m256i fold = _mm256_set1_epi64x(static_cast<long long>(0xff51afd7ed558ccdULL));
+        h = mul_avx2(_mm256_xor_si256(h, lane), fold);
+        return _mm256_xor_si256(h, _mm256_srli_epi64(h, 32));
+    }
+
+    /**
+     * The AVX2 version of hash_bytes_batch(), which hashes the inputs four at a time:
+     * every register holds the same lane of four inputs, so each instruction works
+     * for all of them instead of all four lanes of one input waiting on the same loads.
+     * Inputs of different lengths mask the lanes of those which already ended.
+     *
+     * @returns the amount of inputs hashed, `count` rounded down to a multiple of HASH_BATCH
+     */
+    SIMD_TARGET_AVX2 inline size_t hash_bytes_batch_avx2(const uint8_t* const* bytes, const size_t* n,
+                                                          const uint64_t* lengths, size_t count, uint64_t* hashes) {
+        // Inputs which already ended read zeros instead, their lanes are masked
+        alignas(HASH_STRIPE) static const uint8_t zeros[HASH_STRIPE] = {};
+        const __m256i secret0 = _mm256_set1_epi64x(static_cast<long long>(hash_secret[0]));
+        const __m256i secret1 = _mm256_set1_epi64x(static_cast<long long>(hash_secret[1]));
+        const __m256i secret2 = _mm256_set1_epi64x(static_cast<long long>(hash_secret[2]));
+        const __m256i secret3 = _mm256_set1_epi64x(static_cast<long long>(hash_secret[3]));
+        const __m256i stripeStep = _mm256_set1_epi64x(static_cast<long long>(hash_stripe_key));
+        const __m256i avalanche = _mm256_set1_epi64x(static_cast<long long>(0xc4ceb9fe1a85ec53ULL));
+        size_t i = 0;
+        for(; i + HASH_BATCH <= count; i += HASH_BATCH) {
+            __m256i acc0 = secret0;
+            __m256i acc1 = secret1;
+            __m256i acc2 = secret2;
+            __m256i acc3 = secret3;
+            const __m256i ends = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(n + i));
+            const size_t longest = std::max(std::max(n[i], n[i + 1]), std::max(n[i + 2], n[i + 3]));
+            __m256i stripeKey = _mm256_setzero_si256();
+            for(size_t s = 0; s < longest; s += HASH_STRIPE) {
+                // All ones in the lanes of inputs which have a stripe at s
+                __m256i active = _mm256_cmpgt_epi64(ends, _mm256_set1_epi64x(static_cast<long long>(s)));
+                const uint8_t* p0 = s < n[i] ? bytes[i] + s : zeros;
+                const uint8_t* p1 = s < n[i + 1] ? bytes[i + 1] + s : zeros;
+                const uint8_t* p2 = s < n[i + 2] ? bytes[i + 2] + s : zeros;
+                const uint8_t* p3 = s < n[i + 3] ? bytes[i + 3] + s : zeros;
+                __m256i r0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p0));
+                __m256i r1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p1));
+                __m256i r2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p2));
+                __m256i r3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p3));
+                // Transpose, so that wj holds word j of all four inputs
+                __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+                __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+                __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+                __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+                __m256i w0 = _mm256_permute2x128_si256(t0, t2, 0x20);
+                __m256i w1 = _mm256_permute2x128_si256(t1, t3, 0x20);
+                __m256i w2 = _mm256_permute2x128_si256(t0, t2, 0x31);
+                __m256i w3 = _mm256_permute2x128_si256(t1, t3, 0x31);
+                // Every lane also adds its neighbour's input
+                acc0 = _mm256_add_epi64(acc0, _mm256_and_si256(active, _mm256_add_epi64(product_avx2(w0, secret0, stripeKey), w1)));
+                acc1 = _mm256_add_epi64(acc1, _mm256_and_si256(active, _mm256_add_epi64(product_avx2(w1, secret1, stripeKey), w0)));
+                acc2 = _mm256_add_epi64(acc2, _mm256_and_si256(active, _mm256_add_epi64(product_avx2(w2, secret2, stripeKey), w3)));
+                acc3 = _mm256_add_epi64(acc3, _mm256_and_si256(active, _mm256_add_epi64(product_avx2(w3, secret3, stripeKey), w2)));
+                stripeKey = _mm256_add_epi64(stripeKey, stripeStep);
+            }
+
+            // hash_finalize() for all four inputs
+            __m256i h = mul_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(lengths + i)), stripeStep);
+            h = fold_avx2(h, acc0);
+            h = fold_avx2(h, acc1);
+            h = fold_avx2(h, acc2);
+            h = fold_avx2(h, acc3);
+            h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 29));
+            h = mul_avx2(h, avalanche);
+            h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 32));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(hashes + i), h);
+        }
+        return i;
+    }
+}
+#endif
+
+/**
+ * Hashes `count` inputs like hash_bytes() does, i.e. with the same results.
+ * If the CPU supports AVX2, four inputs are hashed at once, see hash_batch_width().
+ *
+ * @param bytes the (padded) inputs
+ * @param n the padded lengths, multiples of HASH_STRIPE
+ * @param lengths the actual lengths
+ * @param count the amount of inputs
+ * @param hashes receives the hashes
+ */
+inline void hash_bytes_batch(const uint8_t* const* bytes, const size_t* n, const uint64_t* lengths,
+                             size_t count, uint64_t* hashes) {
+    size_t i = 0;
+#if defined(SIMD_HASH_AVX2)
+    if(hash_batch_width() == HASH_BATCH)
+        i = simd_detail::hash_bytes_batch_avx2(bytes, n, lengths, count, hashes);
+#endif
+    for(; i < count; ++i) {
+        hashes[i] = hash_bytes(bytes[i], n[i], lengths[i]);
+    }
+}
@@ -0,0 +1,363 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "simd.h"
+
+// Maximum number of entries per block, the eighth tag byte is always empty
+#define BUCKET_SLOTS 7
+// Minimum number of entries per block
+#define BUCKET_MIN_SLOTS 4
+// Targeted size of a block's entries, which adds slots beyond BUCKET_MIN_SLOTS for small entries
+#define BUCKET_BLOCK_BYTES 128
+// Maximum size of a block's entries stored in the block itself, larger
+// entries are allocated one by one and the block only holds pointers to them
+#define BUCKET_INLINE_BYTES 512
+
+/**
+ * The entries of a single HashTable bucket.
+ * Instead of allocating a list node per entry, entries are stored in blocks of
+ * a few slots. The first block is part of the bucket itself, further blocks are
+ * only allocated once it is full. Every block keeps one tag byte per slot, which
+ * is derived from the entry's hash, so a lookup compares all tags of a block at
+ * once and only compares the keys of matching slots.
+ * Every block has at least BUCKET_MIN_SLOTS slots. If that many entries would
+ * take more than BUCKET_INLINE_BYTES (e.g. fixed-width strings), the entries
+ * are boxed: each one is allocated on its own and its slot only holds the
+ * pointer, so the tags stay in the bucket and large buckets don't waste memory.
+ * With SimdKeys, integer keys are additionally kept in a contiguous array per
+ * block, which lookups compare with SIMD instead of the tags (see
+ * simd_match_bytes()), so they don't depend on the hash's high bits. To keep
+ * such blocks about as small, they have fewer slots.
+ * Entries are stored densely, i.e. in positions 0 to size() - 1, and erase()
+ * fills the hole with the last entry, so their order is not preserved.
+ * Synchronization is left to the HashTable's bucket locks.
+ */
+template <typename K, typename V, bool SimdKeys = false>
+class SlotBlocks {
+    public:
+        using value_type = std::pair<K, V>;
+
+        // Whether the entries are allocated one by one instead of stored in the blocks
+        static constexpr bool boxed = BUCKET_MIN_SLOTS * sizeof(value_type) > BUCKET_INLINE_BYTES;
+
+        // Whether the blocks keep a copy of the keys which lookups compare instead of the tags
+        static constexpr bool simdKeys = SimdKeys && std::integral<K> && !std::same_as<K, bool> && !boxed;
+
+        // The number of slots per block. With simdKeys, the copies of the keys
+        // count towards BUCKET_BLOCK_BYTES and they fit in a single SIMD register
+        // unless that holds less than BUCKET_MIN_SLOTS keys
+        static constexpr size_t slots = boxed ? BUCKET_SLOTS
+                : simdKeys ? std::clamp<size_t>(std::min<size_t>(BUCKET_BLOCK_BYTES / (sizeof(value_type) + sizeof(K)), SIMD_LANES(K)),
+                                                BUCKET_MIN_SLOTS, BUCKET_SLOTS)
+                : std::clamp<size_t>(BUCKET_BLOCK_BYTES / sizeof(value_type), BUCKET_MIN_SLOTS, BUCKET_SLOTS);
+
+        /**
+         * A block of slots. Empty slots have the tag 0.
+         */
+        class Block {
+            public:
+                Block() = default;
+                Block(const Block&) = delete;
+                Block& operator=(const Block&) = delete;
+
+                // Returns a mask with the high bit set in the byte of every slot
+                // whose tag (possibly) equals `tag`, or whose key equals `key`
+                // with simdKeys
+                uint64_t match(const K& key, uint8_t tag) const {
+                    uint64_t word;
+                    std::memcpy(&word, _tags.data(), sizeof(word));
+                    if constexpr(simdKeys) {
+                        // Unused slots may hold any key
+                        return simd_match_bytes<slots>(_keys.data(), key) & word & 0x8080808080808080ULL;
+                    } else {
+                        return swar_match(word, tag);
+                    }
+                }
+
+                // Returns the slot index of the lowest byte set in a mask returned by match()
+                static size_t slot(uint64_t mask) {
+                    return static_cast<size_t>(std::countr_zero(mask)) / 8;
+                }
+
+                value_type* at(size_t i) {
+                    if constexpr(boxed)
+                        return _storage[i];
+                    else
+                        return std::launder(reinterpret_cast<value_type*>(_storage) + i);
+                }
+                const value_type* at(size_t i) const {
+                    return const_cast<Block*>(this)->at(i);
+                }
+
+                const Block* next() const {
+                    return _next.get();
+                }
+
+            private:
+                friend class SlotBlocks;
+
+                // Constructs the entry of slot `i` from `args`
+                template <typename... Args>
+                void construct(size_t i, Args&&... args) {
+                    if constexpr(boxed)
+                        _storage[i] = new value_type(std::forward<Args>(args)...);
+                    else
+                        std::construct_at(at(i), std::forward<Args>(args)...);
+                    if constexpr(simdKeys)
+                        _keys[i] = at(i)->first;
+                }
+
+                // Destroys the entry of slot `i`
+                void destroy(size_t i) {
+                    if constexpr(boxed)
+                        delete std::exchange(_storage[i], nullptr);
+                    else
+                        std::destroy_at(at(i));
+                }
+
+                struct NoKeys { };
+                using Keys = std::conditional_t<simdKeys, std::array<K, SIMD_PADDED(K, slots)>, NoKeys>;
+
+                std::array<uint8_t, 8> _tags{};
+                [[no_unique_address]] Keys _keys{};
+                std::unique_ptr<Block> _next;
+                using Storage = std::conditional_t<boxed, value_type* [slots], std::byte[slots * sizeof(value_type)]>;
+                alignas(value_type) Storage _storage;
+        };
+
+        template <bool Const>
+        class Iterator {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type        = SlotBlocks::value_type;
+                using difference_type   = std::ptrdiff_t;
+                using pointer           = std::conditional_t<Const, const value_type*, value_type*>;
+                using reference         = std::conditional_t<Const, const value_type&, value_type&>;
+
+                Iterator() = default;
+                // Allows converting an iterator to a const_iterator
+                template <bool C> requires (Const && !C)
+                Iterator(const Iterator<C>& other) : _block(other._block), _slot(other._slot) { }
+
+                reference operator*() const { return *_block->at(_slot); }
+                pointer operator->() const { return _block->at(_slot); }
+
+                Iterator& operator++() {
+                    if(++_slot == slots) {
+                        _block = _block->_next.get();
+                        _slot = 0;
+                    }
+                    // Entries are dense, the first empty slot marks the end
+                    if(_block && _block->_tags[_slot] == 0) {
+                        _block = nullptr;
+                        _slot = 0;
+                    }
+                    return *this;
+                }
+                Iterator operator++(int) {
+                    Iterator it = *this;
+                    ++*this;
+                    return it;
+                }
+
+                bool operator==(const Iterator& other) const {
+                    return _block == other._block && _slot == other._slot;
+                }
+
+            private:
+                friend class SlotBlocks;
+                friend class Iterator<!Const>;
+
+                using block_pointer = std::conditional_t<Const, const Block*, Block*>;
+
+                Iterator(block_pointer block, size_t slot) : _block(block), _slot(slot) { }
+
+                block_pointer _block{nullptr};
+                size_t _slot{0};
+        };
+
+        using iterator       = Iterator<false>;
+        using const_iterator = Iterator<true>;
+
+        SlotBlocks() = default;
+        SlotBlocks(const SlotBlocks&) = delete;
+        SlotBlocks& operator=(const SlotBlocks&) = delete;
+
+        ~SlotBlocks() {
+            clear();
+        }
+
+        /**
+         * Derives an entry's tag from its hash. The bucket index is taken from
+         * the hash's low bits, so the tag is taken from its high bits.
+         * The high bit is always set to tell used from empty slots.
+         */
+        static uint8_t tag(size_t hash) {
+            return static_cast<uint8_t>(hash >> (sizeof(size_t) * 8 - 7)) | 0x80;
+        }
+
+        iterator begin() { return _size == 0 ? end() : iterator{&_head, 0}; }
+        iterator end() { return iterator{}; }
+        const_iterator begin() const { return _size == 0 ? end() : const_iterator{&_head, 0}; }
+        const_iterator end() const { return const_iterator{}; }
+
+        // Returns an iterator to the entry at position `pos` < size()
+        iterator at(size_t pos) {
+            return iterator{locate(pos).second, pos % slots};
+        }
+
+        size_t size() const {
+            return _size;
+        }
+
+        bool empty() const {
+            return _size == 0;
+        }
+
+        // Returns the first block, which is part of the bucket itself
+        const Block* head() const {
+            return &_head;
+        }
+
+        /**
+         * Looks up `key`, only comparing the keys of slots with the given tag.
+         *
+         * @returns an iterator to the entry or end()
+         */
+        iterator find(const K& key, uint8_t tag) {
+            for(Block* block = &_head; block; block = block->_next.get()) {
+                for(uint64_t mask = block->match(key, tag); mask; mask &= mask - 1) {
+                    size_t i = Block::slot(mask);
+                    // Integer keys already matched exactly
+                    if(simdKeys || block->at(i)->first == key)
+                        return iterator{block, i};
+                }
+            }
+            return end();
+        }
+        const_iterator find(const K& key, uint8_t tag) const {
+            return const_cast<SlotBlocks*>(this)->find(key, tag);
+        }
+
+        /**
+         * Appends a new entry, allocating a new block if the last one is full.
+         *
+         * @returns an iterator to the new entry
+         */
+        iterator emplace(uint8_t tag, K key, V value) {
+            auto [prev, block] = locate(_size);
+            size_t i = _size % slots;
+            if(!block) {
+                prev->_next = std::make_unique<Block>();
+                block = prev->_next.get();
+            }
+            block->construct(i, std::move(key), std::move(value));
+            block->_tags[i] = tag;
+            ++_size;
+            return iterator{block, i};
+        }
+
+        /**
+         * Removes the entry at `it` by moving the last entry into its place.
+         * Invalidates all iterators.
+         */
+        void erase(const_iterator it) {
+            auto [prev, last] = locate(_size - 1);
+            size_t j = (_size - 1) % slots;
+            auto* block = const_cast<Block*>(it._block);
+
+            if(block != last || it._slot != j) {
+                if constexpr(boxed) {
+                    // Only the pointer has to move
+                    block->destroy(it._slot);
+                    block->_storage[it._slot] = std::exchange(last->_storage[j], nullptr);
+                } else {
+                    block->destroy(it._slot);
+                    block->construct(it._slot, std::move(*last->at(j)));
+                }
+                block->_tags[it._slot] = last->_tags[j];
+            }
+            // A no-op if the box was moved
+            last->destroy(j);
+            last->_tags[j] = 0;
+            --_size;
+
+            // Release the last block once it is empty
+            if(j == 0 && prev)
+                prev->_next.reset();
+        }
+
+        /**
+         * Removes all entries and releases all blocks but the first one.
+         */
+        void clear() {
+            for(auto it = begin(); it != end(); ++it) {
+                it._block->destroy(it._slot);
+            }
+            _head._tags = {};
+            _head._next.reset();
+            _size = 0;
+        }
+
+        /**
+         * Moves all entries of further blocks into freshly allocated ones, so
+         * the allocator can reuse or release the old blocks' memory, and calls
+         * f(entry) for every entry at its final position, e.g. to copy
+         * the entry's own heap storage as well.
+         * Invalidates all iterators.
+         */
+        template <typename F>
+        void relocate(F&& f) {
+            // Boxed entries of the first block are moved into new boxes as well
+            std::vector<std::unique_ptr<value_type>> boxes{};
+            for(size_t i = 0; i < std::min(_size, slots); ++i) {
+                if constexpr(boxed) {
+                    boxes.emplace_back(_head._storage[i]);
+                    _head._storage[i] = new value_type(std::move(*boxes.back()));
+                }
+                f(*_head.at(i));
+            }
+
+            // The old blocks are released once all their entries are moved
+            std::unique_ptr<Block> old = std::move(_head._next);
+            Block* tail = &_head;
+            for(Block* from = old.get(); from; from = from->_next.get()) {
+                tail->_next = std::make_unique<Block>();
+                tail = tail->_next.get();
+                for(size_t i = 0; i < slots && from->_tags[i] != 0; ++i) {
+                    tail->construct(i, std::move(*from->at(i)));
+                    from->destroy(i);
+                    tail->_tags[i] = std::exchange(from->_tags[i], 0);
+                    f(*tail->at(i));
+                }
+            }
+        }
+
+    private:
+        // Returns the block holding position `pos` (nullptr if it does not exist
+        // yet) and its predecessor
+        std::pair<Block*, Block*> locate(size_t pos) {
+            Block* prev = nullptr;
+            Block* block = &_head;
+            for(size_t i = pos / slots; i > 0; --i) {
+                prev = block;
+                block = block->_next.get();
+            }
+            return {prev, block};
+        }
+
+        Block _head;
+        size_t _size{0};
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+#include "hashtable.h"
+
+/**
+ * A hashtable with a fixed amount of buckets known at compile time.
+ * It is a HashTable with a constant Capacity, so it has the same buckets
+ * (SlotBlocks behind a lock chosen by the LockPolicy) and operations, but it
+ * does not need a global lock or the resizing logic, the bucket array is
+ * stored inline (so the StaticHashTable can e.g. be a static object) and the
+ * bucket index is computed by a modulo with a constant divisor.
+ * Each bucket's first slot block is part of the table as well, only buckets
+ * holding more entries than fit into it allocate further blocks.
+ *
+ * Since the buckets are stored inline, large StaticHashTables should not be
+ * placed on the stack.
+ */
+template <typename K, typename V, size_t Buckets, typename Locks = AdaptiveLocks, typename Hash = std::hash<K>>
+    requires (Buckets > 0)
+using StaticHashTable = HashTable<K, V, Locks, Hash, Buckets>;